@@ -14,13 +14,19 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <fstream>
+#include <map>
 
 #include <rld.h>
 #include <rld-cc.h>
 #include <rld-process.h>
+#include <rld-stats.h>
 
 namespace rld
 {
@@ -76,32 +82,278 @@ namespace rld
       return false;
     }
 
+    /**
+     * The probe cache file's header line. Change the version if the format
+     * changes.
+     */
+    static const char* probe_cache_header = "RLD-CC-CACHE,0001";
+
+    /**
+     * The probe cache entries. The key is the compiler key and the probe
+     * separated by a tab and the value is the probe's result.
+     */
+    typedef std::map < std::string, std::string > probe_entries;
+
+    /**
+     * The compiler's answers to the search path and file name probes are
+     * cached in this file. It is the RTEMS_LD_CC_CACHE environment variable
+     * or ~/.rtems-ld-cc.cache and an empty name disables the cache.
+     */
+    static std::string   probe_cache;
+    static bool          probe_cache_set;
+    static probe_entries probes;
+    static bool          probes_loaded;
+    static std::string   compiler_path;
+    static std::string   compiler_mtime;
+    static std::string   compiler_size;
+    static std::string   compiler_key;
+
+    static const std::string&
+    probe_cache_path ()
+    {
+      if (!probe_cache_set)
+      {
+        /*
+         * An empty environment variable turns the cache off.
+         */
+        const char* env = ::getenv ("RTEMS_LD_CC_CACHE");
+        if (env)
+          probe_cache = env;
+        else
+        {
+          const char* home = ::getenv ("HOME");
+          if (home && *home)
+            rld::files::path_join (home, ".rtems-ld-cc.cache", probe_cache);
+        }
+        probe_cache_set = true;
+      }
+      return probe_cache;
+    }
+
+    /**
+     * Split a tab separated line. Empty fields are kept.
+     */
+    static void
+    split_fields (const std::string& line, strings& fields)
+    {
+      std::string::size_type start = 0;
+      while (true)
+      {
+        std::string::size_type end = line.find ('\t', start);
+        if (end == std::string::npos)
+        {
+          fields.push_back (line.substr (start));
+          break;
+        }
+        fields.push_back (line.substr (start, end - start));
+        start = end + 1;
+      }
+    }
+
+    /**
+     * Find the compiler the command will run and make the key its results are
+     * held under. The key is empty if the compiler cannot be found.
+     */
+    static void
+    make_compiler_key (const rld::process::arg_container& args)
+    {
+      const std::string& cmd = args[0];
+
+      compiler_path.clear ();
+      compiler_key.clear ();
+
+      if (cmd.find_first_of (RLD_PATH_SEPARATOR) != std::string::npos)
+        compiler_path = cmd;
+      else
+      {
+        const char* env = ::getenv ("PATH");
+        if (env)
+        {
+          rld::files::paths paths;
+          rld::files::path_split (env, paths);
+          rld::files::find_file (compiler_path, cmd, paths);
+        }
+      }
+
+      if (compiler_path.empty ())
+        return;
+
+      struct stat sb;
+      if (::stat (compiler_path.c_str (), &sb) < 0)
+      {
+        compiler_path.clear ();
+        return;
+      }
+
+      compiler_mtime = rld::to_string (sb.st_mtime);
+      compiler_size = rld::to_string (sb.st_size);
+      compiler_key = (compiler_path + '\t' + compiler_mtime + '\t' +
+                      compiler_size + '\t' + march + '\t' + mcpu);
+    }
+
+    /**
+     * Load the cache. Entries for the compiler with a different time or size
+     * are stale and are dropped.
+     */
+    static void
+    load_probes ()
+    {
+      if (probes_loaded)
+        return;
+
+      probes_loaded = true;
+
+      const std::string& path = probe_cache_path ();
+      if (path.empty ())
+        return;
+
+      std::ifstream in (path.c_str ());
+      if (!in.is_open ())
+        return;
+
+      std::string line;
+      if (!std::getline (in, line) || (line != probe_cache_header))
+        return;
+
+      while (std::getline (in, line))
+      {
+        strings fields;
+        split_fields (line, fields);
+        if (fields.size () != 7)
+          continue;
+        std::string key = (fields[0] + '\t' + fields[1] + '\t' +
+                           fields[2] + '\t' + fields[3] + '\t' + fields[4]);
+        if ((fields[0] == compiler_path) &&
+            ((fields[1] != compiler_mtime) || (fields[2] != compiler_size)))
+          continue;
+        probes[key + '\t' + fields[5]] = fields[6];
+      }
+
+      if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        std::cout << "cc::cache: " << path << ": " << probes.size ()
+                  << " entries" << std::endl;
+    }
+
+    /**
+     * Write the cache. The file is written to a temporary and renamed so
+     * concurrent links do not see a partial file. Errors are not fatal, the
+     * compiler is asked next time.
+     */
+    static void
+    save_probes ()
+    {
+      const std::string& path = probe_cache_path ();
+      if (path.empty ())
+        return;
+
+      std::string tmp = path + '.' + rld::to_string (::getpid ());
+
+      {
+        std::ofstream out (tmp.c_str (), std::ios::out | std::ios::trunc);
+        if (!out.is_open ())
+          return;
+        out << probe_cache_header << std::endl;
+        for (probe_entries::const_iterator pi = probes.begin ();
+             pi != probes.end ();
+             ++pi)
+          out << (*pi).first << '\t' << (*pi).second << std::endl;
+        if (!out.good ())
+        {
+          out.close ();
+          ::unlink (tmp.c_str ());
+          return;
+        }
+      }
+
+      try
+      {
+        rld::files::rename_file (tmp, path);
+      }
+      catch (rld::error re)
+      {
+        ::unlink (tmp.c_str ());
+        if (rld::verbose () >= RLD_VERBOSE_INFO)
+          std::cout << "warning: cc::cache: " << re.what << std::endl;
+      }
+    }
+
+    /**
+     * Look for a probe's result in the cache.
+     */
+    static bool
+    find_probe (const std::string& probe, std::string& result)
+    {
+      if (compiler_key.empty ())
+        return false;
+      load_probes ();
+      probe_entries::const_iterator pi = probes.find (compiler_key + '\t' + probe);
+      if (pi == probes.end ())
+        return false;
+      result = (*pi).second;
+      if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        std::cout << "cc::cache: hit: " << probe << std::endl;
+      return true;
+    }
+
+    /**
+     * Add probe results to the cache. Results with a new line cannot be held.
+     */
+    static void
+    add_probe (const std::string& probe, const std::string& result)
+    {
+      if (compiler_key.empty () || (result.find ('\n') != std::string::npos))
+        return;
+      load_probes ();
+      probes[compiler_key + '\t' + probe] = result;
+    }
+
     static void
     search_dirs ()
     {
       rld::process::arg_container args;
 
       make_cc_command (args);
+      make_compiler_key (args);
+
+      if (find_probe ("install", install_path) &&
+          find_probe ("programs", programs_path) &&
+          find_probe ("libraries", libraries_path))
+      {
+        if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        {
+          std::cout << "cc::install: " << install_path << std::endl
+                    << "cc::programs: " << programs_path << std::endl
+                    << "cc::libraries: " << libraries_path << std::endl;
+        }
+        return;
+      }
+
       args.push_back ("-print-search-dirs");
 
-      rld::process::tempfile out;
-      rld::process::tempfile err;
+      std::string            out;
+      std::string            err;
       rld::process::status   status;
 
-      status = rld::process::execute ("gcc", args, out.name (), err.name ());
+      {
+        stats::phase phase ("cc-probe");
+        status = rld::process::execute (args, out, err);
+      }
 
       if ((status.type == rld::process::status::normal) &&
           (status.code == 0))
       {
         if (rld::verbose () >= RLD_VERBOSE_DETAILS)
-          out.output ("gcc", std::cout, true);
-        out.open ();
-        while (true)
+          rld::process::output ("gcc", out, std::cout, true);
+        std::string::size_type start = 0;
+        while (start < out.size ())
         {
-          std::string line;
-          out.getline (line);
-          if (line.size () == 0)
-            break;
+          std::string::size_type end = out.find ('\n', start);
+          if (end == std::string::npos)
+            end = out.size ();
+          else
+            ++end;
+          std::string line = out.substr (start, end - start);
+          start = end;
           if (match_and_trim ("install: ", line, install_path))
             continue;
           if (match_and_trim ("programs: ", line, programs_path))
@@ -109,17 +361,20 @@ namespace rld
           if (match_and_trim ("libraries: ", line, libraries_path))
             continue;
         }
-        out.close ();
         if (rld::verbose () >= RLD_VERBOSE_DETAILS)
         {
           std::cout << "cc::install: " << install_path << std::endl
                     << "cc::programs: " << programs_path << std::endl
                     << "cc::libraries: " << libraries_path << std::endl;
         }
+        add_probe ("install", install_path);
+        add_probe ("programs", programs_path);
+        add_probe ("libraries", libraries_path);
+        save_probes ();
       }
       else
       {
-        err.output ("gcc", std::cout);
+        rld::process::output ("gcc", err, std::cout);
       }
     }
 
@@ -129,28 +384,41 @@ namespace rld
       rld::process::arg_container args;
 
       make_cc_command (args);
+      make_compiler_key (args);
+
+      if (find_probe ("file-name=" + name, path))
+      {
+        if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+          std::cout << "cc::libpath: " << name << " -> " << path << std::endl;
+        return;
+      }
+
       args.push_back ("-print-file-name=" + name);
 
-      rld::process::tempfile out;
-      rld::process::tempfile err;
+      std::string            err;
       rld::process::status   status;
 
-      status = rld::process::execute ("gcc", args, out.name (), err.name ());
+      {
+        stats::phase phase ("cc-probe");
+        status = rld::process::execute (args, path, err);
+      }
 
       if ((status.type == rld::process::status::normal) &&
           (status.code == 0))
       {
         if (rld::verbose () >= RLD_VERBOSE_DETAILS)
-          out.output ("cc", std::cout, true);
-        out.open ();
-        out.get (path);
-        out.close ();
+          rld::process::output ("cc", path, std::cout, true);
+        if (!path.empty () && (path[path.size () - 1] == '\n'))
+          path.erase (path.size () - 1);
         if (rld::verbose () >= RLD_VERBOSE_DETAILS)
           std::cout << "cc::libpath: " << name << " -> " << path << std::endl;
+        add_probe ("file-name=" + name, path);
+        save_probes ();
       }
       else
       {
-        err.output ("cc", std::cout);
+        path.clear ();
+        rld::process::output ("cc", err, std::cout);
       }
     }
 
@@ -34,6 +34,8 @@
 
 #include <rld.h>
 #include <rld-compression.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 #include "fastlz.h"
 
@@ -44,11 +46,13 @@ namespace rld
     compressor::compressor (files::image& image,
                             size_t        size,
                             bool          out,
-                            bool          compress)
+                            bool          compress,
+                            int           fastlz_level)
       : image (image),
         size (size),
         out (out),
         compress (compress),
+        fastlz_level (fastlz_level),
         buffer (0),
         io (0),
         level (0),
@@ -58,8 +62,15 @@ namespace rld
       if (size > 0xffff)
         throw rld::error ("Size too big, 16 bits only", "compression");
 
+      if ((fastlz_level < 0) || (fastlz_level > 2))
+        throw rld::error ("Invalid FastLZ level", "compression");
+
+      /*
+       * FastLZ needs an output buffer 5% bigger than the input and no smaller
+       * than 66 bytes.
+       */
       buffer = new uint8_t[size];
-      io = new uint8_t[size + (size / 10)];
+      io = new uint8_t[size + (size / 10) + 66];
     }
 
     compressor::~compressor ()
@@ -236,11 +247,36 @@ namespace rld
     {
       if (out && ((forced && level) || (level >= size)))
       {
+        trace::span span ("compressor-output", "compress");
+
         if (compress)
         {
-          int     writing = ::fastlz_compress (buffer, level, io);
+          int     writing;
           uint8_t header[2];
 
+          {
+            stats::phase phase ("compress");
+            if (fastlz_level)
+              writing = ::fastlz_compress_level (fastlz_level,
+                                                 buffer, level, io);
+            else
+              writing = ::fastlz_compress (buffer, level, io);
+          }
+
+          /*
+           * A block that does not compress can grow and may not fit the
+           * header.
+           */
+          if (writing > 0xffff)
+          {
+            level = 0;
+            throw rld::error ("Compressed block too big, 16 bits only",
+                              "compression");
+          }
+
+          stats::count (stats::compress_raw, level);
+          stats::count (stats::compress_out, 2 + writing);
+
           if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
             std::cout << "rtl: comp: offset=" << total_compressed
                       << " block-size=" << writing << std::endl;
@@ -299,5 +335,85 @@ namespace rld
       }
     }
 
+    void
+    write_uleb128 (compressor& comp, uint32_t value)
+    {
+      uint8_t bytes[5];
+      size_t  length = 0;
+      do
+      {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value)
+          byte |= 0x80;
+        bytes[length++] = byte;
+      }
+      while (value);
+      comp.write (bytes, length);
+    }
+
+    void
+    write_sleb128 (compressor& comp, int32_t value)
+    {
+      uint8_t bytes[5];
+      size_t  length = 0;
+      bool    more = true;
+      while (more)
+      {
+        uint8_t byte = value & 0x7f;
+        /*
+         * Arithmetic shift so the sign is kept.
+         */
+        value = value < 0 ? ~(~value >> 7) : value >> 7;
+        if (((value == 0) && ((byte & 0x40) == 0)) ||
+            ((value == -1) && ((byte & 0x40) != 0)))
+          more = false;
+        else
+          byte |= 0x80;
+        bytes[length++] = byte;
+      }
+      comp.write (bytes, length);
+    }
+
+    uint32_t
+    read_uleb128 (compressor& comp)
+    {
+      uint32_t value = 0;
+      int      shift = 0;
+      uint8_t  byte;
+      do
+      {
+        if (shift > 28)
+          throw rld::error ("LEB128 field too long", "compression");
+        if (comp.read (&byte, 1) != 1)
+          throw rld::error ("Reading of value failed", "compression");
+        value |= ((uint32_t) (byte & 0x7f)) << shift;
+        shift += 7;
+      }
+      while (byte & 0x80);
+      return value;
+    }
+
+    int32_t
+    read_sleb128 (compressor& comp)
+    {
+      uint32_t value = 0;
+      int      shift = 0;
+      uint8_t  byte;
+      do
+      {
+        if (shift > 28)
+          throw rld::error ("LEB128 field too long", "compression");
+        if (comp.read (&byte, 1) != 1)
+          throw rld::error ("Reading of value failed", "compression");
+        value |= ((uint32_t) (byte & 0x7f)) << shift;
+        shift += 7;
+      }
+      while (byte & 0x80);
+      if ((shift < 32) && (byte & 0x40))
+        value |= ~0U << shift;
+      return (int32_t) value;
+    }
+
   }
 }
@@ -31,6 +31,14 @@ namespace rld
 {
   namespace compress
   {
+    /**
+     * The largest block that can be compressed. A block that does not
+     * compress is written by FastLZ as runs of up to 32 bytes each with a
+     * control byte so it grows by up to 1/32 and has to fit the 16 bit block
+     * header.
+     */
+    const size_t max_block_size = 63549;
+
     /**
      * A compressor.
      */
@@ -44,11 +52,15 @@ namespace rld
        * @param size The size of the input and output buffers.
        * @param out The compressor is compressing.
        * @param compress Set to false to disable compression.
+       * @param fastlz_level The FastLZ level, 1 or 2. The default of 0 lets
+       *                     FastLZ select the level from the size of the
+       *                     block.
        */
       compressor (files::image& image,
                   size_t        size,
                   bool          out = true,
-                  bool          compress = true);
+                  bool          compress = true,
+                  int           fastlz_level = 0);
 
       /**
        * Destruct the compressor.
@@ -148,6 +160,7 @@ namespace rld
       size_t        size;             //< The size of the buffer.
       bool          out;              //< If true the it is compression.
       bool          compress;         //< If true compress the data.
+      int           fastlz_level;     //< The FastLZ level, 0 for automatic.
       uint8_t*      buffer;           //< The decompressed buffer
       uint8_t*      io;               //< The I/O buffer.
       size_t        level;            //< The amount of data in the buffer.
@@ -192,6 +205,28 @@ namespace rld
       return v;
     }
 
+    /**
+     * Write an unsigned value to the compressor as a variable length LEB128
+     * field.
+     */
+    void write_uleb128 (compressor& comp, uint32_t value);
+
+    /**
+     * Write a signed value to the compressor as a variable length LEB128
+     * field.
+     */
+    void write_sleb128 (compressor& comp, int32_t value);
+
+    /**
+     * Read an unsigned variable length LEB128 field from the compressor.
+     */
+    uint32_t read_uleb128 (compressor& comp);
+
+    /**
+     * Read a signed variable length LEB128 field from the compressor.
+     */
+    int32_t read_sleb128 (compressor& comp);
+
   }
 }
 
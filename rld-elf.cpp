@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include <rld.h>
+#include <rld-stats.h>
 
 namespace rld
 {
@@ -534,6 +535,18 @@ namespace rld
           oclass = ::gelf_getclass (elf__);
           ident_str = elf_getident (elf__, &ident_size);
         }
+
+        if (stats::enabled ())
+        {
+          stats::count (archive ? stats::archives_opened : stats::objects_opened);
+
+          /*
+           * Libelf maps the file. Archive members are in the archive's map.
+           */
+          size_t raw_size = 0;
+          if (!archive_ && ::elf_rawfile (elf__, &raw_size))
+            stats::count (stats::bytes_mapped, raw_size);
+        }
       }
 
       fd_ = fd__;
@@ -641,8 +654,11 @@ namespace rld
 
       ::elf_flagphdr (elf_, ELF_C_SET, ELF_F_DIRTY);
 
-      if (::elf_update (elf_, ELF_C_WRITE) < 0)
+      off_t size = ::elf_update (elf_, ELF_C_WRITE);
+      if (size < 0)
         libelf_error ("elf_update:write: " + name_);
+
+      stats::count (stats::bytes_written, size);
     }
 
     void
@@ -794,6 +810,8 @@ namespace rld
           section& sec = *(*si);
           int      syms = sec.entries ();
 
+          stats::count (stats::symbols, syms);
+
           for (int s = 0; s < syms; ++s)
           {
             elf_sym esym;
@@ -909,6 +927,8 @@ namespace rld
         int      rels = sec.entries ();
         bool     rela = sec.type () == SHT_RELA;
 
+        stats::count (stats::relocations, rels);
+
         targetsec.set_reloc_type (rela);
 
         if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
@@ -1206,5 +1226,13 @@ namespace rld
                           "elf:check_file: " + file.name ());
     }
 
+    void
+    check_file_reset ()
+    {
+      elf_object_class = ELFCLASSNONE;
+      elf_object_machinetype = EM_NONE;
+      elf_object_datatype = ELFDATANONE;
+    }
+
   }
 }
@@ -30,6 +30,7 @@
 #include <vector>
 
 #include <rld.h>
+#include <rld-memory.h>
 
 namespace rld
 {
@@ -99,7 +100,9 @@ namespace rld
     /**
      * A container of relocation records.
      */
-    typedef std::vector < relocation > relocations;
+    typedef std::vector < relocation,
+                          memory::allocator < relocation,
+                                              memory::elf_relocs > > relocations;
 
     /**
      * An ELF Section. The current implementation only supports a single data
@@ -750,6 +753,12 @@ namespace rld
      */
     void check_file(const file& file);
 
+    /**
+     * Clear the global machine type, object class and data type so the next
+     * file checked becomes the default.
+     */
+    void check_file_reset ();
+
   }
 }
 
@@ -19,14 +19,23 @@
 #endif
 
 #include <algorithm>
+#include <set>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 #include <rld.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 #if __WIN32__
 #define CREATE_MODE (S_IRUSR | S_IWUSR)
@@ -86,7 +95,7 @@ namespace rld
     {
       size_t b = name.find_last_of (RLD_PATH_SEPARATOR);
       if (b != std::string::npos)
-        return name.substr (0, b - 1);
+        return name.substr (0, b == 0 ? 1 : b);
       return name;
     }
 
@@ -373,12 +382,16 @@ namespace rld
       {
         writable = writable_;
 
-        if (writable)
+        if (path == "-")
+          fd_ = ::dup (writable ? STDOUT_FILENO : STDIN_FILENO);
+        else if (writable)
           fd_ = ::open (path.c_str (), OPEN_FLAGS | O_RDWR | O_CREAT | O_TRUNC, CREATE_MODE);
         else
           fd_ = ::open (path.c_str (), OPEN_FLAGS | O_RDONLY);
+        stats::count (stats::syscalls);
         if (fd_ < 0)
           throw rld::error (::strerror (errno), "open:" + path);
+        stats::count (stats::files_opened);
       }
       else
       {
@@ -389,6 +402,27 @@ namespace rld
       ++references_;
     }
 
+    void
+    image::open_update ()
+    {
+      const std::string path = name_.path ();
+
+      if (rld::verbose () >= RLD_VERBOSE_TRACE_FILE)
+        std::cout << "image::open-update:  " << name (). full () << std::endl;
+
+      if (fd_ >= 0)
+        throw rld::error ("Image is open", "open-update:" + path);
+
+      fd_ = ::open (path.c_str (), OPEN_FLAGS | O_RDWR);
+      stats::count (stats::syscalls);
+      if (fd_ < 0)
+        throw rld::error (::strerror (errno), "open-update:" + path);
+      stats::count (stats::files_opened);
+
+      writable = true;
+      ++references_;
+    }
+
     void
     image::close ()
     {
@@ -402,6 +436,7 @@ namespace rld
         if (references_ == 0)
         {
           ::close (fd_);
+          stats::count (stats::syscalls);
           fd_ = -1;
         }
       }
@@ -413,9 +448,11 @@ namespace rld
       uint8_t* buffer = static_cast <uint8_t*> (buffer_);
       size_t   have_read = 0;
       size_t   to_read = size;
+      int      calls = 0;
       while (have_read < size)
       {
         const ssize_t rsize = ::read (fd (), buffer, to_read);
+        ++calls;
         if (rsize < 0)
           throw rld::error (strerror (errno), "read:" + name ().path ());
         if (rsize == 0)
@@ -424,6 +461,8 @@ namespace rld
         to_read -= rsize;
         buffer += rsize;
       }
+      stats::count (stats::syscalls, calls);
+      stats::count (stats::bytes_read, have_read);
       return have_read;
     }
 
@@ -433,21 +472,26 @@ namespace rld
       const uint8_t* buffer = static_cast <const uint8_t*> (buffer_);
       size_t         have_written = 0;
       size_t         to_write = size;
+      int            calls = 0;
       while (have_written < size)
       {
         const ssize_t wsize = ::write (fd (), buffer, to_write);
+        ++calls;
         if (wsize < 0)
           throw rld::error (strerror (errno), "write:" + name ().path ());
         have_written += wsize;
         to_write -= wsize;
         buffer += wsize;
       }
+      stats::count (stats::syscalls, calls);
+      stats::count (stats::bytes_written, have_written);
       return have_written;
     }
 
     void
     image::seek (off_t offset)
     {
+      stats::count (stats::syscalls);
       if (::lseek (fd (), name_.offset () + offset, SEEK_SET) < 0)
         throw rld::error (strerror (errno), "lseek:" + name ().path ());
     }
@@ -508,29 +552,85 @@ namespace rld
       return symbol_refs;
     }
 
+    /**
+     * The buffer used to copy when the host cannot copy between the files. It
+     * is aligned to a page.
+     */
+    #define COPY_FILE_BUFFER_SIZE  (128 * 1024)
+    #define COPY_FILE_BUFFER_ALIGN (4 * 1024)
+
+    /**
+     * Have the host copy the data from the input file's position to the
+     * output file's position. The host may share the file system blocks
+     * rather than copy them. The positions are moved by the amount copied.
+     *
+     * @return size_t The amount left to copy.
+     */
+    static size_t
+    copy_file_host (image& in, image& out, size_t size)
+    {
+      size_t copying = size;
+      int    calls = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+      while (size)
+      {
+        ssize_t r = ::copy_file_range (in.fd (), 0, out.fd (), 0, size, 0);
+        ++calls;
+        if (r <= 0)
+          break;
+        size -= r;
+      }
+#endif
+#ifdef HAVE_SENDFILE
+      while (size)
+      {
+        ssize_t r = ::sendfile (out.fd (), in.fd (), 0, size);
+        ++calls;
+        if (r <= 0)
+          break;
+        size -= r;
+      }
+#endif
+      stats::count (stats::syscalls, calls);
+      stats::count (stats::bytes_copied, copying - size);
+      return size;
+    }
+
     void
     copy_file (image& in, image& out, size_t size)
     {
-      #define COPY_FILE_BUFFER_SIZE (8 * 1024)
-      uint8_t* buffer = 0;
+      uint8_t* storage = 0;
 
       if (size == 0)
         size = in.name ().size ();
 
+      /*
+       * Images held in files are copied by the host if it can. Anything it
+       * cannot copy is copied using the images' read and write.
+       */
+      if ((in.fd () >= 0) && (out.fd () >= 0))
+        size = copy_file_host (in, out, size);
+
+      if (size == 0)
+        return;
+
       try
       {
-        buffer = new uint8_t[COPY_FILE_BUFFER_SIZE];
+        storage = new uint8_t[COPY_FILE_BUFFER_SIZE + COPY_FILE_BUFFER_ALIGN];
+
+        uint8_t* buffer =
+          storage + (COPY_FILE_BUFFER_ALIGN -
+                     ((uintptr_t) storage & (COPY_FILE_BUFFER_ALIGN - 1)));
+
         while (size)
         {
           /*
-           * @fixme the reading and writing are not POSIX; sigints could split them.
+           * Use the images' read and write so any kind of image can be
+           * copied. They handle short reads and writes.
            */
 
           size_t l = size < COPY_FILE_BUFFER_SIZE ? size : COPY_FILE_BUFFER_SIZE;
-          ssize_t r = ::read (in.fd (), buffer, l);
-
-          if (r < 0)
-            throw rld::error (::strerror (errno), "reading: " + in.name ().full ());
+          ssize_t r = in.read (buffer, l);
 
           if (r == 0)
           {
@@ -539,10 +639,7 @@ namespace rld
             throw rld::error ("input too short", oss.str ());
           }
 
-          ssize_t w = ::write (out.fd (), buffer, r);
-
-          if (w < 0)
-            throw rld::error (::strerror (errno), "writing: " + out.name ().full ());
+          ssize_t w = out.write (buffer, r);
 
           if (w != r)
             throw rld::error ("output trucated", "writing: " + out.name ().full ());
@@ -552,12 +649,143 @@ namespace rld
       }
       catch (...)
       {
-        delete [] buffer;
+        delete [] storage;
         throw;
       }
 
-      if (buffer)
-        delete [] buffer;
+      delete [] storage;
+    }
+
+    /**
+     * Copy a range of the input image to the output image's current position.
+     */
+    static void
+    copy_range (image& in, off_t offset, image& out, size_t size)
+    {
+      if (size)
+      {
+        in.seek (offset);
+        copy_file (in, out, size);
+      }
+    }
+
+    void
+    rename_file (const std::string& from, const std::string& to)
+    {
+      if (::rename (from.c_str (), to.c_str ()) < 0)
+      {
+        /*
+         * Some hosts cannot rename over an existing file.
+         */
+        ::unlink (to.c_str ());
+        if (::rename (from.c_str (), to.c_str ()) < 0)
+          throw rld::error (::strerror (errno), "rename:" + to);
+      }
+    }
+
+    memory_image::memory_image (const std::string& path)
+      : image (path),
+        position (0),
+        references_ (0)
+    {
+    }
+
+    memory_image::memory_image ()
+      : position (0),
+        references_ (0)
+    {
+    }
+
+    memory_image::~memory_image ()
+    {
+    }
+
+    void
+    memory_image::open (bool writable)
+    {
+      if (rld::verbose () >= RLD_VERBOSE_TRACE_FILE)
+        std::cout << "memory-image::open:  " << name (). full ()
+                  << " refs:" << references_ + 1
+                  << " writable:" << (char*) (writable ? "yes" : "no")
+                  << std::endl;
+
+      if (references_ == 0)
+      {
+        if (writable)
+          data_.clear ();
+        position = 0;
+      }
+
+      ++references_;
+    }
+
+    void
+    memory_image::close ()
+    {
+      if (references_ > 0)
+      {
+        if (rld::verbose () >= RLD_VERBOSE_TRACE_FILE)
+          std::cout << "memory-image::close: " << name ().full ()
+                    << " refs:" << references_ << std::endl;
+
+        --references_;
+      }
+    }
+
+    ssize_t
+    memory_image::read (void* buffer, size_t size)
+    {
+      if (position >= data_.size ())
+        return 0;
+      if (size > (data_.size () - position))
+        size = data_.size () - position;
+      ::memcpy (buffer, &data_[position], size);
+      position += size;
+      return size;
+    }
+
+    ssize_t
+    memory_image::write (const void* buffer_, size_t size)
+    {
+      const uint8_t* buffer = static_cast <const uint8_t*> (buffer_);
+      if (position > data_.size ())
+        data_.resize (position, 0);
+      size_t overwrite = data_.size () - position;
+      if (overwrite > size)
+        overwrite = size;
+      if (overwrite)
+        ::memcpy (&data_[position], buffer, overwrite);
+      data_.insert (data_.end (), buffer + overwrite, buffer + size);
+      position += size;
+      return size;
+    }
+
+    void
+    memory_image::seek (off_t offset)
+    {
+      if (offset < 0)
+        throw rld::error ("Invalid offset", "seek:" + name ().full ());
+      position = offset;
+    }
+
+    int
+    memory_image::references () const
+    {
+      return references_;
+    }
+
+    size_t
+    memory_image::size () const
+    {
+      return data_.size ();
+    }
+
+    const uint8_t*
+    memory_image::data () const
+    {
+      if (data_.empty ())
+        return 0;
+      return &data_[0];
     }
 
     /**
@@ -642,6 +870,8 @@ namespace rld
     void
     archive::load_objects (objects& objs)
     {
+      trace::span span ("archive-load", "files", name ().full ());
+
       off_t extended_file_names = 0;
       off_t offset = rld_archive_fhdr_base;
       size_t size = 0;
@@ -826,6 +1056,42 @@ namespace rld
         std::cout << "archive::create: " << name ().full ()
                   << ", objects: " << objects.size () << std::endl;
 
+      image_list             images;
+      std::vector < size_t > sizes;
+
+      for (object_list::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        object& obj = *(*oi);
+        images.push_back (&obj);
+        sizes.push_back (obj.name ().size ());
+      }
+
+      write_members (images, sizes);
+    }
+
+    void
+    archive::create (image_list& images)
+    {
+      if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        std::cout << "archive::create: " << name ().full ()
+                  << ", images: " << images.size () << std::endl;
+
+      std::vector < size_t > sizes;
+
+      for (image_list::iterator ii = images.begin ();
+           ii != images.end ();
+           ++ii)
+        sizes.push_back ((*ii)->size ());
+
+      write_members (images, sizes);
+    }
+
+    void
+    archive::write_members (image_list&                   images,
+                            const std::vector < size_t >& sizes)
+    {
       open (true);
 
       try
@@ -837,12 +1103,12 @@ namespace rld
          */
         std::string extended_file_names;
 
-        for (object_list::iterator oi = objects.begin ();
-             oi != objects.end ();
-             ++oi)
+        for (image_list::iterator ii = images.begin ();
+             ii != images.end ();
+             ++ii)
         {
-          object& obj = *(*oi);
-          const std::string&  oname = basename (obj.name ().oname ());
+          image& img = *(*ii);
+          const std::string&  oname = basename (img.name ().oname ());
           if (oname.length () >= rld_archive_fname_size)
             extended_file_names += oname + '\n';
         }
@@ -857,56 +1123,260 @@ namespace rld
           write (extended_file_names.c_str (), extended_file_names.length ());
         }
 
-        for (object_list::iterator oi = objects.begin ();
-             oi != objects.end ();
-             ++oi)
+        size_t member = 0;
+
+        for (image_list::iterator ii = images.begin ();
+             ii != images.end ();
+             ++ii, ++member)
+          write_member (*(*ii), sizes[member], extended_file_names);
+      }
+      catch (...)
+      {
+        close ();
+        throw;
+      }
+
+      close ();
+    }
+
+    void
+    archive::write_member (image&             img,
+                           size_t             size,
+                           const std::string& extended_file_names)
+    {
+      img.open ();
+
+      try
+      {
+        std::string oname = basename (img.name ().oname ());
+
+        /*
+         * Convert the file name to an offset into the extended file name
+         * table if the file name is too long for the header.
+         */
+
+        if (oname.length () >= rld_archive_fname_size)
+        {
+          size_t pos = extended_file_names.find (oname + '\n');
+          if (pos == std::string::npos)
+            throw rld_error_at ("extended file name not found");
+          std::ostringstream oss;
+          oss << '/' << pos;
+          oname = oss.str ();
+        }
+        else oname += '/';
+
+        write_header (oname, 0, 0, 0, 0666, (size + 1) & ~1);
+        if (size)
         {
-          object& obj = *(*oi);
+          img.seek (0);
+          copy_file (img, *this, size);
+        }
+        if (size & 1)
+          write ("\n", 1);
+      }
+      catch (...)
+      {
+        img.close ();
+        throw;
+      }
+
+      img.close ();
+    }
 
-          obj.open ();
+    off_t
+    archive::member_header (object& obj) const
+    {
+      archive* ar = obj.get_archive ();
+      if (ar && (ar->name ().path () == name ().path ()))
+        return obj.name ().offset () - rld_archive_fhdr_size;
+      return -1;
+    }
+
+    void
+    archive::update (object_list& objects)
+    {
+      if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        std::cout << "archive::update: " << name ().full ()
+                  << ", objects: " << objects.size () << std::endl;
+
+      if (!name ().exists ())
+      {
+        create (objects);
+        return;
+      }
+
+      /*
+       * Scan the existing archive for the offset of each member's header and
+       * the GNU extended file name table. A symbol table would be out of date
+       * so the archive is written again without it.
+       */
+      std::vector < off_t > headers;
+      std::string           extended_file_names;
+      off_t                 archive_end = rld_archive_fhdr_base;
+      bool                  in_place = true;
+
+      open ();
+
+      try
+      {
+        uint8_t ident[rld_archive_ident_size];
+
+        if (!seek_read (0, ident, rld_archive_ident_size) ||
+            (::memcmp (ident, rld_archive_ident, rld_archive_ident_size) != 0))
+          in_place = false;
+
+        uint8_t header[rld_archive_fhdr_size];
+
+        while (in_place && read_header (archive_end, &header[0]))
+        {
+          size_t size =
+            (scan_decimal (&header[rld_archive_size],
+                           rld_archive_size_size) + 1) & ~1;
+
+          if ((header[0] == '/') && (header[1] == '/'))
+          {
+            extended_file_names.resize (size);
+            if (size &&
+                !seek_read (archive_end + rld_archive_fhdr_size,
+                            (uint8_t*) &extended_file_names[0], size))
+              in_place = false;
+          }
+          else if ((header[0] == '/') && (header[1] == ' '))
+            in_place = false;
+          else
+            headers.push_back (archive_end);
+
+          archive_end += rld_archive_fhdr_size + size;
+        }
+
+        /*
+         * The members at the start of the archive that are not changed.
+         */
+        size_t                kept = 0;
+        object_list::iterator oi = objects.begin ();
+
+        while ((oi != objects.end ()) && (kept < headers.size ()) &&
+               (member_header (*(*oi)) == headers[kept]))
+        {
+          ++kept;
+          ++oi;
+        }
+
+        /*
+         * The headers of the members written are copied or the new members
+         * use the existing extended file name table. A new long file name
+         * needs a new table and the whole archive is written.
+         */
+        bool append = kept == headers.size ();
+
+        for (object_list::iterator ni = oi; ni != objects.end (); ++ni)
+        {
+          if (member_header (*(*ni)) >= 0)
+          {
+            append = false;
+            continue;
+          }
+          const std::string oname = basename ((*ni)->name ().oname ());
+          if ((oname.length () >= rld_archive_fname_size) &&
+              (extended_file_names.find (oname + '\n') == std::string::npos))
+            in_place = false;
+        }
+
+        const std::string tmp_name = name ().path () + ".tmp";
+
+        if (!in_place)
+        {
+          if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+            std::cout << "archive::update: rewrite: " << name ().full ()
+                      << std::endl;
 
           try
           {
-            std::string oname = basename (obj.name ().oname ());
+            archive tmp (tmp_name);
+            tmp.create (objects);
+          }
+          catch (...)
+          {
+            ::unlink (tmp_name.c_str ());
+            throw;
+          }
+        }
+        else if (append)
+        {
+          if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+            std::cout << "archive::update: append: " << name ().full ()
+                      << ", members: " << headers.size ()
+                      << ", new: " << objects.size () - kept << std::endl;
+
+          close ();
+          open_update ();
 
+          try
+          {
+            seek (archive_end);
+            for (; oi != objects.end (); ++oi)
+              write_member (*(*oi), (*oi)->name ().size (),
+                            extended_file_names);
+          }
+          catch (...)
+          {
             /*
-             * Convert the file name to an offset into the extended file name
-             * table if the file name is too long for the header.
+             * Remove the partly appended members.
              */
+            if (::ftruncate (fd (), archive_end) < 0)
+              std::cerr << "error: truncating: " << name ().full () << std::endl;
+            throw;
+          }
+        }
+        else
+        {
+          if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+            std::cout << "archive::update: from member " << kept
+                      << ": " << name ().full () << std::endl;
+
+          try
+          {
+            archive tmp (tmp_name);
+
+            tmp.open (true);
+
+            const off_t kept_end =
+              kept < headers.size () ? headers[kept] : archive_end;
+
+            copy_range (*this, 0, tmp, kept_end);
 
-            if (oname.length () >= rld_archive_fname_size)
+            for (; oi != objects.end (); ++oi)
             {
-              size_t pos = extended_file_names.find (oname + '\n');
-              if (pos == std::string::npos)
-                throw rld_error_at ("extended file name not found");
-              std::ostringstream oss;
-              oss << '/' << pos;
-              oname = oss.str ();
+              object& obj = *(*oi);
+              off_t   header = member_header (obj);
+              if (header >= 0)
+                copy_range (*this, header, tmp,
+                            rld_archive_fhdr_size + obj.name ().size ());
+              else
+                tmp.write_member (obj, obj.name ().size (),
+                                  extended_file_names);
             }
-            else oname += '/';
 
-            write_header (oname, 0, 0, 0, 0666, (obj.name ().size () + 1) & ~1);
-            obj.seek (0);
-            copy_file (obj, *this);
-            if (obj.name ().size () & 1)
-              write ("\n", 1);
+            tmp.close ();
           }
           catch (...)
           {
-            obj.close ();
+            ::unlink (tmp_name.c_str ());
             throw;
           }
-
-          obj.close ();
         }
+
+        close ();
+
+        if (!in_place || !append)
+          rename_file (tmp_name, name ().path ());
       }
       catch (...)
       {
         close ();
         throw;
       }
-
-      close ();
     }
 
     relocation::relocation (const elf::relocation& er)
@@ -940,6 +1410,7 @@ namespace rld
     section::load_relocations (const elf::section& es)
     {
       const elf::relocations& es_relocs = es.get_relocations ();
+      relocs.reserve (relocs.size () + es_relocs.size ());
       for (elf::relocations::const_iterator ri = es_relocs.begin ();
            ri != es_relocs.end ();
            ++ri)
@@ -969,13 +1440,13 @@ namespace rld
     }
 
     const section*
-    find (const sections& secs, const int index)
+    find (const section_refs& secs, const int index)
     {
-      for (sections::const_iterator si = secs.begin ();
+      for (section_refs::const_iterator si = secs.begin ();
            si != secs.end ();
            ++si)
       {
-        const section& sec = *si;
+        const section& sec = *(*si);
 
         if (index == sec.index)
           return &sec;
@@ -984,12 +1455,19 @@ namespace rld
       return 0;
     }
 
+    /**
+     * The sequence of the next object created.
+     */
+    static unsigned long object_sequence;
+
     object::object (archive& archive_, file& name_)
       : image (name_),
         archive_ (&archive_),
         valid_ (false),
         resolving_ (false),
-        resolved_ (false)
+        resolved_ (false),
+        loaded_ (false),
+        sequence_ (object_sequence++)
     {
       if (!name ().is_valid ())
         throw rld_error_at ("name is empty");
@@ -1000,7 +1478,9 @@ namespace rld
         archive_ (0),
         valid_ (false),
         resolving_ (false),
-        resolved_ (false)
+        resolved_ (false),
+        loaded_ (false),
+        sequence_ (object_sequence++)
     {
       if (!name ().is_valid ())
         throw rld_error_at ("name is empty");
@@ -1010,7 +1490,9 @@ namespace rld
       : archive_ (0),
         valid_ (false),
         resolving_ (false),
-        resolved_ (false)
+        resolved_ (false),
+        loaded_ (false),
+        sequence_ (object_sequence++)
     {
     }
 
@@ -1055,6 +1537,8 @@ namespace rld
        * Begin a session.
        */
 
+      trace::span span ("object-begin", "files", name ().full ());
+
       if (rld::verbose () >= RLD_VERBOSE_TRACE_FILE)
         std::cout << "object:begin: " << name ().full () << " in-archive:"
                   << ((char*) (archive_ ? "yes" : "no")) << std::endl;
@@ -1092,6 +1576,8 @@ namespace rld
 
           elf ().get_sections (elf_secs, 0);
 
+          secs.reserve (elf_secs.size ());
+
           for (elf::sections::const_iterator esi = elf_secs.begin ();
                esi != elf_secs.end ();
                ++esi)
@@ -1125,9 +1611,26 @@ namespace rld
     void
     object::load_symbols (rld::symbols::table& symbols, bool local)
     {
+      trace::span span ("load-symbols", "files", name ().full ());
+
       if (rld::verbose () >= RLD_VERBOSE_TRACE_SYMS)
         std::cout << "object:load-sym: " << name ().full () << std::endl;
 
+      if (loaded_)
+      {
+        for (symbols::pointers::iterator si = externals.begin ();
+             si != externals.end ();
+             ++si)
+        {
+          symbols::symbol& sym = *(*si);
+          if (sym.binding () == STB_WEAK)
+            symbols.add_weak (sym);
+          else
+            symbols.add_external (sym);
+        }
+        return;
+      }
+
       rld::symbols::pointers syms;
 
       elf ().get_symbols (syms, false, local, false, true);
@@ -1191,11 +1694,21 @@ namespace rld
 
         unresolved[sym.name ()] = &sym;
       }
+
+      loaded_ = true;
+    }
+
+    bool
+    object::symbols_loaded () const
+    {
+      return loaded_;
     }
 
     void
     object::load_relocations ()
     {
+      trace::span span ("load-relocations", "files", name ().full ());
+
       if (rld::verbose () >= RLD_VERBOSE_TRACE)
         std::cout << "object:load-relocs: " << name ().full () << std::endl;
 
@@ -1249,6 +1762,12 @@ namespace rld
       return archive_;
     }
 
+    const archive*
+    object::get_archive () const
+    {
+      return archive_;
+    }
+
     rld::symbols::symtab&
     object::unresolved_symbols ()
     {
@@ -1262,10 +1781,10 @@ namespace rld
     }
 
     void
-    object::get_sections (sections& filtered_secs,
-                          uint32_t  type,
-                          uint64_t  flags_in,
-                          uint64_t  flags_out)
+    object::get_sections (section_refs& filtered_secs,
+                          uint32_t      type,
+                          uint64_t      flags_in,
+                          uint64_t      flags_out)
     {
       for (sections::const_iterator si = secs.begin ();
            si != secs.end ();
@@ -1278,14 +1797,15 @@ namespace rld
               (((sec.flags & flags_in) == flags_in) &&
                ((sec.flags & flags_out) == 0)))
           {
-            filtered_secs.push_back (sec);
+            filtered_secs.push_back (&sec);
           }
         }
       }
     }
 
     void
-    object::get_sections (sections& filtered_secs, const std::string& matching_name)
+    object::get_sections (section_refs&      filtered_secs,
+                          const std::string& matching_name)
     {
       for (sections::const_iterator si = secs.begin ();
            si != secs.end ();
@@ -1294,7 +1814,7 @@ namespace rld
         const section& sec = *si;
         if (sec.name == matching_name)
         {
-          filtered_secs.push_back (sec);
+          filtered_secs.push_back (&sec);
         }
       }
     }
@@ -1345,6 +1865,34 @@ namespace rld
       return resolved_;
     }
 
+    void
+    object::set_reference (const std::string& symbol, const std::string& by)
+    {
+      if (ref_symbol.empty ())
+      {
+        ref_symbol = symbol;
+        ref_by = by;
+      }
+    }
+
+    const std::string&
+    object::reference_symbol () const
+    {
+      return ref_symbol;
+    }
+
+    const std::string&
+    object::referenced_by () const
+    {
+      return ref_by;
+    }
+
+    unsigned long
+    object::sequence () const
+    {
+      return sequence_;
+    }
+
     cache::cache ()
       : opened (false)
     {
@@ -1360,6 +1908,7 @@ namespace rld
     {
       if (!opened)
       {
+        stats::phase phase ("cache-open");
         collect_object_files ();
         archives_begin ();
         opened = true;
@@ -1401,6 +1950,7 @@ namespace rld
     void
     cache::add_libraries (paths& paths__)
     {
+      stats::phase phase ("archive-collection");
       for (paths::iterator pi = paths__.begin();
            pi != paths__.end();
            ++pi)
@@ -1511,6 +2061,8 @@ namespace rld
     void
     cache::load_symbols (rld::symbols::table& symbols, bool local)
     {
+      stats::phase phase ("symbol-load");
+
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "cache:load-sym: object files: " << objects_.size ()
                   << std::endl;
@@ -1520,11 +2072,16 @@ namespace rld
            ++oi)
       {
         object* obj = (*oi).second;
-        obj->open ();
-        obj->begin ();
-        obj->load_symbols (symbols, local);
-        obj->end ();
-        obj->close ();
+        if (obj->symbols_loaded ())
+          obj->load_symbols (symbols, local);
+        else
+        {
+          obj->open ();
+          obj->begin ();
+          obj->load_symbols (symbols, local);
+          obj->end ();
+          obj->close ();
+        }
       }
 
       if (rld::verbose () >= RLD_VERBOSE_INFO)
@@ -1542,7 +2099,7 @@ namespace rld
         object* obj = (*oi).second;
         if (obj)
         {
-          out << obj->name ().full () << ':' << std::endl;
+          out << obj->name ().full () << ':' << '\n';
           rld::symbols::output (out, obj->unresolved_symbols ());
         }
       }
@@ -1617,14 +2174,14 @@ namespace rld
     cache::output_archive_files (std::ostream& out)
     {
       for (archives::iterator ai = archives_.begin (); ai != archives_.end (); ++ai)
-        out << ' ' << (*ai).second->name ().full () << std::endl;
+        out << ' ' << (*ai).second->name ().full () << '\n';
     }
 
     void
     cache::output_object_files (std::ostream& out)
     {
       for (objects::iterator oi = objects_.begin (); oi != objects_.end (); ++oi)
-        out << ' ' << (*oi).second->name ().full () << std::endl;
+        out << ' ' << (*oi).second->name ().full () << '\n';
     }
 
     void
@@ -1670,5 +2227,29 @@ namespace rld
       }
     }
 
+    bool
+    link_order (const object* lhs, const object* rhs)
+    {
+      bool lhs_member = lhs->get_archive () != 0;
+      bool rhs_member = rhs->get_archive () != 0;
+      if (lhs_member != rhs_member)
+        return rhs_member;
+      return lhs->sequence () < rhs->sequence ();
+    }
+
+    void
+    remove_duplicates (object_list& objects)
+    {
+      std::set < object* > seen;
+      object_list::iterator oi = objects.begin ();
+      while (oi != objects.end ())
+      {
+        if (seen.insert (*oi).second)
+          ++oi;
+        else
+          oi = objects.erase (oi);
+      }
+    }
+
   }
 }
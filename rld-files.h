@@ -38,6 +38,7 @@
 #include <vector>
 
 #include <rld.h>
+#include <rld-memory.h>
 
 namespace rld
 {
@@ -68,6 +69,11 @@ namespace rld
      */
     typedef std::list < object* > object_list;
 
+    /**
+     * Container list of images.
+     */
+    typedef std::list < image* > image_list;
+
     /**
      * Return the basename of the file name.
      *
@@ -318,7 +324,8 @@ namespace rld
 
       /**
        * Open the image. You can open the image more than once but you need to
-       * close it the same number of times.
+       * close it the same number of times. The path '-' is the standard input
+       * or the standard output if writable.
        *
        * @param writeable If true the image is open as writable. The default is
        *                  false.
@@ -453,6 +460,14 @@ namespace rld
         return writable;
       }
 
+    protected:
+
+      /**
+       * Open the image as writable keeping the existing data so it can be
+       * updated in place. The image must not be open.
+       */
+      void open_update ();
+
     private:
 
       file      name_;       //< The name of the file.
@@ -473,6 +488,112 @@ namespace rld
      */
     void copy (image& in, image& out, size_t size);
 
+    /**
+     * An image held in memory. It is read, written and seeked like a file
+     * image and grows as data is written past its end. The path names the
+     * image, for example when it is added to an archive, and nothing is
+     * created on disk. The image has no file descriptor and cannot be
+     * accessed with libelf.
+     */
+    class memory_image:
+      public image
+    {
+    public:
+      /**
+       * Construct the memory image.
+       *
+       * @param path The name of the image.
+       */
+      memory_image (const std::string& path);
+
+      /**
+       * Construct the memory image.
+       */
+      memory_image ();
+
+      /**
+       * Destruct the memory image.
+       */
+      virtual ~memory_image ();
+
+      /**
+       * Open the image. Opening an image that is not open as writable
+       * discards the data it holds.
+       *
+       * @param writeable If true the image is open as writable. The default is
+       *                  false.
+       */
+      virtual void open (bool writable = false);
+
+      /**
+       * Close the image. The data is held until the image is destructed.
+       */
+      virtual void close ();
+
+      /**
+       * Read a block from the image's current position.
+       *
+       * @param buffer The buffer to read the data into.
+       * @param size The amount of data to read.
+       * @return ssize_t The amount of data read.
+       */
+      virtual ssize_t read (void* buffer, size_t size);
+
+      /**
+       * Write a block at the image's current position.
+       *
+       * @param buffer The buffer of data to write.
+       * @param size The amount of data to write.
+       * @return ssize_t The amount of data written.
+       */
+      virtual ssize_t write (const void* buffer, size_t size);
+
+      /**
+       * Seek to the offset in the image. Seeking past the end of the image
+       * fills the gap with zeros when next written.
+       *
+       * @param offset The offset to seek too.
+       */
+      virtual void seek (off_t offset);
+
+      /**
+       * References to the image.
+       *
+       * @return int The number of references the image has.
+       */
+      virtual int references () const;
+
+      /**
+       * The size of the data in the image.
+       *
+       * @return size_t The size of the image.
+       */
+      virtual size_t size () const;
+
+      /**
+       * The image's data.
+       *
+       * @return const uint8_t* The data, 0 if the image is empty.
+       */
+      const uint8_t* data () const;
+
+    private:
+
+      std::vector < uint8_t > data_;       //< The image's data.
+      size_t                  position;    //< The read and write position.
+      int                     references_; //< The number of handles open.
+
+      /**
+       * Cannot copy via a copy constructor.
+       */
+      memory_image (const memory_image& orig);
+
+      /**
+       * Cannot assign using the assignment operator.
+       */
+      memory_image& operator= (const memory_image& rhs);
+    };
+
     /**
      * The archive class proivdes access to object files that are held in a AR
      * format file. GNU AR extensions are supported. The archive is a kind of
@@ -556,8 +677,58 @@ namespace rld
        */
       void create (object_list& objects);
 
+      /**
+       * Create a new archive containing the given set of images. The size of
+       * each image is the size of the member. If referening an existing
+       * archive it is overwritten.
+       *
+       * @param images The list of images to place in the archive.
+       */
+      void create (image_list& images);
+
+      /**
+       * Update an existing archive so it contains the given set of objects in
+       * order. Objects that are members of this archive are found by their
+       * offset. If the archive only gains members they are appended in
+       * place. Otherwise the members before the first change are copied as a
+       * single range to a temporary file, the rest of the archive is written
+       * after them and the temporary file is renamed to the archive. If the
+       * archive does not exist it is created.
+       *
+       * @param objects The list of objects to place in the archive.
+       */
+      void update (object_list& objects);
+
     private:
 
+      /**
+       * Write an image as a member of the archive at the current position.
+       *
+       * @param img The image to write.
+       * @param size The size of the image's member.
+       * @param extended_file_names The GNU extended file name table.
+       */
+      void write_member (image&             img,
+                         size_t             size,
+                         const std::string& extended_file_names);
+
+      /**
+       * The offset of the object's header if it is a member of this archive.
+       *
+       * @param obj The object file.
+       * @return off_t The header's offset or -1 if not a member.
+       */
+      off_t member_header (object& obj) const;
+
+      /**
+       * Write the archive with the images as members.
+       *
+       * @param images The list of images to place in the archive.
+       * @param sizes The size of each image's member.
+       */
+      void write_members (image_list&                  images,
+                          const std::vector < size_t >& sizes);
+
       /**
        * Read the archive header and check the magic number is valid.
        *
@@ -617,15 +788,15 @@ namespace rld
      */
     struct relocation
     {
-      const uint32_t    offset;    //< The section offset.
-      const uint32_t    type;      //< The type of relocation record.
-      const uint32_t    info;      //< The ELF info field.
-      const int32_t     addend;    //< The constant addend.
-      const std::string symname;   //< The name of the symbol.
-      const uint32_t    symtype;   //< The type of symbol.
-      const int         symsect;   //< The symbol's section symbol.
-      const uint32_t    symvalue;  //< The symbol's value.
-      const uint32_t    symbinding;//< The symbol's binding.
+      uint32_t    offset;    //< The section offset.
+      uint32_t    type;      //< The type of relocation record.
+      uint32_t    info;      //< The ELF info field.
+      int32_t     addend;    //< The constant addend.
+      std::string symname;   //< The name of the symbol.
+      uint32_t    symtype;   //< The type of symbol.
+      int         symsect;   //< The symbol's section symbol.
+      uint32_t    symvalue;  //< The symbol's value.
+      uint32_t    symbinding;//< The symbol's binding.
 
       /**
        * Construct from an ELF relocation record.
@@ -634,16 +805,18 @@ namespace rld
 
     private:
       /**
-       * The default constructor is not allowed due to all elements being
-       * const.
+       * The default constructor is not allowed.
        */
       relocation ();
     };
 
     /**
-     * A container of relocations.
+     * A container of relocations. The records are held in one block of
+     * memory.
      */
-    typedef std::list < relocation > relocations;
+    typedef std::vector < relocation,
+                          memory::allocator < relocation,
+                                              memory::file_relocs > > relocations;
 
     /**
      * The sections attributes. We extract what we want because the
@@ -652,17 +825,17 @@ namespace rld
      */
     struct section
     {
-      const std::string name;      //< The name of the section.
-      const int         index;     //< The section's index in the object file.
-      const uint32_t    type;      //< The type of section.
-      const size_t      size;      //< The size of the section.
-      const uint32_t    alignment; //< The alignment of the section.
-      const uint32_t    link;      //< The ELF link field.
-      const uint32_t    info;      //< The ELF info field.
-      const uint32_t    flags;     //< The ELF flags.
-      const off_t       offset;    //< The ELF file offset.
-      bool              rela;      //< Relocation records have the addend field.
-      relocations       relocs;    //< The sections relocations.
+      std::string name;      //< The name of the section.
+      int         index;     //< The section's index in the object file.
+      uint32_t    type;      //< The type of section.
+      size_t      size;      //< The size of the section.
+      uint32_t    alignment; //< The alignment of the section.
+      uint32_t    link;      //< The ELF link field.
+      uint32_t    info;      //< The ELF info field.
+      uint32_t    flags;     //< The ELF flags.
+      off_t       offset;    //< The ELF file offset.
+      bool        rela;      //< Relocation records have the addend field.
+      relocations relocs;    //< The sections relocations.
 
       /**
        * Construct from an ELF section.
@@ -680,16 +853,24 @@ namespace rld
 
     private:
       /**
-       * The default constructor is not allowed due to all elements being
-       * const.
+       * The default constructor is not allowed.
        */
       section ();
     };
 
     /**
-     * A container of sections.
+     * A container of sections. An object file's sections are loaded once and
+     * not added to so references to them are stable for the life of the
+     * object.
      */
-    typedef std::list < section > sections;
+    typedef std::vector < section,
+                          memory::allocator < section,
+                                              memory::file_sections > > sections;
+
+    /**
+     * A container of references to an object file's sections.
+     */
+    typedef std::vector < const section* > section_refs;
 
     /**
      * Sum the sizes of a container of sections.
@@ -699,7 +880,7 @@ namespace rld
     /**
      * Find the section that matches the index in the sections provided.
      */
-    const section* find (const sections& secs, const int index);
+    const section* find (const section_refs& secs, const int index);
 
     /**
      * The object file cab be in an archive or a file.
@@ -760,13 +941,21 @@ namespace rld
       bool valid () const;
 
       /**
-       * Load the symbols into the symbols table.
+       * Load the symbols into the symbols table. If the symbols have been
+       * loaded they are added to the table again without reading the file and
+       * the object does not need to be open.
        *
        * @param symbols The symbol table to load.
-       * @param local Include local symbols. The default is not to.
+       * @param local Include local symbols. The default is not to. Ignored
+       *              if the symbols have been loaded.
        */
       void load_symbols (symbols::table& symbols, bool local = false);
 
+      /**
+       * The symbols have been loaded.
+       */
+      bool symbols_loaded () const;
+
       /**
        * Load the relocations.
        */
@@ -797,6 +986,7 @@ namespace rld
        * not contained in an archive.
        */
       archive* get_archive ();
+      const archive* get_archive () const;
 
       /**
        * Return the unresolved symbol table for this object file.
@@ -809,7 +999,7 @@ namespace rld
       symbols::pointers& external_symbols ();
 
       /**
-       * Return a container sections that match the requested type and
+       * Return references to the sections that match the requested type and
        * flags. The filtered section container is not cleared so any matching
        * sections are appended.
        *
@@ -820,20 +1010,20 @@ namespace rld
        * @param flags_out The sections flags that must be clear. This is a
        *                 mask. If 0 this value is ignored.
        */
-      void get_sections (sections& filtered_secs,
-                         uint32_t  type = 0,
-                         uint64_t  flags_in = 0,
-                         uint64_t  flags_out = 0);
+      void get_sections (section_refs& filtered_secs,
+                         uint32_t      type = 0,
+                         uint64_t      flags_in = 0,
+                         uint64_t      flags_out = 0);
 
       /**
-       * Return a container sections that match the requested name. The
+       * Return references to the sections that match the requested name. The
        * filtered section container is not cleared so any matching sections are
        * appended.
        *
        * @param filtered_secs The container of the matching sections.
        * @param name The name of the section.
        */
-      void get_sections (sections& filtered_secs, const std::string& name);
+      void get_sections (section_refs& filtered_secs, const std::string& name);
 
       /**
        * Get a section given an index number.
@@ -867,6 +1057,33 @@ namespace rld
        */
       bool resolved () const;
 
+      /**
+       * Record why the object was pulled into the link. Only the first
+       * reference is kept.
+       *
+       * @param symbol The symbol the object was pulled in to resolve.
+       * @param by The object that referenced the symbol.
+       */
+      void set_reference (const std::string& symbol, const std::string& by);
+
+      /**
+       * The symbol the object was pulled in to resolve, empty if it was not
+       * pulled in.
+       */
+      const std::string& reference_symbol () const;
+
+      /**
+       * The object that referenced the symbol the object was pulled in to
+       * resolve.
+       */
+      const std::string& referenced_by () const;
+
+      /**
+       * The order the object was created in. Objects are created in the order
+       * the paths and archive members are loaded.
+       */
+      unsigned long sequence () const;
+
     private:
       archive*          archive_;   //< Points to the archive if part of an
                                     //  archive.
@@ -876,6 +1093,10 @@ namespace rld
       sections          secs;       //< The sections.
       bool              resolving_; //< The object is being resolved.
       bool              resolved_;  //< The object has been resolved.
+      bool              loaded_;    //< The symbols have been loaded.
+      std::string       ref_symbol; //< The symbol that pulled the object in.
+      std::string       ref_by;     //< The object referencing the symbol.
+      unsigned long     sequence_;  //< The order the object was created in.
 
       /**
        * Cannot copy via a copy constructor.
@@ -963,7 +1184,8 @@ namespace rld
       void collect_object_files (const std::string& path);
 
       /**
-       * Load the symbols into the symbol table.
+       * Load the symbols into the symbol table. Objects with their symbols
+       * loaded are not read again.
        *
        * @param symbols The symbol table to load.
        * @param locals Include local symbols. The default does not include them.
@@ -1045,7 +1267,9 @@ namespace rld
     };
 
     /**
-     * Copy the in file to the out file.
+     * Copy the in file to the out file from the current position of each
+     * image. If both images are files the host copies the data when it can,
+     * otherwise the images' read and write are used.
      *
      * @param in The input file.
      * @param out The output file.
@@ -1053,12 +1277,41 @@ namespace rld
      */
     void copy_file (image& in, image& out, size_t size = 0);
 
+    /**
+     * Rename a file replacing the file it is renamed to if it exists.
+     *
+     * @param from The file to rename.
+     * @param to The new name of the file.
+     */
+    void rename_file (const std::string& from, const std::string& to);
+
     /**
      * Find the libraries given the list of libraries as bare name which
      * have 'lib' and '.a' added.
      */
     void find_libraries (paths& libraries, paths& libpaths, paths& libs);
 
+    /**
+     * Remove the objects in the list more than once keeping the first. The
+     * order of the objects is not changed. Unlike list::unique the copies do
+     * not need to be next to each other.
+     *
+     * @param objects The list of objects.
+     */
+    void remove_duplicates (object_list& objects);
+
+    /**
+     * The link order of objects. The object files before the archive members
+     * and each in the order they are created. The order does not depend on
+     * where the objects are in memory so a link run by a server or in a batch
+     * orders the objects as a link on its own does.
+     *
+     * @param lhs The object to compare.
+     * @param rhs The object compared with.
+     * @retval true The lhs object is before the rhs object.
+     */
+    bool link_order (const object* lhs, const object* rhs);
+
   }
 }
 
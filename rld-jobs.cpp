@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker jobs run on a pool of worker threads.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <rld.h>
+#include <rld-jobs.h>
+
+namespace rld
+{
+  namespace jobs
+  {
+    /**
+     * The result of a job. Errors are held so they can be thrown on the
+     * caller's thread.
+     */
+    struct result
+    {
+      bool        failed;    //< The job threw an error.
+      std::string what;      //< The error.
+      std::string where;     //< Where the error happened.
+
+      result ();
+    };
+
+    typedef std::vector < result > results;
+
+    result::result ()
+      : failed (false)
+    {
+    }
+
+    job::~job ()
+    {
+    }
+
+    /**
+     * Run a job holding any error in the result.
+     */
+    static void
+    run_job (job& j, int worker, result& res)
+    {
+      try
+      {
+        j.run (worker);
+      }
+      catch (rld::error re)
+      {
+        res.failed = true;
+        res.what = re.what;
+        res.where = re.where;
+      }
+      catch (std::exception& e)
+      {
+        res.failed = true;
+        res.what = e.what ();
+        res.where = "jobs:run";
+      }
+      catch (...)
+      {
+        res.failed = true;
+        res.what = "unhandled exception";
+        res.where = "jobs:run";
+      }
+    }
+
+#ifdef HAVE_PTHREAD_H
+    /**
+     * The state shared by the workers. The next job and the failed flag are
+     * protected by the lock.
+     */
+    struct pool
+    {
+      job_list&       jobs;      //< The jobs to run.
+      results&        res;       //< The result of each job.
+      size_t          next;      //< The next job to start.
+      bool            failed;    //< A job has failed, start no more.
+      pthread_mutex_t lock;      //< Protect the pool.
+
+      pool (job_list& jobs, results& res);
+      ~pool ();
+
+      /**
+       * Get the next job to run. Returns false if there are no more jobs to
+       * start.
+       */
+      bool get (size_t& index);
+
+      /**
+       * Record a job's result.
+       */
+      void done (size_t index);
+    };
+
+    /**
+     * A worker's arguments.
+     */
+    struct worker_args
+    {
+      pool* p;        //< The pool.
+      int   worker;   //< The worker's index.
+    };
+
+    pool::pool (job_list& jobs, results& res)
+      : jobs (jobs),
+        res (res),
+        next (0),
+        failed (false)
+    {
+      if (::pthread_mutex_init (&lock, 0) != 0)
+        throw rld::error ("mutex create failed", "jobs:pool");
+    }
+
+    pool::~pool ()
+    {
+      ::pthread_mutex_destroy (&lock);
+    }
+
+    bool
+    pool::get (size_t& index)
+    {
+      bool got = false;
+      ::pthread_mutex_lock (&lock);
+      if (!failed && (next < jobs.size ()))
+      {
+        index = next;
+        ++next;
+        got = true;
+      }
+      ::pthread_mutex_unlock (&lock);
+      return got;
+    }
+
+    void
+    pool::done (size_t index)
+    {
+      if (res[index].failed)
+      {
+        ::pthread_mutex_lock (&lock);
+        failed = true;
+        ::pthread_mutex_unlock (&lock);
+      }
+    }
+
+    extern "C"
+    {
+      static void*
+      worker_main (void* arg)
+      {
+        worker_args& wa = *static_cast < worker_args* > (arg);
+        size_t       index;
+        while (wa.p->get (index))
+        {
+          run_job (*wa.p->jobs[index], wa.worker, wa.p->res[index]);
+          wa.p->done (index);
+        }
+        return 0;
+      }
+    }
+#endif
+
+    int
+    processors ()
+    {
+      int count = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+      long online = ::sysconf (_SC_NPROCESSORS_ONLN);
+      if (online > 0)
+        count = online;
+#endif
+      return count;
+    }
+
+    void
+    run (job_list& jobs, int& workers)
+    {
+      results res (jobs.size ());
+
+      if (workers < 1)
+        workers = 1;
+      if (workers > (int) jobs.size ())
+        workers = jobs.size ();
+
+#ifdef HAVE_PTHREAD_H
+      if (workers > 1)
+      {
+        pool                       p (jobs, res);
+        std::vector < pthread_t >  threads (workers);
+        std::vector < worker_args > args (workers);
+        int                        started = 0;
+
+        for (int w = 0; w < workers; ++w)
+        {
+          args[w].p = &p;
+          args[w].worker = w;
+          if (::pthread_create (&threads[w], 0, worker_main, &args[w]) != 0)
+            break;
+          ++started;
+        }
+
+        /*
+         * If no worker could be started run the jobs here.
+         */
+        if (started == 0)
+        {
+          worker_args wa;
+          wa.p = &p;
+          wa.worker = 0;
+          worker_main (&wa);
+          started = 1;
+        }
+        else
+        {
+          for (int w = 0; w < started; ++w)
+            ::pthread_join (threads[w], 0);
+        }
+
+        workers = started;
+      }
+      else
+#endif
+      {
+        workers = 1;
+        for (size_t j = 0; j < jobs.size (); ++j)
+        {
+          run_job (*jobs[j], 0, res[j]);
+          if (res[j].failed)
+            break;
+        }
+      }
+
+      if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+        std::cout << "jobs:run: jobs=" << jobs.size ()
+                  << " workers=" << workers << std::endl;
+
+      for (results::const_iterator ri = res.begin (); ri != res.end (); ++ri)
+      {
+        const result& r = *ri;
+        if (r.failed)
+          throw rld::error (r.what, r.where);
+      }
+    }
+  }
+}
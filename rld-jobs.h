@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker jobs run on a pool of worker threads.
+ *
+ */
+
+#if !defined (_RLD_JOBS_H_)
+#define _RLD_JOBS_H_
+
+#include <vector>
+
+namespace rld
+{
+  namespace jobs
+  {
+    /**
+     * A job is a piece of work that does not depend on any other job. A job
+     * may be run on any worker and must only touch state it owns or state
+     * owned by the worker running it.
+     */
+    class job
+    {
+    public:
+      /**
+       * Destruct the job.
+       */
+      virtual ~job ();
+
+      /**
+       * Run the job.
+       *
+       * @param worker The index of the worker running the job, starting
+       *               at 0. A worker runs one job at a time so per worker
+       *               state can be indexed by it.
+       */
+      virtual void run (int worker) = 0;
+    };
+
+    /**
+     * A container of jobs.
+     */
+    typedef std::vector < job* > job_list;
+
+    /**
+     * The number of workers to use when the user asks for as many as the host
+     * can run. This is the number of online processors.
+     */
+    int processors ();
+
+    /**
+     * Run the jobs on a pool of workers. The jobs are started in the order
+     * they are held in the list and the call returns when all started jobs
+     * have finished. If a job throws an error no more jobs are started and
+     * the error of the failed job earliest in the list is thrown. The jobs
+     * are run in order on the caller's thread if there is a single worker or
+     * the host has no threads.
+     *
+     * @param jobs The jobs to run.
+     * @param workers The number of workers. Returned with the number used.
+     */
+    void run (job_list& jobs, int& workers);
+  }
+}
+
+#endif
@@ -0,0 +1,849 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker map.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iomanip>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <rld.h>
+#include <rld-map.h>
+#include <rld-stats.h>
+
+namespace rld
+{
+  namespace map
+  {
+    /**
+     * A stream buffer that writes to a file descriptor when it is full or
+     * flushed. The standard output is line buffered when it is a terminal and
+     * std::endl flushes so a large map is a system call for each line
+     * without it.
+     */
+    class writer::output_buffer
+      : public std::streambuf
+    {
+    public:
+      output_buffer (int fd, size_t size);
+
+      /**
+       * The error number of the first write to fail, 0 if none have.
+       */
+      int error () const;
+
+    protected:
+      int_type overflow (int_type c);
+      int sync ();
+
+    private:
+      int                 fd;      //< The file descriptor.
+      std::vector < char > buffer; //< The buffer.
+      int                 error_;  //< The error number of a failed write.
+
+      /**
+       * Write the buffer to the file descriptor.
+       */
+      bool drain ();
+    };
+
+    writer::output_buffer::output_buffer (int fd, size_t size)
+      : fd (fd),
+        buffer (size),
+        error_ (0)
+    {
+      /*
+       * Keep a character at the end for overflow to add.
+       */
+      setp (&buffer[0], &buffer[0] + buffer.size () - 1);
+    }
+
+    int
+    writer::output_buffer::error () const
+    {
+      return error_;
+    }
+
+    writer::output_buffer::int_type
+    writer::output_buffer::overflow (int_type c)
+    {
+      if (!traits_type::eq_int_type (c, traits_type::eof ()))
+      {
+        *pptr () = traits_type::to_char_type (c);
+        pbump (1);
+      }
+      return drain () ? traits_type::not_eof (c) : traits_type::eof ();
+    }
+
+    int
+    writer::output_buffer::sync ()
+    {
+      return drain () ? 0 : -1;
+    }
+
+    bool
+    writer::output_buffer::drain ()
+    {
+      const char* data = pbase ();
+      size_t      size = pptr () - pbase ();
+
+      while (size && !error_)
+      {
+        ssize_t wrote = ::write (fd, data, size);
+        if (wrote < 0)
+        {
+          if (errno != EINTR)
+            error_ = errno;
+        }
+        else
+        {
+          data += wrote;
+          size -= wrote;
+        }
+      }
+
+      setp (&buffer[0], &buffer[0] + buffer.size () - 1);
+
+      return error_ == 0;
+    }
+
+    format
+    parse_format (const std::string& name)
+    {
+      if (name == "text")
+        return text;
+      if (name == "json")
+        return json;
+      if (name == "csv")
+        return csv;
+      throw rld::error ("invalid map format: " + name, "map");
+    }
+
+    static const char*
+    binding_name (int binding)
+    {
+      switch (binding)
+      {
+        case STB_LOCAL:
+          return "local";
+        case STB_GLOBAL:
+          return "global";
+        case STB_WEAK:
+          return "weak";
+        default:
+          break;
+      }
+      return "other";
+    }
+
+    static const char*
+    type_name (int type)
+    {
+      switch (type)
+      {
+        case STT_NOTYPE:
+          return "notype";
+        case STT_OBJECT:
+          return "object";
+        case STT_FUNC:
+          return "func";
+        case STT_SECTION:
+          return "section";
+        case STT_FILE:
+          return "file";
+        default:
+          break;
+      }
+      return "other";
+    }
+
+    /**
+     * The name of the section a symbol is in.
+     */
+    static const std::string
+    section_of (const symbols::symbol& sym)
+    {
+      int index = sym.section_index ();
+      switch (index)
+      {
+        case SHN_UNDEF:
+          return "UNDEF";
+        case SHN_ABS:
+          return "ABS";
+        case SHN_COMMON:
+          return "COMMON";
+        default:
+          break;
+      }
+      if (sym.object ())
+      {
+        try
+        {
+          return sym.object ()->get_section (index).name;
+        }
+        catch (rld::error re)
+        {
+        }
+      }
+      return "";
+    }
+
+    /**
+     * The name of an object file, empty if there is no object file.
+     */
+    static const std::string
+    object_name (const files::object* obj)
+    {
+      if (obj)
+        return obj->name ().full ();
+      return "";
+    }
+
+    /**
+     * The placements keyed by the object file and section index.
+     */
+    typedef std::pair < const files::object*, int > placement_key;
+    typedef std::map < placement_key, const rap::placement* > placement_index;
+
+    /**
+     * The details of a map being written.
+     */
+    struct details
+    {
+      const std::string&               title;
+      files::cache&                    cache;
+      symbols::table&                  symbols;
+      const rap::placements*           placed;
+      std::set < const files::object* > inputs;
+      std::set < const files::object* > linked;
+      placement_index                  places;
+
+      details (const std::string&        title,
+               files::cache&             cache,
+               symbols::table&           symbols,
+               const files::object_list* dependents,
+               const rap::placements*    placed);
+
+      /**
+       * Is the object file part of the link ?
+       */
+      bool is_linked (const files::object* obj) const;
+
+      /**
+       * Is the object file an input to the link ?
+       */
+      bool is_input (const files::object* obj) const;
+
+      /**
+       * Find a symbol's placement, 0 if not placed.
+       */
+      const rap::placement* find (const symbols::symbol& sym) const;
+    };
+
+    details::details (const std::string&        title,
+                      files::cache&             cache,
+                      symbols::table&           symbols,
+                      const files::object_list* dependents,
+                      const rap::placements*    placed)
+      : title (title),
+        cache (cache),
+        symbols (symbols),
+        placed (placed)
+    {
+      if (dependents)
+      {
+        files::object_list objects;
+        cache.get_objects (objects);
+        for (files::object_list::const_iterator oi = objects.begin ();
+             oi != objects.end ();
+             ++oi)
+        {
+          inputs.insert (*oi);
+          linked.insert (*oi);
+        }
+        for (files::object_list::const_iterator oi = dependents->begin ();
+             oi != dependents->end ();
+             ++oi)
+          linked.insert (*oi);
+      }
+
+      if (placed)
+      {
+        for (rap::placements::const_iterator pi = placed->begin ();
+             pi != placed->end ();
+             ++pi)
+          places[placement_key ((*pi).obj, (*pi).index)] = &(*pi);
+      }
+    }
+
+    bool
+    details::is_linked (const files::object* obj) const
+    {
+      return linked.find (obj) != linked.end ();
+    }
+
+    bool
+    details::is_input (const files::object* obj) const
+    {
+      return inputs.find (obj) != inputs.end ();
+    }
+
+    const rap::placement*
+    details::find (const symbols::symbol& sym) const
+    {
+      placement_index::const_iterator pi =
+        places.find (placement_key (sym.object (), sym.section_index ()));
+      if (pi == places.end ())
+        return 0;
+      return (*pi).second;
+    }
+
+    /**
+     * The symbols of a table in name order with the externals first.
+     */
+    static void
+    get_symbols (symbols::table& symbols, symbols::pointers& syms)
+    {
+      const symbols::symtab& externals = symbols.externals ();
+      for (symbols::symtab::const_iterator si = externals.begin ();
+           si != externals.end ();
+           ++si)
+        syms.push_back ((*si).second);
+      const symbols::symtab& weaks = symbols.weaks ();
+      for (symbols::symtab::const_iterator si = weaks.begin ();
+           si != weaks.end ();
+           ++si)
+        syms.push_back ((*si).second);
+    }
+
+    static void
+    write_text (std::ostream& out, details& d)
+    {
+      files::cache&    cache = d.cache;
+      files::archives& archives = cache.get_archives ();
+      files::objects&  objects = cache.get_objects ();
+
+      out << "Map: " << d.title << '\n'
+          << "Archive files    : " << cache.archive_count () << '\n'
+          << "Object files     : " << cache.object_count () << '\n'
+          << "Exported symbols : " << d.symbols.size () << '\n'
+          << "Archives:" << '\n';
+
+      for (files::archives::iterator ai = archives.begin ();
+           ai != archives.end ();
+           ++ai)
+        out << ' ' << (*ai).second->name ().full () << '\n';
+
+      out << "Objects:" << '\n';
+
+      for (files::objects::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        files::object* obj = (*oi).second;
+
+        if (!obj)
+          continue;
+
+        out << ' ' << obj->name ().full () << '\n';
+
+        if (d.is_input (obj))
+          out << "  linked: input" << '\n';
+        else if (d.is_linked (obj))
+          out << "  linked: " << obj->reference_symbol ()
+              << " referenced by " << obj->referenced_by () << '\n';
+
+        files::section_refs secs;
+        obj->get_sections (secs, 0, SHF_ALLOC, 0);
+
+        for (files::section_refs::const_iterator si = secs.begin ();
+             si != secs.end ();
+             ++si)
+        {
+          const files::section& sec = *(*si);
+          out << "  " << std::setw (24) << std::left << sec.name << std::right
+              << std::setw (10) << sec.size
+              << " align " << sec.alignment << '\n';
+        }
+      }
+
+      out << "Exported symbols:" << '\n';
+      rld::symbols::output (out, d.symbols);
+
+      out << "Symbol sections:" << '\n';
+
+      symbols::pointers syms;
+      get_symbols (d.symbols, syms);
+
+      for (symbols::pointers::const_iterator si = syms.begin ();
+           si != syms.end ();
+           ++si)
+      {
+        const symbols::symbol& sym = *(*si);
+        out << ' ' << std::setw (24) << std::left << sym.name ()
+            << ' ' << std::setw (20) << section_of (sym) << std::right
+            << ' ' << object_name (sym.object ());
+        const rap::placement* place = d.find (sym);
+        if (place)
+          out << ' ' << rap::section_name (place->sec)
+              << "+0x" << std::hex << place->offset + sym.value () << std::dec;
+        out << '\n';
+      }
+
+      out << "Unresolved symbols:" << '\n';
+      cache.output_unresolved_symbols (out);
+
+      if (d.placed)
+      {
+        out << "Layout:" << '\n';
+
+        int sec = -1;
+        for (rap::placements::const_iterator pi = d.placed->begin ();
+             pi != d.placed->end ();
+             ++pi)
+        {
+          const rap::placement& place = *pi;
+          if (place.sec != sec)
+          {
+            sec = place.sec;
+            out << ' ' << rap::section_name (sec) << ':' << '\n';
+          }
+          out << "  0x" << std::hex << std::setfill ('0')
+              << std::setw (8) << place.offset
+              << " 0x" << std::setw (8) << place.size
+              << std::dec << std::setfill (' ')
+              << ' ' << std::setw (3) << place.align
+              << ' ' << object_name (place.obj)
+              << ' ' << place.name << '\n';
+        }
+      }
+    }
+
+    static void
+    write_json (std::ostream& out, details& d, bool first)
+    {
+      files::cache&    cache = d.cache;
+      files::archives& archives = cache.get_archives ();
+      files::objects&  objects = cache.get_objects ();
+      const char*      sep;
+
+      out << (first ? "" : ",") << '\n'
+          << "  {" << '\n'
+          << "    \"name\": " << json_string (d.title) << ',' << '\n'
+          << "    \"archives\": [";
+
+      sep = "";
+      for (files::archives::iterator ai = archives.begin ();
+           ai != archives.end ();
+           ++ai)
+      {
+        out << sep << '\n'
+            << "      " << json_string ((*ai).second->name ().full ());
+        sep = ",";
+      }
+
+      out << '\n'
+          << "    ]," << '\n'
+          << "    \"objects\": [";
+
+      sep = "";
+      for (files::objects::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        files::object* obj = (*oi).second;
+
+        if (!obj)
+          continue;
+
+        out << sep << '\n'
+            << "      { \"name\": " << json_string (obj->name ().full ())
+            << ", \"archive\": " << json_string (obj->get_archive () ?
+                                                 obj->get_archive ()->name ().full () :
+                                                 "")
+            << ", \"linked\": " << (d.is_linked (obj) ? "true" : "false")
+            << ", \"reason\": ";
+        sep = ",";
+
+        if (d.is_input (obj))
+          out << "\"input\"";
+        else if (d.is_linked (obj))
+          out << "{ \"symbol\": " << json_string (obj->reference_symbol ())
+              << ", \"referenced-by\": " << json_string (obj->referenced_by ())
+              << " }";
+        else
+          out << "null";
+
+        out << ", \"sections\": [";
+
+        files::section_refs secs;
+        obj->get_sections (secs, 0, SHF_ALLOC, 0);
+
+        const char* ssep = "";
+        for (files::section_refs::const_iterator si = secs.begin ();
+             si != secs.end ();
+             ++si)
+        {
+          const files::section& sec = *(*si);
+          out << ssep
+              << " { \"name\": " << json_string (sec.name)
+              << ", \"index\": " << sec.index
+              << ", \"size\": " << sec.size
+              << ", \"align\": " << sec.alignment << " }";
+          ssep = ",";
+        }
+
+        out << " ] }";
+      }
+
+      out << '\n'
+          << "    ]," << '\n'
+          << "    \"symbols\": [";
+
+      symbols::pointers syms;
+      get_symbols (d.symbols, syms);
+
+      sep = "";
+      for (symbols::pointers::const_iterator si = syms.begin ();
+           si != syms.end ();
+           ++si)
+      {
+        const symbols::symbol& sym = *(*si);
+        out << sep << '\n'
+            << "      { \"name\": " << json_string (sym.name ())
+            << ", \"binding\": \"" << binding_name (sym.binding ()) << '"'
+            << ", \"type\": \"" << type_name (sym.type ()) << '"'
+            << ", \"value\": " << sym.value ()
+            << ", \"size\": " << sym.esym ().st_size
+            << ", \"object\": " << json_string (object_name (sym.object ()))
+            << ", \"section\": " << json_string (section_of (sym));
+        sep = ",";
+        const rap::placement* place = d.find (sym);
+        if (place)
+          out << ", \"rap-section\": \"" << rap::section_name (place->sec) << '"'
+              << ", \"rap-offset\": " << place->offset + sym.value ();
+        out << " }";
+      }
+
+      out << '\n'
+          << "    ]," << '\n'
+          << "    \"unresolved\": [";
+
+      sep = "";
+      for (files::objects::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        files::object* obj = (*oi).second;
+
+        if (!obj)
+          continue;
+
+        symbols::symtab& unresolved = obj->unresolved_symbols ();
+        for (symbols::symtab::const_iterator ui = unresolved.begin ();
+             ui != unresolved.end ();
+             ++ui)
+        {
+          const symbols::symbol& urs = *((*ui).second);
+          out << sep << '\n'
+              << "      { \"object\": " << json_string (obj->name ().full ())
+              << ", \"name\": " << json_string (urs.name ())
+              << ", \"resolved-by\": "
+              << json_string (object_name (urs.object ())) << " }";
+          sep = ",";
+        }
+      }
+
+      out << '\n'
+          << "    ]," << '\n'
+          << "    \"layout\": [";
+
+      if (d.placed)
+      {
+        sep = "";
+        for (rap::placements::const_iterator pi = d.placed->begin ();
+             pi != d.placed->end ();
+             ++pi)
+        {
+          const rap::placement& place = *pi;
+          out << sep << '\n'
+              << "      { \"rap-section\": \""
+              << rap::section_name (place.sec) << '"'
+              << ", \"offset\": " << place.offset
+              << ", \"size\": " << place.size
+              << ", \"align\": " << place.align
+              << ", \"object\": " << json_string (object_name (place.obj))
+              << ", \"section\": " << json_string (place.name) << " }";
+          sep = ",";
+        }
+      }
+
+      out << '\n'
+          << "    ]" << '\n'
+          << "  }";
+    }
+
+    static void
+    write_csv_header (std::ostream& out)
+    {
+      out << "#archive,map,name" << '\n'
+          << "#object,map,name,archive,linked,reason,symbol,referenced-by"
+          << '\n'
+          << "#section,map,object,name,index,size,align" << '\n'
+          << "#symbol,map,name,binding,type,value,size,object,section,"
+          << "rap-section,rap-offset" << '\n'
+          << "#unresolved,map,object,name,resolved-by" << '\n'
+          << "#placement,map,rap-section,offset,size,align,object,section"
+          << '\n';
+    }
+
+    static void
+    write_csv (std::ostream& out, details& d)
+    {
+      files::cache&     cache = d.cache;
+      files::archives&  archives = cache.get_archives ();
+      files::objects&   objects = cache.get_objects ();
+      const std::string title = csv_string (d.title);
+
+      for (files::archives::iterator ai = archives.begin ();
+           ai != archives.end ();
+           ++ai)
+        out << "archive," << title << ','
+            << csv_string ((*ai).second->name ().full ()) << '\n';
+
+      for (files::objects::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        files::object* obj = (*oi).second;
+
+        if (!obj)
+          continue;
+
+        const std::string name = csv_string (obj->name ().full ());
+
+        out << "object," << title << ',' << name << ','
+            << csv_string (obj->get_archive () ?
+                           obj->get_archive ()->name ().full () : "")
+            << ',' << (d.is_linked (obj) ? "yes" : "no") << ',';
+
+        if (d.is_input (obj))
+          out << "input,,";
+        else if (d.is_linked (obj))
+          out << "symbol," << csv_string (obj->reference_symbol ()) << ','
+              << csv_string (obj->referenced_by ());
+        else
+          out << ",,";
+
+        out << '\n';
+
+        files::section_refs secs;
+        obj->get_sections (secs, 0, SHF_ALLOC, 0);
+
+        for (files::section_refs::const_iterator si = secs.begin ();
+             si != secs.end ();
+             ++si)
+        {
+          const files::section& sec = *(*si);
+          out << "section," << title << ',' << name << ','
+              << csv_string (sec.name) << ',' << sec.index << ','
+              << sec.size << ',' << sec.alignment << '\n';
+        }
+      }
+
+      symbols::pointers syms;
+      get_symbols (d.symbols, syms);
+
+      for (symbols::pointers::const_iterator si = syms.begin ();
+           si != syms.end ();
+           ++si)
+      {
+        const symbols::symbol& sym = *(*si);
+        out << "symbol," << title << ',' << csv_string (sym.name ()) << ','
+            << binding_name (sym.binding ()) << ','
+            << type_name (sym.type ()) << ','
+            << sym.value () << ',' << sym.esym ().st_size << ','
+            << csv_string (object_name (sym.object ())) << ','
+            << csv_string (section_of (sym)) << ',';
+        const rap::placement* place = d.find (sym);
+        if (place)
+          out << rap::section_name (place->sec) << ','
+              << place->offset + sym.value ();
+        else
+          out << ',';
+        out << '\n';
+      }
+
+      for (files::objects::iterator oi = objects.begin ();
+           oi != objects.end ();
+           ++oi)
+      {
+        files::object* obj = (*oi).second;
+
+        if (!obj)
+          continue;
+
+        const std::string name = csv_string (obj->name ().full ());
+
+        symbols::symtab& unresolved = obj->unresolved_symbols ();
+        for (symbols::symtab::const_iterator ui = unresolved.begin ();
+             ui != unresolved.end ();
+             ++ui)
+        {
+          const symbols::symbol& urs = *((*ui).second);
+          out << "unresolved," << title << ',' << name << ','
+              << csv_string (urs.name ()) << ','
+              << csv_string (object_name (urs.object ())) << '\n';
+        }
+      }
+
+      if (d.placed)
+      {
+        for (rap::placements::const_iterator pi = d.placed->begin ();
+             pi != d.placed->end ();
+             ++pi)
+        {
+          const rap::placement& place = *pi;
+          out << "placement," << title << ','
+              << rap::section_name (place.sec) << ','
+              << place.offset << ',' << place.size << ',' << place.align << ','
+              << csv_string (object_name (place.obj)) << ','
+              << csv_string (place.name) << '\n';
+        }
+      }
+    }
+
+    writer::writer (format fmt, int fd)
+      : fmt (fmt),
+        buf (new output_buffer (fd, buffer_size)),
+        out (buf),
+        maps (0),
+        closed (false)
+    {
+      /*
+       * Anything written to the standard output before the map has to be
+       * written first.
+       */
+      std::cout.flush ();
+    }
+
+    writer::~writer ()
+    {
+      if (!closed)
+      {
+        try
+        {
+          close ();
+        }
+        catch (...)
+        {
+        }
+      }
+      delete buf;
+    }
+
+    void
+    writer::write (const std::string& title,
+                   files::cache&      cache,
+                   symbols::table&    symbols)
+    {
+      write (title, cache, symbols, 0, 0);
+    }
+
+    void
+    writer::write (const std::string&        title,
+                   files::cache&             cache,
+                   symbols::table&           symbols,
+                   const files::object_list& dependents,
+                   const rap::placements&    placed)
+    {
+      write (title, cache, symbols, &dependents,
+             placed.empty () ? 0 : &placed);
+    }
+
+    void
+    writer::write (const std::string&        title,
+                   files::cache&             cache,
+                   symbols::table&           symbols,
+                   const files::object_list* dependents,
+                   const rap::placements*    placed)
+    {
+      stats::phase phase ("map");
+
+      if (closed)
+        throw rld::error ("Writer is closed", "map:" + title);
+
+      details d (title, cache, symbols, dependents, placed);
+
+      switch (fmt)
+      {
+        case text:
+          if (maps)
+            out << '\n';
+          write_text (out, d);
+          break;
+        case json:
+          if (!maps)
+            out << "{ \"maps\": [";
+          write_json (out, d, maps == 0);
+          break;
+        case csv:
+          if (!maps)
+            write_csv_header (out);
+          write_csv (out, d);
+          break;
+      }
+
+      ++maps;
+    }
+
+    void
+    writer::close ()
+    {
+      if (closed)
+        return;
+
+      closed = true;
+
+      if (fmt == json)
+      {
+        if (!maps)
+          out << "{ \"maps\": [";
+        out << '\n' << "] }" << '\n';
+      }
+
+      out.flush ();
+
+      if (buf->error ())
+        throw rld::error (::strerror (buf->error ()), "map:write");
+    }
+  }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker map.
+ *
+ * The map of a link is written to the standard output through a large buffer
+ * as text, JSON or CSV. A map holds the archives and object files, the size
+ * of each object file's sections, why each archive member was pulled into the
+ * link, the section each symbol is in and the offset of each object file's
+ * sections in the RAP image.
+ *
+ */
+
+#if !defined (_RLD_MAP_H_)
+#define _RLD_MAP_H_
+
+#include <iostream>
+#include <string>
+
+#include <rld-files.h>
+#include <rld-rap.h>
+#include <rld-symbols.h>
+
+namespace rld
+{
+  namespace map
+  {
+    /**
+     * The map formats.
+     */
+    enum format
+    {
+      text,   //< Text for people to read.
+      json,   //< A JSON object with a list of maps.
+      csv     //< CSV rows, the first field is the kind of row.
+    };
+
+    /**
+     * Return the format given its name. Throws an error if the name is not a
+     * format.
+     *
+     * @param name The name of the format.
+     */
+    format parse_format (const std::string& name);
+
+    /**
+     * Write maps to a file descriptor, by default the standard output.
+     */
+    class writer
+    {
+    public:
+      /**
+       * The size of the output buffer.
+       */
+      static const size_t buffer_size = 256 * 1024;
+
+      /**
+       * Construct a writer.
+       *
+       * @param fmt The format of the maps.
+       * @param fd The file descriptor to write to.
+       */
+      writer (format fmt, int fd = 1);
+
+      /**
+       * Destruct the writer. Anything not written is flushed and errors are
+       * ignored. Call close to see the errors.
+       */
+      ~writer ();
+
+      /**
+       * Write the map of a cache that has not been linked, for example the
+       * base image.
+       *
+       * @param title The title of the map.
+       * @param cache The file cache.
+       * @param symbols The symbol table loaded from the cache.
+       */
+      void write (const std::string&   title,
+                  files::cache&        cache,
+                  symbols::table&      symbols);
+
+      /**
+       * Write the map of a link.
+       *
+       * @param title The title of the map.
+       * @param cache The file cache.
+       * @param symbols The symbol table loaded from the cache.
+       * @param dependents The object files the resolver pulled in.
+       * @param placed The place of the object file sections in the image. Can
+       *               be empty if the output is not a RAP file.
+       */
+      void write (const std::string&       title,
+                  files::cache&            cache,
+                  symbols::table&          symbols,
+                  const files::object_list& dependents,
+                  const rap::placements&   placed);
+
+      /**
+       * Finish the maps and flush the output. Throws an error if the output
+       * cannot be written.
+       */
+      void close ();
+
+    private:
+      class output_buffer;
+
+      format         fmt;     //< The format.
+      output_buffer* buf;     //< The output buffer.
+      std::ostream   out;     //< The stream writing to the buffer.
+      int            maps;    //< The number of maps written.
+      bool           closed;  //< The writer has been closed.
+
+      /**
+       * Write a map.
+       */
+      void write (const std::string&        title,
+                  files::cache&             cache,
+                  symbols::table&           symbols,
+                  const files::object_list* dependents,
+                  const rap::placements*    placed);
+
+      /**
+       * Cannot copy a writer.
+       */
+      writer (const writer& orig);
+      writer& operator= (const writer& rhs);
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker memory accounting.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <vector>
+
+#include <rld-memory.h>
+
+namespace rld
+{
+  namespace memory
+  {
+    /**
+     * The category names in the order of the categories.
+     */
+    static const char* category_names[category_count] =
+    {
+      "elf-symbols",
+      "elf-relocs",
+      "file-sections",
+      "file-relocs",
+      "symbol-tables",
+      "rap-objects",
+      "rap-sections",
+      "rap-relocs",
+      "untracked"
+    };
+
+    /**
+     * The categories allocated from an arena. The vectors free the memory
+     * they grow out of and are left on the heap.
+     */
+    static const bool in_arena[category_count] =
+    {
+      true,   /* elf-symbols */
+      false,  /* elf-relocs */
+      false,  /* file-sections */
+      false,  /* file-relocs */
+      true,   /* symbol-tables */
+      true,   /* rap-objects */
+      true,   /* rap-sections */
+      false,  /* rap-relocs */
+      false   /* untracked */
+    };
+
+    /**
+     * The alignment of the memory an arena hands out.
+     */
+    static const size_t arena_align = 2 * sizeof (double);
+
+    /**
+     * The size of an arena's first chunk and the largest chunk.
+     */
+    static const size_t chunk_first = 64 * 1024;
+    static const size_t chunk_max = 4 * 1024 * 1024;
+
+    /**
+     * A chunk of memory.
+     */
+    struct chunk
+    {
+      char*  base;  //< The base of the chunk.
+      size_t size;  //< The size of the chunk.
+    };
+
+    typedef std::vector < chunk > chunks;
+
+    /**
+     * The chunks of an arena. A pool out lives its arena if records from it
+     * are still in use when the arena is destroyed.
+     */
+    struct pool
+    {
+      chunks chunks_;     //< The chunks, the last is the current chunk.
+      char*  next;        //< The next free byte in the current chunk.
+      char*  end;         //< The end of the current chunk.
+      size_t chunk_size;  //< The size of the next chunk.
+      size_t reserved;    //< The bytes held in chunks.
+      size_t used;        //< The bytes handed out.
+      size_t live;        //< The records not deallocated.
+      bool   orphaned;    //< The arena has been destroyed.
+
+      pool ();
+
+      /**
+       * Is the memory from this pool ?
+       */
+      bool owns (const void* p) const;
+
+      /**
+       * Free the chunks.
+       */
+      void release ();
+    };
+
+    typedef std::vector < pool* > pools;
+
+    static bool   on;
+    static usage  usages_[category_count];
+    static usage  arenas_;
+    static arena* current;
+
+    /**
+     * The pools of the arenas, ownership of memory being deallocated is
+     * decided by searching them so it does not depend on the current arena.
+     */
+    static pools pools_;
+
+    /**
+     * The containers are filled by more than one job.
+     */
+#ifdef HAVE_PTHREAD_H
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+    struct locker
+    {
+      locker ()
+      {
+#ifdef HAVE_PTHREAD_H
+        ::pthread_mutex_lock (&lock);
+#endif
+      }
+
+      ~locker ()
+      {
+#ifdef HAVE_PTHREAD_H
+        ::pthread_mutex_unlock (&lock);
+#endif
+      }
+    };
+
+    usage::usage ()
+      : bytes (0),
+        peak (0),
+        allocs (0)
+    {
+    }
+
+    void
+    enable ()
+    {
+      on = true;
+    }
+
+    bool
+    enabled ()
+    {
+      return on;
+    }
+
+    const char*
+    name (category c)
+    {
+      return category_names[c];
+    }
+
+    void
+    allocated (category c, size_t bytes)
+    {
+      if (on)
+      {
+        locker l;
+        usage&  u = usages_[c];
+        u.bytes += bytes;
+        ++u.allocs;
+        if (u.bytes > u.peak)
+          u.peak = u.bytes;
+      }
+    }
+
+    void
+    freed (category c, size_t bytes)
+    {
+      if (on)
+      {
+        locker l;
+        usages_[c].bytes -= bytes;
+      }
+    }
+
+    void
+    get (usage* usages)
+    {
+      locker l;
+
+#ifdef HAVE_MALLINFO2
+      /*
+       * The untracked memory is the heap in use less the categories.
+       */
+      struct mallinfo2 mi = ::mallinfo2 ();
+      int64_t          heap = mi.uordblks + mi.hblkhd;
+      usage&           u = usages_[untracked];
+
+      u.bytes = heap;
+      for (int c = 0; c < untracked; ++c)
+        u.bytes -= usages_[c].bytes;
+      if (u.bytes < 0)
+        u.bytes = 0;
+      if (u.bytes > u.peak)
+        u.peak = u.bytes;
+#endif
+
+      for (int c = 0; c < category_count; ++c)
+        usages[c] = usages_[c];
+    }
+
+    void
+    get_arenas (usage& arenas)
+    {
+      locker l;
+      arenas = arenas_;
+    }
+
+    void*
+    allocate (category c, size_t bytes)
+    {
+      void* p;
+      if (current && in_arena[c])
+        p = current->allocate (bytes);
+      else
+        p = ::operator new (bytes);
+      allocated (c, bytes);
+      return p;
+    }
+
+    /**
+     * Find the pool holding the memory. The newest pools are the most
+     * likely. Call with the lock held.
+     */
+    static pools::iterator
+    find_pool (const void* p)
+    {
+      for (pools::iterator pi = pools_.end (); pi != pools_.begin (); )
+      {
+        --pi;
+        if ((*pi)->owns (p))
+          return pi;
+      }
+      return pools_.end ();
+    }
+
+    void
+    deallocate (category c, void* p, size_t bytes)
+    {
+      freed (c, bytes);
+
+      if (in_arena[c])
+      {
+        locker          l;
+        pools::iterator pi = find_pool (p);
+
+        if (pi != pools_.end ())
+        {
+          pool* pl = *pi;
+          --pl->live;
+          if (pl->orphaned && (pl->live == 0))
+          {
+            pl->release ();
+            pools_.erase (pi);
+            delete pl;
+          }
+          return;
+        }
+      }
+
+      ::operator delete (p);
+    }
+
+    pool::pool ()
+      : next (0),
+        end (0),
+        chunk_size (chunk_first),
+        reserved (0),
+        used (0),
+        live (0),
+        orphaned (false)
+    {
+    }
+
+    bool
+    pool::owns (const void* p) const
+    {
+      const char* cp = static_cast < const char* > (p);
+
+      /*
+       * The newest chunks are the most likely.
+       */
+      for (chunks::const_reverse_iterator ci = chunks_.rbegin ();
+           ci != chunks_.rend ();
+           ++ci)
+      {
+        if ((cp >= (*ci).base) && (cp < ((*ci).base + (*ci).size)))
+          return true;
+      }
+
+      return false;
+    }
+
+    void
+    pool::release ()
+    {
+      for (chunks::iterator ci = chunks_.begin (); ci != chunks_.end (); ++ci)
+        ::operator delete ((*ci).base);
+      arenas_.bytes -= reserved;
+      chunks_.clear ();
+      reserved = 0;
+    }
+
+    arena::arena ()
+      : pool_ (new pool)
+    {
+      locker l;
+      pools_.push_back (pool_);
+    }
+
+    arena::~arena ()
+    {
+      locker l;
+
+      /*
+       * Records still held by containers keep the chunks until they are
+       * deallocated.
+       */
+      if (pool_->live)
+      {
+        pool_->orphaned = true;
+        return;
+      }
+
+      pool_->release ();
+      for (pools::iterator pi = pools_.begin (); pi != pools_.end (); ++pi)
+      {
+        if (*pi == pool_)
+        {
+          pools_.erase (pi);
+          break;
+        }
+      }
+      delete pool_;
+    }
+
+    void*
+    arena::allocate (size_t bytes)
+    {
+      bytes = (bytes + arena_align - 1) & ~(arena_align - 1);
+
+      locker l;
+
+      pool& pl = *pool_;
+
+      ++pl.live;
+
+      if ((size_t) (pl.end - pl.next) < bytes)
+      {
+        /*
+         * A record larger than half a chunk gets a chunk of its own so the
+         * rest of the current chunk is not lost.
+         */
+        bool   own = bytes > (pl.chunk_size / 2);
+        chunk  c;
+
+        c.size = own ? bytes : pl.chunk_size;
+        c.base = static_cast < char* > (::operator new (c.size));
+        pl.reserved += c.size;
+
+        arenas_.bytes += c.size;
+        ++arenas_.allocs;
+        if (arenas_.bytes > arenas_.peak)
+          arenas_.peak = arenas_.bytes;
+
+        if (own && !pl.chunks_.empty ())
+        {
+          pl.chunks_.insert (pl.chunks_.end () - 1, c);
+          pl.used += bytes;
+          return c.base;
+        }
+
+        pl.chunks_.push_back (c);
+        pl.next = c.base;
+        pl.end = c.base + c.size;
+
+        if (!own && (pl.chunk_size < chunk_max))
+          pl.chunk_size *= 2;
+      }
+
+      void* p = pl.next;
+      pl.next += bytes;
+      pl.used += bytes;
+      return p;
+    }
+
+    bool
+    arena::owns (const void* p) const
+    {
+      locker l;
+      return pool_->owns (p);
+    }
+
+    size_t
+    arena::reserved () const
+    {
+      locker l;
+      return pool_->reserved;
+    }
+
+    size_t
+    arena::used () const
+    {
+      locker l;
+      return pool_->used;
+    }
+
+    arena_scope::arena_scope (arena* a)
+      : previous (current)
+    {
+      current = a;
+    }
+
+    arena_scope::~arena_scope ()
+    {
+      current = previous;
+    }
+  }
+}
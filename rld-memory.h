@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker memory accounting.
+ *
+ * The containers holding most of a link's data allocate through an allocator
+ * tagged with the category of data they hold. When accounting is enabled the
+ * bytes in use, the peak and the number of allocations of each category are
+ * counted. The heap the categories do not account for, for example libelf's
+ * buffers, is reported as untracked if the host can report the heap's size.
+ *
+ * The records of a link are allocated from a link-scoped arena when one is
+ * in use. An arena hands out memory from large chunks and never frees a
+ * record, it frees all its chunks when it is destroyed at the end of the
+ * link. The vectors are not allocated from an arena because they free the
+ * memory they grow out of.
+ *
+ * A record freed back to an arena is counted as freed in its category so the
+ * category bytes are the bytes the containers hold. The memory the arenas
+ * hold in chunks is reported separately.
+ *
+ */
+
+#if !defined (_RLD_MEMORY_H_)
+#define _RLD_MEMORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+
+namespace rld
+{
+  namespace memory
+  {
+    /**
+     * The categories of memory.
+     */
+    enum category
+    {
+      elf_symbols,      //< The symbols loaded from ELF files.
+      elf_relocs,       //< The relocation records read from ELF files.
+      file_sections,    //< The sections of object files.
+      file_relocs,      //< The relocation records of object file sections.
+      symbol_tables,    //< The symbol tables.
+      rap_objects,      //< The RAP objects made by the layout.
+      rap_sections,     //< The RAP object section index.
+      rap_relocs,       //< The relocation records of the RAP sections.
+      untracked,        //< The heap not in a category.
+      category_count    //< The number of categories.
+    };
+
+    /**
+     * The memory used by a category.
+     */
+    struct usage
+    {
+      int64_t  bytes;   //< The bytes in use.
+      int64_t  peak;    //< The peak bytes in use.
+      uint64_t allocs;  //< The number of allocations.
+
+      usage ();
+    };
+
+    /**
+     * Enable the accounting.
+     */
+    void enable ();
+
+    /**
+     * Is the accounting enabled ?
+     */
+    bool enabled ();
+
+    /**
+     * The name of a category.
+     */
+    const char* name (category c);
+
+    /**
+     * Count an allocation.
+     *
+     * @param c The category.
+     * @param bytes The bytes allocated.
+     */
+    void allocated (category c, size_t bytes);
+
+    /**
+     * Count a free.
+     *
+     * @param c The category.
+     * @param bytes The bytes freed.
+     */
+    void freed (category c, size_t bytes);
+
+    /**
+     * Get the usage of all categories.
+     *
+     * @param usages The usage of each category, category_count in size.
+     */
+    void get (usage* usages);
+
+    /**
+     * Get the memory the arenas hold. The bytes are the bytes held in chunks,
+     * the peak is the most bytes held at once and the allocs are the chunks
+     * allocated.
+     *
+     * @param arenas The usage of the arenas.
+     */
+    void get_arenas (usage& arenas);
+
+    /**
+     * Allocate memory in a category. The memory is from the current arena if
+     * there is one and the category is allocated from an arena.
+     *
+     * @param c The category.
+     * @param bytes The bytes to allocate.
+     */
+    void* allocate (category c, size_t bytes);
+
+    /**
+     * Deallocate memory in a category. Memory from an arena is returned to
+     * the arena that allocated it and is not freed.
+     *
+     * @param c The category.
+     * @param p The memory to deallocate.
+     * @param bytes The bytes allocated.
+     */
+    void deallocate (category c, void* p, size_t bytes);
+
+    /**
+     * The chunks of an arena.
+     */
+    struct pool;
+
+    /**
+     * A monotonic arena. Memory is allocated by bumping a pointer in a chunk
+     * and the chunks are freed when the arena is destroyed. If records from
+     * the arena are still in use when it is destroyed the chunks are kept
+     * until the last record is deallocated.
+     */
+    class arena
+    {
+    public:
+      arena ();
+      ~arena ();
+
+      /**
+       * Allocate memory from the arena.
+       *
+       * @param bytes The bytes to allocate.
+       */
+      void* allocate (size_t bytes);
+
+      /**
+       * Is the memory from this arena ?
+       *
+       * @param p The memory to check.
+       */
+      bool owns (const void* p) const;
+
+      /**
+       * The bytes held in chunks.
+       */
+      size_t reserved () const;
+
+      /**
+       * The bytes handed out.
+       */
+      size_t used () const;
+
+    private:
+      pool* pool_;  //< The chunks of the arena.
+
+      /**
+       * An arena cannot be copied.
+       */
+      arena (const arena&);
+      arena& operator= (const arena&);
+    };
+
+    /**
+     * Make an arena the current arena for the life of the scope. The previous
+     * arena is restored when the scope ends. A null arena allocates from the
+     * heap.
+     */
+    class arena_scope
+    {
+    public:
+      arena_scope (arena* a);
+      ~arena_scope ();
+
+    private:
+      arena* previous;  //< The arena current when the scope started.
+    };
+
+    /**
+     * An allocator that accounts for the memory in a category.
+     */
+    template < typename T, category C >
+    class allocator
+    {
+    public:
+      typedef T         value_type;
+      typedef T*        pointer;
+      typedef const T*  const_pointer;
+      typedef T&        reference;
+      typedef const T&  const_reference;
+      typedef size_t    size_type;
+      typedef ptrdiff_t difference_type;
+
+      template < typename U >
+      struct rebind
+      {
+        typedef allocator < U, C > other;
+      };
+
+      allocator () throw () {
+      }
+
+      allocator (const allocator&) throw () {
+      }
+
+      template < typename U >
+      allocator (const allocator < U, C >&) throw () {
+      }
+
+      ~allocator () throw () {
+      }
+
+      pointer address (reference r) const {
+        return &r;
+      }
+
+      const_pointer address (const_reference r) const {
+        return &r;
+      }
+
+      pointer allocate (size_type n, const void* = 0) {
+        return static_cast < pointer > (memory::allocate (C, n * sizeof (T)));
+      }
+
+      void deallocate (pointer p, size_type n) {
+        memory::deallocate (C, p, n * sizeof (T));
+      }
+
+      size_type max_size () const throw () {
+        return size_type (-1) / sizeof (T);
+      }
+
+      void construct (pointer p, const T& value) {
+        new (static_cast < void* > (p)) T (value);
+      }
+
+      void destroy (pointer p) {
+        p->~T ();
+      }
+    };
+
+    template < typename T, typename U, category C >
+    inline bool
+    operator== (const allocator < T, C >&, const allocator < U, C >&)
+    {
+      return true;
+    }
+
+    template < typename T, typename U, category C >
+    inline bool
+    operator!= (const allocator < T, C >&, const allocator < U, C >&)
+    {
+      return false;
+    }
+  }
+}
+
+#endif
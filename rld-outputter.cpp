@@ -33,7 +33,9 @@
 #include <string.h>
 
 #include <rld.h>
+#include <rld-outputter.h>
 #include <rld-rap.h>
+#include <rld-stats.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -44,6 +46,19 @@ namespace rld
 {
   namespace outputter
   {
+    /**
+     * Merge the dependents into the objects and remove any object that is in
+     * the result more than once.
+     */
+    static void
+    add_dependents (files::object_list&       objects,
+                    const files::object_list& dependents)
+    {
+      files::object_list dep_copy (dependents);
+      objects.merge (dep_copy, files::link_order);
+      files::remove_duplicates (objects);
+    }
+
     const std::string
     script_text (const std::string&        entry,
                  const std::string&        exit,
@@ -53,11 +68,9 @@ namespace rld
     {
       std::ostringstream out;
       files::object_list objects;
-      files::object_list dep_copy (dependents);
 
       cache.get_objects (objects);
-      objects.merge (dep_copy);
-      objects.unique ();
+      add_dependents (objects, dependents);
 
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << " E: " << entry << std::endl;
@@ -178,14 +191,13 @@ namespace rld
 
       metadata_object (metadata, entry, exit, dependents, cache);
 
-      files::object_list dep_copy (dependents);
       files::object_list objects;
 
       cache.get_objects (objects);
-      objects.merge (dep_copy);
+      add_dependents (objects, dependents);
       objects.push_front (&metadata);
-      objects.unique ();
 
+      stats::phase   phase ("archive-create");
       files::archive arch (name);
       arch.create (objects);
     }
@@ -252,32 +264,18 @@ namespace rld
           objects_tmp.push_back (obj);
       }
 
-      objects.merge (objects_tmp);
-      objects.unique ();
+      objects.merge (objects_tmp, files::link_order);
+      files::remove_duplicates (objects);
 
       if (objects.size ())
       {
+        stats::phase phase ("archive-create");
+
         if (ra_exist)
         {
-          std::string new_name = "rld_XXXXXX";
-          struct stat sb;
-          files::archive arch (new_name);
-          arch.create (objects);
-
-          if ((::stat (name.c_str (), &sb) >= 0) && S_ISREG (sb.st_mode))
-          {
-            if (::unlink (name.c_str ()) < 0)
-              std::cerr << "error: unlinking temp file: " << name << std::endl;
-          }
-          if (::link (new_name.c_str (), name.c_str ()) < 0)
-          {
-            std::cerr << "error: linking temp file: " << name << std::endl;
-          }
-          if ((::stat (new_name.c_str (), &sb) >= 0) && S_ISREG (sb.st_mode))
-          {
-            if (::unlink (new_name.c_str ()) < 0)
-              std::cerr << "error: unlinking temp file: " << new_name << std::endl;
-          }
+          /* Update */
+          files::archive arch (name);
+          arch.update (objects);
         }
         else
         {
@@ -288,6 +286,47 @@ namespace rld
       }
     }
 
+    void
+    archivera (const std::string& name,
+               files::image_list& images)
+    {
+      if (rld::verbose () >= RLD_VERBOSE_INFO)
+        std::cout << "outputter:archivera: " << name
+                  << ", images: " << images.size () << std::endl;
+
+      if (images.size ())
+      {
+        /*
+         * Write a temporary file next to the archive and rename it so the
+         * archive is replaced in one step and an error does not leave a
+         * partial archive.
+         */
+        const std::string tmp = name + ".tmp";
+        stats::phase      phase ("archive-create");
+
+        try
+        {
+          files::archive arch (tmp);
+          arch.create (images);
+        }
+        catch (...)
+        {
+          ::unlink (tmp.c_str ());
+          throw;
+        }
+
+        try
+        {
+          files::rename_file (tmp, name);
+        }
+        catch (...)
+        {
+          ::unlink (tmp.c_str ());
+          throw;
+        }
+      }
+    }
+
     void
     script (const std::string&        name,
             const std::string&        entry,
@@ -329,7 +368,6 @@ namespace rld
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "outputter:application: " << name << std::endl;
 
-      files::object_list dep_copy (dependents);
       files::object_list objects;
       std::string        header;
       std::string        script;
@@ -341,20 +379,13 @@ namespace rld
       script = script_text (entry, exit, dependents, cache, true);
 
       cache.get_objects (objects);
-      objects.merge (dep_copy);
-      objects.unique ();
+      add_dependents (objects, dependents);
 
       app.open (true);
       app.write (header.c_str (), header.size ());
 
-      #define APP_BUFFER_SIZE  (128 * 1024)
-
-      uint8_t* buffer = 0;
-
       try
       {
-        buffer = new uint8_t[APP_BUFFER_SIZE];
-
         for (files::object_list::iterator oi = objects.begin ();
              oi != objects.end ();
              ++oi)
@@ -366,18 +397,8 @@ namespace rld
           try
           {
             obj.seek (0);
-
-            size_t in_size = obj.name ().size ();
-
-            while (in_size)
-            {
-              size_t reading =
-                in_size < APP_BUFFER_SIZE ? in_size : APP_BUFFER_SIZE;
-
-              app.write (buffer, obj.read (buffer, reading));
-
-              in_size -= reading;
-            }
+            if (obj.name ().size ())
+              files::copy_file (obj, app, obj.name ().size ());
           }
           catch (...)
           {
@@ -390,13 +411,10 @@ namespace rld
       }
       catch (...)
       {
-        delete [] buffer;
         app.close ();
         throw;
       }
 
-      delete [] buffer;
-
       app.close ();
     }
 
@@ -414,27 +432,44 @@ namespace rld
                  const files::object_list& dependents,
                  const files::cache&       cache,
                  const symbols::table&     symbols,
-                 bool                      one_file)
+                 bool                      one_file,
+                 rap::placements*          placed,
+                 rap::costs*               cost)
+    {
+      files::image app (name);
+      application (app, entry, exit, dependents, cache, symbols, one_file,
+                   placed, cost);
+    }
+
+    void
+    application (files::image&             app,
+                 const std::string&        entry,
+                 const std::string&        exit,
+                 const files::object_list& dependents,
+                 const files::cache&       cache,
+                 const symbols::table&     symbols,
+                 bool                      one_file,
+                 rap::placements*          placed,
+                 rap::costs*               cost)
     {
       if (rld::verbose () >= RLD_VERBOSE_INFO)
-        std::cout << "outputter:application: " << name << std::endl;
+        std::cout << "outputter:application: " << app.name ().full ()
+                  << std::endl;
 
       files::object_list dep_copy (dependents);
       files::object_list objects;
-      files::image       app (name);
 
       if (!one_file)
         dep_copy.remove_if (in_archive);
 
       cache.get_objects (objects);
-      objects.merge (dep_copy);
-      objects.unique ();
+      add_dependents (objects, dep_copy);
 
       app.open (true);
 
       try
       {
-        rap::write (app, entry, exit, objects, symbols);
+        rap::write (app, entry, exit, objects, symbols, placed, cost);
       }
       catch (...)
       {
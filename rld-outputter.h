@@ -26,6 +26,7 @@
 #define _RLD_OUTPUTTER_H_
 
 #include <rld-files.h>
+#include <rld-rap.h>
 
 namespace rld
 {
@@ -68,6 +69,17 @@ namespace rld
                     bool                      ra_exist,
                     bool                      ra_rap);
 
+    /**
+     * Output the images as the members of a new RA archive. The images are
+     * added in the order they are listed. The archive is written to a
+     * temporary file that is renamed to the archive's name once complete.
+     *
+     * @param name The name of the archive.
+     * @param images The RAP images to place in the archive.
+     */
+    void archivera (const std::string& name,
+                    files::image_list& images);
+
     /**
      * Output the object file list as a script.
      *
@@ -110,6 +122,11 @@ namespace rld
      * @param cache The file cache for the link. Includes the object list
      *              the user requested.
      * @param symbols The symbol table used to resolve the application.
+     * @param one_file Include the archive members in the application.
+     * @param placed If not 0 the place of each object file section in the
+     *               application is returned.
+     * @param cost If not 0 the bytes each part of the application takes is
+     *             returned.
      */
     void application (const std::string&        name,
                       const std::string&        entry,
@@ -117,7 +134,36 @@ namespace rld
                       const files::object_list& dependents,
                       const files::cache&       cache,
                       const symbols::table&     symbols,
-                      bool                      one_file);
+                      bool                      one_file,
+                      rap::placements*          placed = 0,
+                      rap::costs*               cost = 0);
+
+    /**
+     * Output the object files in an archive with the metadata to an image.
+     * The image is opened as writable and closed when written.
+     *
+     * @param app The image to write the application to.
+     * @param entry The name of the entry point symbol.
+     * @param exit The name of the exit point symbol.
+     * @param dependents The list of dependent object files
+     * @param cache The file cache for the link. Includes the object list
+     *              the user requested.
+     * @param symbols The symbol table used to resolve the application.
+     * @param one_file Include the archive members in the application.
+     * @param placed If not 0 the place of each object file section in the
+     *               application is returned.
+     * @param cost If not 0 the bytes each part of the application takes is
+     *             returned.
+     */
+    void application (files::image&             app,
+                      const std::string&        entry,
+                      const std::string&        exit,
+                      const files::object_list& dependents,
+                      const files::cache&       cache,
+                      const symbols::table&     symbols,
+                      bool                      one_file,
+                      rap::placements*          placed = 0,
+                      rap::costs*               cost = 0);
 
   }
 }
@@ -28,6 +28,14 @@
 #include <sys/wait.h>
 #endif
 
+#if defined (HAVE_SPAWN_H) && defined (HAVE_POLL_H) && defined (HAVE_SYS_WAIT_H)
+#define RLD_PROCESS_PIPES 1
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
 #ifndef WIFEXITED
 #define WIFEXITED(S) (((S) & 0xff) == 0)
 #endif
@@ -267,6 +275,38 @@ namespace rld
       }
     }
 
+    static status
+    decode_status (const std::string& name, int s)
+    {
+      status _status;
+
+      if (WIFEXITED (s))
+      {
+        _status.type = status::normal;
+        _status.code = WEXITSTATUS (s);
+        if (rld::verbose () >= RLD_VERBOSE_TRACE)
+          std::cout << _status.code << std::endl;
+      }
+      else if (WIFSIGNALED (s))
+      {
+        _status.type = status::signal;
+        _status.code = WTERMSIG (s);
+        if (rld::verbose () >= RLD_VERBOSE_TRACE)
+          std::cout << "signal: " << _status.code << std::endl;
+      }
+      else if (WIFSTOPPED (s))
+      {
+        _status.type = status::stopped;
+        _status.code = WSTOPSIG (s);
+        if (rld::verbose () >= RLD_VERBOSE_TRACE)
+          std::cout << "stopped: " << _status.code << std::endl;
+      }
+      else
+        throw rld::error ("execute: " + name, "unknown status returned");
+
+      return _status;
+    }
+
     status
     execute (const std::string& pname, 
              const std::string& command,
@@ -317,36 +357,366 @@ namespace rld
       else if (err)
         throw rld::error ("execute: " + args[0], ::strerror (err));
 
-      status _status;
-
       if (rld::verbose () >= RLD_VERBOSE_TRACE)
         std::cout << "execute: status: ";
 
-      if (WIFEXITED (s))
+      return decode_status (args[0], s);
+    }
+
+    child::child ()
+      : pid (-1),
+        out_fd (-1),
+        err_fd (-1)
+    {
+      status_.type = status::normal;
+      status_.code = 0;
+    }
+
+    child::~child ()
+    {
+      if (running ())
       {
-        _status.type = status::normal;
-        _status.code = WEXITSTATUS (s);
-        if (rld::verbose () >= RLD_VERBOSE_TRACE)
-          std::cout << _status.code << std::endl;
+        child_container children;
+        children.push_back (this);
+        try
+        {
+          wait (children);
+        }
+        catch (...)
+        {
+        }
       }
-      else if (WIFSIGNALED (s))
+    }
+
+#if RLD_PROCESS_PIPES
+    static void
+    close_pipe (int fds[2])
+    {
+      if (fds[0] >= 0)
+        ::close (fds[0]);
+      if (fds[1] >= 0)
+        ::close (fds[1]);
+    }
+#endif
+
+    void
+    child::spawn (const arg_container& args)
+    {
+      if (running ())
+        throw rld::error ("child is running", "spawn: " + name);
+
+      name = args[0];
+      out_.clear ();
+      err_.clear ();
+
+      if (rld::verbose () >= RLD_VERBOSE_TRACE)
       {
-        _status.type = status::signal;
-        _status.code = WTERMSIG (s);
-        if (rld::verbose () >= RLD_VERBOSE_TRACE)
-          std::cout << "signal: " << _status.code << std::endl;
+        std::cout << "spawn: ";
+        for (size_t a = 0; a < args.size (); ++a)
+          std::cout << args[a] << ' ';
+        std::cout << std::endl;
       }
-      else if (WIFSTOPPED (s))
+
+#if RLD_PROCESS_PIPES
+      int out_pipe[2] = { -1, -1 };
+      int err_pipe[2] = { -1, -1 };
+
+      if ((::pipe (out_pipe) < 0) || (::pipe (err_pipe) < 0))
       {
-        _status.type = status::stopped;
-        _status.code = WSTOPSIG (s);
-        if (rld::verbose () >= RLD_VERBOSE_TRACE)
-          std::cout << "stopped: " << _status.code << std::endl;
+        int e = errno;
+        close_pipe (out_pipe);
+        close_pipe (err_pipe);
+        throw rld::error (::strerror (e), "spawn: pipe: " + name);
+      }
+
+      /*
+       * Other children must not inherit the pipes or the read ends will not
+       * see the end of file until they exit.
+       */
+      if ((::fcntl (out_pipe[0], F_SETFD, FD_CLOEXEC) < 0) ||
+          (::fcntl (out_pipe[1], F_SETFD, FD_CLOEXEC) < 0) ||
+          (::fcntl (err_pipe[0], F_SETFD, FD_CLOEXEC) < 0) ||
+          (::fcntl (err_pipe[1], F_SETFD, FD_CLOEXEC) < 0))
+      {
+        int e = errno;
+        close_pipe (out_pipe);
+        close_pipe (err_pipe);
+        throw rld::error (::strerror (e), "spawn: fcntl: " + name);
+      }
+
+      posix_spawn_file_actions_t actions;
+      int                        r;
+
+      r = ::posix_spawn_file_actions_init (&actions);
+      if (r != 0)
+      {
+        close_pipe (out_pipe);
+        close_pipe (err_pipe);
+        throw rld::error (::strerror (r), "spawn: file-actions: " + name);
+      }
+
+      r = ::posix_spawn_file_actions_adddup2 (&actions, out_pipe[1], 1);
+      if (r == 0)
+        r = ::posix_spawn_file_actions_adddup2 (&actions, err_pipe[1], 2);
+      if (r != 0)
+      {
+        ::posix_spawn_file_actions_destroy (&actions);
+        close_pipe (out_pipe);
+        close_pipe (err_pipe);
+        throw rld::error (::strerror (r), "spawn: file-actions: " + name);
+      }
+
+      const char** cargs = new const char* [args.size () + 1];
+
+      for (size_t a = 0; a < args.size (); ++a)
+        cargs[a] = args[a].c_str ();
+      cargs[args.size ()] = 0;
+
+      pid_t cpid = -1;
+
+      r = ::posix_spawnp (&cpid, cargs[0], &actions, 0,
+                          (char* const*) cargs, environ);
+
+      delete [] cargs;
+      ::posix_spawn_file_actions_destroy (&actions);
+
+      ::close (out_pipe[1]);
+      ::close (err_pipe[1]);
+
+      if (r != 0)
+      {
+        ::close (out_pipe[0]);
+        ::close (err_pipe[0]);
+        throw rld::error (::strerror (r), "spawn: " + name);
+      }
+
+      pid = cpid;
+      out_fd = out_pipe[0];
+      err_fd = err_pipe[0];
+#else
+      /*
+       * No pipes so run the child to completion using temporary files.
+       */
+      tempfile out;
+      tempfile err;
+
+      status_ = execute (name, args, out.name (), err.name ());
+
+      out.open ();
+      out.get (out_);
+      out.close ();
+      err.open ();
+      err.get (err_);
+      err.close ();
+#endif
+    }
+
+    bool
+    child::running () const
+    {
+      return pid >= 0;
+    }
+
+    void
+    child::reaped ()
+    {
+      pid = -1;
+      out_fd = -1;
+      err_fd = -1;
+    }
+
+    const std::string&
+    child::out () const
+    {
+      return out_;
+    }
+
+    const std::string&
+    child::err () const
+    {
+      return err_;
+    }
+
+    const status&
+    child::result () const
+    {
+      return status_;
+    }
+
+#if RLD_PROCESS_PIPES
+    /**
+     * If waiting fails close the pipes still open and reap the children so
+     * no file descriptors or zombies are left behind.
+     */
+    struct wait_guard
+    {
+      child_container&               children;
+      std::vector < struct pollfd >& fds;
+
+      wait_guard (child_container&               children,
+                  std::vector < struct pollfd >& fds)
+        : children (children),
+          fds (fds) {
+      }
+
+      ~wait_guard ();
+    };
+
+    wait_guard::~wait_guard ()
+    {
+      for (size_t f = 0; f < fds.size (); ++f)
+      {
+        if (fds[f].fd >= 0)
+        {
+          ::close (fds[f].fd);
+          fds[f].fd = -1;
+        }
+      }
+
+      for (child_container::iterator ci = children.begin ();
+           ci != children.end ();
+           ++ci)
+      {
+        child& c = *(*ci);
+        if (c.running ())
+        {
+          int s = 0;
+          while ((::waitpid (c.pid, &s, 0) < 0) && (errno == EINTR))
+            ;
+          c.reaped ();
+        }
+      }
+    }
+#endif
+
+    void
+    wait (child_container& children)
+    {
+#if RLD_PROCESS_PIPES
+      /*
+       * Read the pipes until all are closed. A child that fills a pipe
+       * blocks until it is read so waiting for the exit first can deadlock.
+       */
+      std::vector < struct pollfd > fds;
+      std::vector < std::string* >  outputs;
+
+      for (child_container::iterator ci = children.begin ();
+           ci != children.end ();
+           ++ci)
+      {
+        child& c = *(*ci);
+        if (c.running ())
+        {
+          struct pollfd pfd;
+          pfd.events = POLLIN;
+          pfd.revents = 0;
+          pfd.fd = c.out_fd;
+          fds.push_back (pfd);
+          outputs.push_back (&c.out_);
+          pfd.fd = c.err_fd;
+          fds.push_back (pfd);
+          outputs.push_back (&c.err_);
+        }
+      }
+
+      wait_guard guard (children, fds);
+      size_t     open_fds = fds.size ();
+      char       buf[8 * 1024];
+
+      while (open_fds)
+      {
+        if (::poll (&fds[0], fds.size (), -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          throw rld::error (::strerror (errno), "wait: poll");
+        }
+
+        for (size_t f = 0; f < fds.size (); ++f)
+        {
+          if ((fds[f].fd >= 0) && (fds[f].revents != 0))
+          {
+            ssize_t r = ::read (fds[f].fd, buf, sizeof (buf));
+            if (r > 0)
+              outputs[f]->append (buf, r);
+            else if ((r == 0) || (errno != EINTR))
+            {
+              ::close (fds[f].fd);
+              fds[f].fd = -1;
+              --open_fds;
+            }
+          }
+        }
+      }
+
+      for (child_container::iterator ci = children.begin ();
+           ci != children.end ();
+           ++ci)
+      {
+        child& c = *(*ci);
+        if (c.running ())
+        {
+          int s = 0;
+          while (::waitpid (c.pid, &s, 0) < 0)
+          {
+            if (errno != EINTR)
+              throw rld::error (::strerror (errno), "wait: " + c.name);
+          }
+          c.reaped ();
+          if (rld::verbose () >= RLD_VERBOSE_TRACE)
+            std::cout << "wait: " << c.name << ": ";
+          c.status_ = decode_status (c.name, s);
+        }
+      }
+#else
+      /*
+       * The children ran to completion when spawned.
+       */
+      (void) children;
+#endif
+    }
+
+    status
+    execute (const arg_container& args,
+             std::string&         out,
+             std::string&         err)
+    {
+      child           c;
+      child_container children;
+
+      c.spawn (args);
+      children.push_back (&c);
+      wait (children);
+
+      out = c.out ();
+      err = c.err ();
+
+      return c.result ();
+    }
+
+    void
+    output (const std::string& prefix,
+            const std::string& text,
+            std::ostream&      out,
+            bool               line_numbers)
+    {
+      std::string::size_type start = 0;
+      int                    lc = 0;
+      while (start < text.size ())
+      {
+        std::string::size_type end = text.find ('\n', start);
+        if (end == std::string::npos)
+          end = text.size ();
+        else
+          ++end;
+        ++lc;
+        if (!prefix.empty ())
+          out << prefix << ':';
+        if (line_numbers)
+          out << lc << ':';
+        out << text.substr (start, end - start);
+        start = end;
       }
-      else
-        throw rld::error ("execute: " + args[0], "unknown status returned");
-          
-      return _status;
     }
 
     /*
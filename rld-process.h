@@ -192,6 +192,105 @@ namespace rld
                     const std::string& outname,
                     const std::string& errname);
 
+    /**
+     * A child process with its stdout and stderr connected to pipes. The
+     * output is read into memory while the child runs so there are no
+     * temporary files. Several children can be spawned and then waited for
+     * together so they run concurrently.
+     */
+    class child
+    {
+    public:
+      /**
+       * Construct a child that has not been spawned.
+       */
+      child ();
+
+      /**
+       * Destruct the child. A child still running is waited for.
+       */
+      ~child ();
+
+      /**
+       * Spawn the child. The first argument is the program and the
+       * executable search path is used if it has no path. Throws an error if
+       * the child cannot be spawned.
+       */
+      void spawn (const arg_container& args);
+
+      /**
+       * Is the child running ?
+       */
+      bool running () const;
+
+      /**
+       * The stdout output of the child. Valid once waited for.
+       */
+      const std::string& out () const;
+
+      /**
+       * The stderr output of the child. Valid once waited for.
+       */
+      const std::string& err () const;
+
+      /**
+       * The exit status of the child. Valid once waited for.
+       */
+      const status& result () const;
+
+    private:
+
+      /*
+       * The child cannot be copied because it owns the pipes.
+       */
+      child (const child& orig);
+      child& operator= (const child& rhs);
+
+      /**
+       * The child has been waited for, its pipes are closed.
+       */
+      void reaped ();
+
+      friend void wait (std::vector < child* >& children);
+      friend struct wait_guard;
+
+      std::string name;    //< The program name.
+      int         pid;     //< The process id while running.
+      int         out_fd;  //< The read end of the stdout pipe.
+      int         err_fd;  //< The read end of the stderr pipe.
+      std::string out_;    //< The stdout output.
+      std::string err_;    //< The stderr output.
+      status      status_; //< The exit status.
+    };
+
+    /**
+     * A container of children.
+     */
+    typedef std::vector < child* > child_container;
+
+    /**
+     * Wait for the children reading their output as it arrives. Returns when
+     * all the children have exited.
+     */
+    void wait (child_container& children);
+
+    /**
+     * Execute a process and capture stdout and stderr in memory. The first
+     * element is the program name to run. Return an error code.
+     */
+    status execute (const arg_container& args,
+                    std::string&         out,
+                    std::string&         err);
+
+    /**
+     * Output the text a line at a time with a prefix and optionally the line
+     * numbers.
+     */
+    void output (const std::string& prefix,
+                 const std::string& text,
+                 std::ostream&      out,
+                 bool               line_numbers = false);
+
     /**
      * Parse a command line into arguments. It support quoting.
      */
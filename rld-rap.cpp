@@ -27,6 +27,7 @@
 #include "config.h"
 #endif
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
@@ -36,6 +37,8 @@
 #include <rld.h>
 #include <rld-compression.h>
 #include <rld-rap.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 namespace rld
 {
@@ -52,6 +55,21 @@ namespace rld
      */
     std::string rpath;
 
+    /**
+     * The RAP format version to write.
+     */
+    uint32_t format_version = rap_version_default;
+
+    /**
+     * Add the exported symbol hash table or not.
+     */
+    bool add_symbol_hash = false;
+
+    /**
+     * Pack the object file sections or not.
+     */
+    bool pack_sections = false;
+
     /**
      * The names of the RAP sections.
      */
@@ -89,7 +107,37 @@ namespace rld
     /**
      * Relocation records.
      */
-    typedef std::vector < relocation > relocations;
+    typedef std::vector < relocation,
+                          memory::allocator < relocation,
+                                              memory::rap_relocs > > relocations;
+
+    /**
+     * A relocation record as written to the RAP file. The compact format sorts
+     * these by the key then the offset so records of the same type against the
+     * same symbol form a run.
+     */
+    struct compact_reloc
+    {
+      uint32_t key;     //< The type, import flag and index.
+      uint32_t offset;  //< The offset in the RAP section.
+      uint32_t addend;  //< The addend.
+
+      /**
+       * Construct the compact record from a RAP relocation record's info
+       * field, offset and addend.
+       */
+      compact_reloc (uint32_t info, uint32_t offset, uint32_t addend);
+
+      /**
+       * Order by the key then the offset.
+       */
+      bool operator < (const compact_reloc& rhs) const;
+    };
+
+    /**
+     * Compact relocation records.
+     */
+    typedef std::vector < compact_reloc > compact_relocs;
 
     /**
      * Relocation symname sorter for the relocations container.
@@ -150,7 +198,9 @@ namespace rld
      * index. This is used when adding the external symbols so the symbol's
      * value can be adjusted by the offset of the section in the RAP section.
      */
-    typedef std::map < const int, osection > osections;
+    typedef std::map < const int, osection, std::less < const int >,
+                       memory::allocator < std::pair < const int, osection >,
+                                           memory::rap_sections > > osections;
 
     /**
      * An ordered container of object section indexes. We need the same
@@ -175,7 +225,7 @@ namespace rld
     /*
      * A container of section detail
      */
-    typedef std::list < section_detail > section_details;
+    typedef std::vector < section_detail > section_details;
 
     /**
      * The RAP section data.
@@ -242,10 +292,10 @@ namespace rld
        */
       static const uint32_t rap_size = sizeof (uint32_t) * 3;
 
-      const uint32_t name;  //< The string table's name index.
-      const sections sec;   //< The section the symbols belongs to.
-      const uint32_t value; //< The offset from the section base.
-      const uint32_t data;  //< The ELF st.info field.
+      uint32_t name;  //< The string table's name index.
+      sections sec;   //< The section the symbols belongs to.
+      uint32_t value; //< The offset from the section base.
+      uint32_t data;  //< The ELF st.info field.
 
       /**
        * The constructor.
@@ -254,18 +304,70 @@ namespace rld
                 const sections sec,
                 const uint32_t value,
                 const uint32_t data);
+    };
 
+    /**
+     * A container of externals.
+     */
+    typedef std::vector < external > externals;
+
+    /**
+     * The exported symbol hash table's words.
+     */
+    typedef std::vector < uint32_t > symbol_hash_table;
+
+    /**
+     * Order the externals by their symbol hash table bucket. The symbols in a
+     * bucket need to be next to each other in the symbol table.
+     */
+    class external_bucket_compare
+    {
+    public:
+      external_bucket_compare (const std::string& strtab, uint32_t buckets)
+        : strtab (strtab),
+          buckets (buckets) {
+      }
+
+      bool operator () (const external& lhs, const external& rhs) const {
+        return ((symbol_hash (&strtab[lhs.name]) % buckets) <
+                (symbol_hash (&strtab[rhs.name]) % buckets));
+      }
+
+    private:
+      const std::string& strtab;
+      const uint32_t     buckets;
+    };
+
+    /**
+     * An imported symbol. Each symbol referenced by name in the relocation
+     * records is held once in the import table and the relocation records
+     * reference the import by its index.
+     */
+    struct import
+    {
       /**
-       * Copy constructor.
+       * Size of an import in the RAP file.
        */
-      external (const external& orig);
+      static const uint32_t rap_size = sizeof (uint32_t) * 2;
 
+      uint32_t name;  //< The string table's name index.
+      uint32_t hash;  //< The hash of the name.
+
+      /**
+       * The constructor.
+       */
+      import (const uint32_t name, const uint32_t hash);
     };
 
     /**
-     * A container of externals.
+     * A container of imports in the order they are written.
+     */
+    typedef std::vector < import > imports;
+
+    /**
+     * The import table index of each imported symbol keyed by name.
      */
-    typedef std::list < external > externals;
+    typedef std::map < std::string, uint32_t > import_indexes;
 
     /**
      * The specific data for each object we need to collect to create the RAP
@@ -273,32 +375,52 @@ namespace rld
      */
     struct object
     {
-      files::object&  obj;            //< The object file.
-      files::sections text;           //< All executable code.
-      files::sections const_;         //< All read only data.
-      files::sections ctor;           //< The static constructor table.
-      files::sections dtor;           //< The static destructor table.
-      files::sections data;           //< All initialised read/write data.
-      files::sections bss;            //< All uninitialised read/write data
-      files::sections symtab;         //< All exported symbols.
-      files::sections strtab;         //< All exported strings.
-      section         secs[rap_secs]; //< The sections of interest.
+      files::object&      obj;              //< The object file.
+      files::section_refs text;             //< All executable code.
+      files::section_refs const_;           //< All read only data.
+      files::section_refs ctor;             //< The static constructor table.
+      files::section_refs dtor;             //< The static destructor table.
+      files::section_refs data;             //< All initialised read/write
+                                            //  data.
+      files::section_refs bss;              //< All uninitialised read/write
+                                            //  data.
+      files::section_refs symtab;           //< All exported symbols.
+      files::section_refs strtab;           //< All exported strings.
+      section             secs[rap_secs];   //< The sections of interest.
+      uint32_t            packed;           //< The padding saved by packing.
+      uint32_t            staged[rap_secs]; //< The offset of each RAP
+                                            //  section's data in the staging
+                                            //  pool.
+      bool                loaded;           //< The object has been loaded.
 
       /**
-       * The constructor. Need to have an object file to create.
+       * The constructor. Need to have an object file to create. The object is
+       * empty until it is loaded.
        */
       object (files::object& obj);
 
       /**
-       * The copy constructor.
+       * The copy constructor. Only an object that has not been loaded can be
+       * copied so the sections and relocations are not copied. An object is
+       * added to a container then loaded in place.
        */
       object (const object& orig);
 
+      /**
+       * Load the object file's sections and merge them into the RAP sections.
+       */
+      void load ();
+
       /**
        * Find the section type that matches the section index.
        */
       sections find (const uint32_t index) const;
 
+      /**
+       * The object file's sections placed in a RAP section.
+       */
+      const files::section_refs& input_sections (sections sec) const;
+
       /**
        * The total number of relocations in the object file.
        */
@@ -316,16 +438,29 @@ namespace rld
       void output ();
 
     private:
+      /**
+       * Pack the sections by decreasing alignment if it reduces the padding
+       * between them.
+       */
+      void pack (files::section_refs& secs);
+
       /**
        * No default constructor allowed.
        */
       object ();
+
+      /**
+       * Cannot assign using the assignment operator.
+       */
+      object& operator= (const object& rhs);
     };
 
     /**
      * A container of objects.
      */
-    typedef std::list < object > objects;
+    typedef std::list < object,
+                        memory::allocator < object,
+                                            memory::rap_objects > > objects;
 
     /**
      * The RAP image.
@@ -356,6 +491,25 @@ namespace rld
        */
       void collect_symbols (object& obj);
 
+      /**
+       * Collect the symbols referenced by name in the relocation records into
+       * the import table.
+       */
+      void collect_imports ();
+
+      /**
+       * Create the exported symbol hash table. The externals are sorted into
+       * bucket order.
+       */
+      void create_symbol_hash ();
+
+      /**
+       * Read the data of the sections written to the image from each object
+       * file into the staging pool. Each object file is opened and read once
+       * rather than once for each RAP section.
+       */
+      void stage ();
+
       /**
        * Write the compressed output file. This is the top level write
        * interface.
@@ -381,23 +535,44 @@ namespace rld
        * @param comp The compressor.
        * @param obj The object file the sections are part of.
        * @param secs The container of file sections to write.
+       * @param staged The offset of the sections' data in the staging pool.
        * @param offset The current offset in the RAP section.
        */
-      void write (compress::compressor&  comp,
-                  files::object&         obj,
-                  const files::sections& secs,
-                  uint32_t&              offset);
+      void write (compress::compressor&      comp,
+                  files::object&             obj,
+                  const files::section_refs& secs,
+                  uint32_t                   staged,
+                  uint32_t&                  offset);
 
       /**
        * Write the external symbols.
        */
       void write_externals (compress::compressor& comp);
 
+      /**
+       * Write the exported symbol hash table.
+       */
+      void write_symbol_hash (compress::compressor& comp);
+
+      /**
+       * Write the import table.
+       */
+      void write_imports (compress::compressor& comp);
+
       /**
        * Write the relocation records for all the object files.
        */
       void write_relocations (compress::compressor& comp);
 
+      /**
+       * Write a RAP section's relocation records in the compact format. Runs
+       * of records with the same key are written as the run length and key
+       * followed by the offset deltas and addends as LEB128 fields.
+       */
+      void write_relocations (compress::compressor& comp,
+                              compact_relocs&       relocs,
+                              bool                  rela);
+
       /**
        * Write the details of the files.
        */
@@ -424,6 +599,16 @@ namespace rld
        */
       std::size_t find_in_strtab (const std::string& symname);
 
+      /**
+       * Get the place of each object file section in the layout.
+       */
+      void get_placements (placements& placed) const;
+
+      /**
+       * Get the bytes each part of the image took when written.
+       */
+      const costs& get_costs () const;
+
     private:
 
       objects     objs;                //< The RAP objects
@@ -432,12 +617,40 @@ namespace rld
       bool        sec_rela[rap_secs];  //< The sections of interest.
       externals   externs;             //< The symbols in the image
       uint32_t    symtab_size;         //< The size of the symbols.
+      symbol_hash_table symhash;       //< The exported symbol hash table.
       std::string strtab;              //< The strings table.
       uint32_t    relocs_size;         //< The relocations size.
+      uint32_t    packed;              //< The padding saved by packing.
+      std::vector < uint8_t > staging; //< The section data of all objects.
+      imports     imps;                //< The imported symbols.
+      import_indexes import_index;     //< The import index of each symbol.
       uint32_t    init_off;            //< The strtab offset to the init label.
       uint32_t    fini_off;            //< The strtab offset to the fini label.
+      costs       cost;                //< The bytes each part took to write.
+
+      /**
+       * Cannot copy via a copy constructor.
+       */
+      image (const image& orig);
+
+      /**
+       * Cannot assign using the assignment operator.
+       */
+      image& operator= (const image& rhs);
     };
 
+    uint32_t
+    parse_format_version (const char* arg)
+    {
+      char*         end;
+      unsigned long version = ::strtoul (arg, &end, 10);
+      if ((*arg == '\0') || (*end != '\0') ||
+          (version < rap_version_names) || (version > rap_version_latest))
+        throw rld::error ("invalid RAP format version: " + std::string (arg),
+                          "options:rap-format");
+      return version;
+    }
+
     const char*
     section_name (int sec)
     {
@@ -447,6 +660,66 @@ namespace rld
                         "rap::section-name");
     }
 
+    placement::placement (files::object*     obj,
+                          const std::string& name,
+                          int                index,
+                          sections           sec,
+                          uint32_t           offset,
+                          uint32_t           size,
+                          uint32_t           align)
+      : obj (obj),
+        name (name),
+        index (index),
+        sec (sec),
+        offset (offset),
+        size (size),
+        align (align)
+    {
+    }
+
+    reloc_cost::reloc_cost ()
+    {
+      for (int s = 0; s < rap_secs; ++s)
+      {
+        records[s] = 0;
+        bytes[s] = 0;
+      }
+    }
+
+    costs::costs ()
+    {
+      clear ();
+    }
+
+    void
+    costs::clear ()
+    {
+      header = 0;
+      details = 0;
+      strtab = 0;
+      symtab = 0;
+      symhash = 0;
+      imports = 0;
+      for (int s = 0; s < rap_secs; ++s)
+      {
+        sections[s] = 0;
+        relocs[s] = 0;
+      }
+      objects.clear ();
+    }
+
+    uint32_t
+    symbol_hash (const char* name)
+    {
+      /*
+       * The DJB hash as used by the GNU hash section.
+       */
+      uint32_t h = 5381;
+      for (const uint8_t* c = (const uint8_t*) name; *c != '\0'; ++c)
+        h = (h << 5) + h + *c;
+      return h;
+    }
+
     /**
      * Update the offset taking into account the alignment.
      *
@@ -472,6 +745,73 @@ namespace rld
       return offset;
     }
 
+    /**
+     * The size of the sections placed one after the other with the padding
+     * each section's alignment needs.
+     *
+     * @param secs The sections in the order placed.
+     * @return uint32_t The size including the padding.
+     */
+    static uint32_t
+    sections_size (const files::section_refs& secs)
+    {
+      uint32_t size = 0;
+      for (files::section_refs::const_iterator si = secs.begin ();
+           si != secs.end ();
+           ++si)
+      {
+        const files::section& sec = *(*si);
+        size = align_offset (size, 0, sec.alignment) + sec.size;
+      }
+      return size;
+    }
+
+    /**
+     * The size of the sections' data without any padding.
+     *
+     * @param secs The sections.
+     * @return size_t The size of the data.
+     */
+    static size_t
+    sections_data_size (const files::section_refs& secs)
+    {
+      size_t size = 0;
+      for (files::section_refs::const_iterator si = secs.begin ();
+           si != secs.end ();
+           ++si)
+        size += (*si)->size;
+      return size;
+    }
+
+    /**
+     * The number of relocation records in the sections.
+     *
+     * @param secs The sections.
+     * @return size_t The number of relocation records.
+     */
+    static size_t
+    sections_relocs (const files::section_refs& secs)
+    {
+      size_t relocs = 0;
+      for (files::section_refs::const_iterator si = secs.begin ();
+           si != secs.end ();
+           ++si)
+        relocs += (*si)->relocs.size ();
+      return relocs;
+    }
+
+    /**
+     * Section sorter placing the larger alignments first.
+     */
+    class section_alignment_compare
+    {
+    public:
+      bool operator () (const files::section* lhs,
+                        const files::section* rhs) const {
+        return lhs->alignment > rhs->alignment;
+      }
+    };
+
     relocation::relocation (const files::relocation& reloc,
                             const uint32_t           offset)
       : offset (reloc.offset + offset),
@@ -485,6 +825,26 @@ namespace rld
     {
     }
 
+    compact_reloc::compact_reloc (uint32_t info,
+                                  uint32_t offset,
+                                  uint32_t addend)
+      : offset (offset),
+        addend (addend)
+    {
+      key = info & 0xff;
+      if ((info & RAP_RELOC_IMPORT) != 0)
+        key |= RAP_RELOC_KEY_IMPORT;
+      key |= ((info & ~RAP_RELOC_IMPORT) >> 8) << RAP_RELOC_KEY_INDEX;
+    }
+
+    bool
+    compact_reloc::operator < (const compact_reloc& rhs) const
+    {
+      if (key == rhs.key)
+        return offset < rhs.offset;
+      return key < rhs.key;
+    }
+
     section_detail::section_detail (uint32_t name,
                                     uint32_t offset,
                                     uint32_t id,
@@ -654,7 +1014,7 @@ namespace rld
      * section.
      */
     class section_merge:
-      public std::unary_function < const files::section, void >
+      public std::unary_function < const files::section*, void >
     {
     public:
 
@@ -662,7 +1022,7 @@ namespace rld
 
       ~section_merge ();
 
-      void operator () (const files::section& fsec);
+      void operator () (const files::section* fsec);
 
     private:
 
@@ -688,8 +1048,10 @@ namespace rld
     }
 
     void
-    section_merge::operator () (const files::section& fsec)
+    section_merge::operator () (const files::section* fsecp)
     {
+      const files::section& fsec = *fsecp;
+
       /*
        * Align the size up to the next alignment boundary and use that as the
        * offset for this object file section.
@@ -763,22 +1125,48 @@ namespace rld
     {
     }
 
-    external::external (const external& orig)
-      : name (orig.name),
-        sec (orig.sec),
-        value (orig.value),
-        data (orig.data)
+    import::import (const uint32_t name, const uint32_t hash)
+      : name (name),
+        hash (hash)
     {
     }
 
     object::object (files::object& obj)
-      : obj (obj)
+      : obj (obj),
+        packed (0),
+        loaded (false)
     {
       /*
        * Set up the names of the sections.
        */
       for (int s = 0; s < rap_secs; ++s)
+      {
         secs[s].name = section_names[s];
+        staged[s] = 0;
+      }
+    }
+
+    object::object (const object& orig)
+      : obj (orig.obj),
+        packed (0),
+        loaded (false)
+    {
+      if (orig.loaded)
+        throw rld_error_at ("cannot copy a loaded RAP object: " +
+                            obj.name ().full ());
+      for (int s = 0; s < rap_secs; ++s)
+      {
+        secs[s].name = section_names[s];
+        staged[s] = 0;
+      }
+    }
+
+    void
+    object::load ()
+    {
+      trace::span span ("rap-object", "rap", obj.name ().full ());
+
+      loaded = true;
 
       /*
        * Get the relocation records. Collect the various section types from the
@@ -809,33 +1197,29 @@ namespace rld
       obj.get_sections (symtab, SHT_SYMTAB);
       obj.get_sections (strtab, ".strtab");
 
-      std::for_each (text.begin (), text.end (),
-                     section_merge (*this, secs[rap_text]));
-      std::for_each (const_.begin (), const_.end (),
-                     section_merge (*this, secs[rap_const]));
-      std::for_each (ctor.begin (), ctor.end (),
-                     section_merge (*this, secs[rap_ctor]));
-      std::for_each (dtor.begin (), dtor.end (),
-                     section_merge (*this, secs[rap_dtor]));
-      std::for_each (data.begin (), data.end (),
-                     section_merge (*this, secs[rap_data]));
-      std::for_each (bss.begin (), bss.end (),
-                     section_merge (*this, secs[rap_bss]));
-    }
+      /*
+       * The constructor and destructor tables are not packed as the order of
+       * the entries is the order they are called.
+       */
+      if (pack_sections)
+      {
+        pack (text);
+        pack (const_);
+        pack (data);
+        pack (bss);
+      }
 
-    object::object (const object& orig)
-      : obj (orig.obj),
-        text (orig.text),
-        const_ (orig.const_),
-        ctor (orig.ctor),
-        dtor (orig.dtor),
-        data (orig.data),
-        bss (orig.bss),
-        symtab (orig.symtab),
-        strtab (orig.strtab)
-    {
+      /*
+       * Size each RAP section's relocations once so the records are not
+       * copied as the container grows.
+       */
       for (int s = 0; s < rap_secs; ++s)
-        secs[s] = orig.secs[s];
+      {
+        const files::section_refs& isecs = input_sections ((sections) s);
+        secs[s].relocs.reserve (sections_relocs (isecs));
+        std::for_each (isecs.begin (), isecs.end (),
+                       section_merge (*this, secs[s]));
+      }
     }
 
     sections
@@ -871,6 +1255,30 @@ namespace rld
                         "' not found: " + obj.name ().full (), "rap::object");
     }
 
+    const files::section_refs&
+    object::input_sections (sections sec) const
+    {
+      switch (sec)
+      {
+        case rap_text:
+          return text;
+        case rap_const:
+          return const_;
+        case rap_ctor:
+          return ctor;
+        case rap_dtor:
+          return dtor;
+        case rap_data:
+          return data;
+        case rap_bss:
+          return bss;
+        default:
+          break;
+      }
+      throw rld::error ("Invalid section index '" + rld::to_string (sec),
+                        "rap::input-sections");
+    }
+
     uint32_t
     object::get_relocations () const
     {
@@ -889,6 +1297,28 @@ namespace rld
       return secs[sec].relocs.size ();
     }
 
+    void
+    object::pack (files::section_refs& secs)
+    {
+      files::section_refs packed_secs (secs);
+
+      std::stable_sort (packed_secs.begin (), packed_secs.end (),
+                        section_alignment_compare ());
+
+      uint32_t size = sections_size (secs);
+      uint32_t packed_size = sections_size (packed_secs);
+
+      if (packed_size < size)
+      {
+        if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+          std::cout << "rap:pack: " << obj.name ().full ()
+                    << ": size=" << size
+                    << " packed=" << packed_size << std::endl;
+        secs.swap (packed_secs);
+        packed += size - packed_size;
+      }
+    }
+
     void
     object::output ()
     {
@@ -914,6 +1344,8 @@ namespace rld
     {
       clear ();
 
+      size_t esyms = 0;
+
       /*
        * Create the local objects which contain the layout information.
        */
@@ -927,9 +1359,21 @@ namespace rld
           throw rld::error ("Not valid: " + app_obj.name ().full (),
                             "rap::layout");
 
+        /*
+         * Add an empty object and load it in place so its sections and
+         * relocations are not copied.
+         */
         objs.push_back (object (app_obj));
+        objs.back ().load ();
+
+        esyms += app_obj.external_symbols ().size ();
       }
 
+      /*
+       * The image's symbols are at most the external symbols of the objects.
+       */
+      externs.reserve (esyms);
+
       for (objects::iterator oi = objs.begin (), poi = objs.begin ();
            oi != objs.end ();
            ++oi)
@@ -968,11 +1412,18 @@ namespace rld
         collect_symbols (obj);
 
         relocs_size += obj.get_relocations ();
+        packed += obj.packed;
 
         if (rld::verbose () >= RLD_VERBOSE_DETAILS)
           obj.output ();
       }
 
+      if (format_version >= rap_version_imports)
+        collect_imports ();
+
+      if (add_symbol_hash)
+        create_symbol_hash ();
+
       init_off = strtab.size () + 1;
       strtab += '\0';
       strtab += init;
@@ -996,7 +1447,12 @@ namespace rld
                   << " symbols:" << symtab_size << " (" << externs.size () << ')'
                   << " strings:" << strtab.size () + 1
                   << " relocs:" << relocs_size
+                  << " imports:" << imps.size ()
                   << std::endl;
+        if (pack_sections)
+          std::cout << "rap::layout: packing removed " << packed
+                    << " bytes of section padding"
+                    << std::endl;
       }
     }
 
@@ -1055,6 +1511,118 @@ namespace rld
       }
     }
 
+    void
+    image::collect_imports ()
+    {
+      for (objects::const_iterator oi = objs.begin ();
+           oi != objs.end ();
+           ++oi)
+      {
+        const object& obj = *oi;
+
+        for (int s = 0; s < rap_secs; ++s)
+        {
+          const relocations& relocs = obj.secs[s].relocs;
+
+          for (relocations::const_iterator ri = relocs.begin ();
+               ri != relocs.end ();
+               ++ri)
+          {
+            const relocation& reloc = *ri;
+
+            /*
+             * Local and section symbols are relocated to a RAP section and do
+             * not need to be imported.
+             */
+            if ((reloc.symtype == STT_SECTION) ||
+                (reloc.symbinding == STB_LOCAL))
+              continue;
+
+            if (import_index.find (reloc.symname) != import_index.end ())
+              continue;
+
+            std::size_t name = find_in_strtab (reloc.symname);
+
+            if (name == std::string::npos)
+            {
+              name = strtab.size () + 1;
+              strtab += '\0';
+              strtab += reloc.symname;
+            }
+
+            import_index[reloc.symname] = imps.size ();
+            imps.push_back (import (name, symbol_hash (reloc.symname.c_str ())));
+          }
+        }
+      }
+
+      if (imps.size () >= (1UL << 23))
+        throw rld::error ("Too many imported symbols: " +
+                          rld::to_string (imps.size ()),
+                          "rap::collect-imports");
+    }
+
+    void
+    image::create_symbol_hash ()
+    {
+      /*
+       * The table is the number of buckets, the bloom filter size in words
+       * and the bloom shift, then the bloom filter, the buckets and a chain
+       * entry for each symbol. The buckets hold the index of the bucket's
+       * first symbol and the chain holds each symbol's hash with bit 0 set on
+       * the last symbol in a bucket. This is the GNU hash section's layout
+       * with 32 bit bloom filter words.
+       */
+      uint32_t symbols = externs.size ();
+      uint32_t buckets = (symbols / 2) + 1;
+      uint32_t bloom_size = 1;
+
+      while ((bloom_size * 32) < (symbols * 2))
+        bloom_size <<= 1;
+
+      std::stable_sort (externs.begin (), externs.end (),
+                        external_bucket_compare (strtab, buckets));
+
+      symhash.clear ();
+      symhash.push_back (buckets);
+      symhash.push_back (bloom_size);
+      symhash.push_back (RAP_SYMHASH_BLOOM_SHIFT);
+
+      size_t bloom = symhash.size ();
+      symhash.resize (bloom + bloom_size, 0);
+
+      size_t bucket = symhash.size ();
+      symhash.resize (bucket + buckets, RAP_SYMHASH_EMPTY);
+
+      size_t   chain = symhash.size ();
+      uint32_t index = 0;
+
+      for (externals::const_iterator ei = externs.begin ();
+           ei != externs.end ();
+           ++ei, ++index)
+      {
+        uint32_t hash = symbol_hash (&strtab[(*ei).name]);
+        uint32_t b = hash % buckets;
+
+        symhash[bloom + ((hash / 32) % bloom_size)] |=
+          (1UL << (hash % 32)) | (1UL << ((hash >> RAP_SYMHASH_BLOOM_SHIFT) % 32));
+
+        if (symhash[bucket + b] == RAP_SYMHASH_EMPTY)
+          symhash[bucket + b] = index;
+        else
+          symhash[chain + index - 1] &= ~1UL;
+
+        symhash.push_back (hash | 1);
+      }
+
+      if (rld::verbose () >= RLD_VERBOSE_INFO)
+        std::cout << "rap::symbol-hash: symbols:" << symbols
+                  << " buckets:" << buckets
+                  << " bloom:" << bloom_size
+                  << " size:" << symhash.size () * sizeof (uint32_t)
+                  << std::endl;
+    }
+
     void
     image::write (compress::compressor& comp)
     {
@@ -1069,6 +1637,8 @@ namespace rld
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "rap:output: machine=" << comp.transferred () << std::endl;
 
+      uint32_t mark = comp.transferred ();
+
       comp << elf::object_machine_type ()
            << elf::object_datatype ()
            << elf::object_class ();
@@ -1087,6 +1657,17 @@ namespace rld
            << (uint32_t) strtab.size () + 1
            << (uint32_t) 0;
 
+      /*
+       * Version 3 adds the size of the import table and the size of the
+       * symbol hash table.
+       */
+      if (format_version >= rap_version_imports)
+        comp << (uint32_t) (imps.size () * import::rap_size)
+             << (uint32_t) (symhash.size () * sizeof (uint32_t));
+
+      cost.header = comp.transferred () - mark;
+      mark = comp.transferred ();
+
       /*
        * Output file details
        */
@@ -1099,33 +1680,77 @@ namespace rld
         comp << (uint32_t)0; /* No file details */
       }
 
+      cost.details = comp.transferred () - mark;
+      mark = comp.transferred ();
+
       /*
        * The sections.
        */
       for (int s = 0; s < rap_secs; ++s)
+      {
         comp << sec_size[s]
              << sec_align[s];
+        cost.sections[s] = sec_size[s];
+      }
+
+      cost.header += comp.transferred () - mark;
 
       /*
        * Output the sections from each object file.
        */
+      stage ();
+
       write (comp, rap_text);
       write (comp, rap_const);
       write (comp, rap_ctor);
       write (comp, rap_dtor);
       write (comp, rap_data);
 
+      std::vector < uint8_t > ().swap (staging);
+
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "rap:output: strtab=" << comp.transferred () << std::endl;
 
+      mark = comp.transferred ();
+
       strtab += '\0';
       comp << strtab;
 
+      cost.strtab = comp.transferred () - mark;
+
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "rap:output: symbols=" << comp.transferred () << std::endl;
 
+      mark = comp.transferred ();
+
       write_externals (comp);
 
+      cost.symtab = comp.transferred () - mark;
+
+      if (!symhash.empty ())
+      {
+        if (rld::verbose () >= RLD_VERBOSE_INFO)
+          std::cout << "rap:output: symhash=" << comp.transferred () << std::endl;
+
+        mark = comp.transferred ();
+
+        write_symbol_hash (comp);
+
+        cost.symhash = comp.transferred () - mark;
+      }
+
+      if (format_version >= rap_version_imports)
+      {
+        if (rld::verbose () >= RLD_VERBOSE_INFO)
+          std::cout << "rap:output: imports=" << comp.transferred () << std::endl;
+
+        mark = comp.transferred ();
+
+        write_imports (comp);
+
+        cost.imports = comp.transferred () - mark;
+      }
+
       if (rld::verbose () >= RLD_VERBOSE_INFO)
         std::cout << "rap:output: relocs=" << comp.transferred () << std::endl;
 
@@ -1174,31 +1799,16 @@ namespace rld
       if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
         std::cout << "rap:writing: " << section_names[sec] << std::endl;
 
-      switch (sec)
-      {
-        case rap_text:
-          img.write (comp, obj.obj, obj.text, offset);
-          break;
-        case rap_const:
-          img.write (comp, obj.obj, obj.const_, offset);
-          break;
-        case rap_ctor:
-          img.write (comp, obj.obj, obj.ctor, offset);
-          break;
-        case rap_dtor:
-          img.write (comp, obj.obj, obj.dtor, offset);
-          break;
-        case rap_data:
-          img.write (comp, obj.obj, obj.data, offset);
-          break;
-        default:
-          break;
-      }
+      if (sec != rap_bss)
+        img.write (comp, obj.obj, obj.input_sections (sec), obj.staged[sec],
+                   offset);
     }
 
     void
     image::write (compress::compressor& comp, sections sec)
     {
+      trace::span span ("section-writer", "rap", section_names[sec]);
+
       uint32_t image_offset = comp.transferred ();
 
       std::for_each (objs.begin (), objs.end (),
@@ -1217,64 +1827,115 @@ namespace rld
     }
 
     void
-    image::write (compress::compressor&  comp,
-                  files::object&         obj,
-                  const files::sections& secs,
-                  uint32_t&              offset)
+    image::stage ()
     {
-      uint32_t size = 0;
+      size_t total = 0;
 
-      obj.open ();
+      for (objects::const_iterator oi = objs.begin ();
+           oi != objs.end ();
+           ++oi)
+      {
+        const object& obj = *oi;
+        for (int s = rap_text; s <= rap_data; ++s)
+          total += sections_data_size (obj.input_sections ((sections) s));
+      }
 
-      try
+      staging.resize (total);
+
+      uint32_t staged = 0;
+
+      for (objects::iterator oi = objs.begin ();
+           oi != objs.end ();
+           ++oi)
       {
-        obj.begin ();
+        object& obj = *oi;
 
         if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
-          std::cout << "rap:write sections: " << obj.name ().full () << std::endl;
+          std::cout << "rap:stage: " << obj.obj.name ().full ()
+                    << " offset=" << staged << std::endl;
+
+        obj.obj.open ();
 
-        for (files::sections::const_iterator si = secs.begin ();
-             si != secs.end ();
-             ++si)
+        try
         {
-          const files::section& sec = *si;
-          uint32_t              unaligned_offset = offset + size;
+          for (int s = rap_text; s <= rap_data; ++s)
+          {
+            const files::section_refs& secs =
+              obj.input_sections ((sections) s);
 
-          offset = align_offset (offset, size, sec.alignment);
+            obj.staged[s] = staged;
 
-          if (offset != unaligned_offset)
-          {
-            char ee = '\xee';
-            for (uint32_t p = 0; p < (offset - unaligned_offset); ++p)
-              comp.write (&ee, 1);
+            for (files::section_refs::const_iterator si = secs.begin ();
+                 si != secs.end ();
+                 ++si)
+            {
+              const files::section& sec = *(*si);
+
+              if (sec.size &&
+                  !obj.obj.seek_read (sec.offset, &staging[staged], sec.size))
+                throw rld::error ("Section data read failed: " + sec.name,
+                                  "rap::stage:" + obj.obj.name ().full ());
+
+              staged += sec.size;
+            }
           }
+        }
+        catch (...)
+        {
+          obj.obj.close ();
+          throw;
+        }
+
+        obj.obj.close ();
+      }
+    }
+
+    void
+    image::write (compress::compressor&      comp,
+                  files::object&             obj,
+                  const files::section_refs& secs,
+                  uint32_t                   staged,
+                  uint32_t&                  offset)
+    {
+      uint32_t size = 0;
+
+      if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
+        std::cout << "rap:write sections: " << obj.name ().full () << std::endl;
 
-          comp.write (obj, sec.offset, sec.size);
+      for (files::section_refs::const_iterator si = secs.begin ();
+           si != secs.end ();
+           ++si)
+      {
+        const files::section& sec = *(*si);
+        uint32_t              unaligned_offset = offset + size;
 
-          if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
-            std::cout << " sec: " << sec.index << ' ' << sec.name
-                      << " offset=" << offset
-                      << " size=" << sec.size
-                      << " align=" << sec.alignment
-                      << " padding=" << (offset - unaligned_offset)  << std::endl;
+        offset = align_offset (offset, size, sec.alignment);
 
-          size = sec.size;
+        if (offset != unaligned_offset)
+        {
+          char ee = '\xee';
+          for (uint32_t p = 0; p < (offset - unaligned_offset); ++p)
+            comp.write (&ee, 1);
         }
 
-        offset += size;
+        if (sec.size)
+          comp.write (&staging[staged], sec.size);
 
         if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
-          std::cout << " total size=" << offset << std::endl;
-
-        obj.end ();
-      }
-      catch (...)
-      {
-        obj.close ();
-        throw;
+          std::cout << " sec: " << sec.index << ' ' << sec.name
+                    << " offset=" << offset
+                    << " size=" << sec.size
+                    << " align=" << sec.alignment
+                    << " padding=" << (offset - unaligned_offset)  << std::endl;
+
+        staged += sec.size;
+        size = sec.size;
       }
 
-      obj.close ();
+      offset += size;
+
+      if (rld::verbose () >= RLD_VERBOSE_FULL_DEBUG)
+        std::cout << " total size=" << offset << std::endl;
     }
 
     void
@@ -1305,6 +1966,36 @@ namespace rld
       }
     }
 
+    void
+    image::write_symbol_hash (compress::compressor& comp)
+    {
+      for (symbol_hash_table::const_iterator hi = symhash.begin ();
+           hi != symhash.end ();
+           ++hi)
+        comp << *hi;
+    }
+
+    void
+    image::write_imports (compress::compressor& comp)
+    {
+      int count = 0;
+      for (imports::const_iterator ii = imps.begin ();
+           ii != imps.end ();
+           ++ii, ++count)
+      {
+        const import& imp = *ii;
+
+        if (rld::verbose () >= RLD_VERBOSE_TRACE)
+          std::cout << "rap:imports: " << count
+                    << " name=" << &strtab[imp.name] << " (" << imp.name << ')'
+                    << " hash=0x" << std::hex << imp.hash << std::dec
+                    << std::endl;
+
+        comp << imp.hash
+             << imp.name;
+      }
+    }
+
     void
     image::write_relocations (compress::compressor& comp)
     {
@@ -1313,6 +2004,7 @@ namespace rld
         uint32_t count = get_relocations (s);
         uint32_t sr = 0;
         uint32_t header;
+        uint32_t mark = comp.transferred ();
 
         if (rld::verbose () >= RLD_VERBOSE_TRACE)
           std::cout << "rap:relocation: section:" << section_names[s]
@@ -1325,6 +2017,8 @@ namespace rld
 
         comp << header;
 
+        compact_relocs compacts;
+
         for (objects::iterator oi = objs.begin ();
              oi != objs.end ();
              ++oi)
@@ -1333,6 +2027,7 @@ namespace rld
           section&     sec = obj.secs[s];
           relocations& relocs = sec.relocs;
           uint32_t     rc = 0;
+          uint32_t     obj_mark = comp.transferred ();
 
           if (rld::verbose () >= RLD_VERBOSE_TRACE)
             std::cout << " relocs=" << sec.relocs.size ()
@@ -1395,6 +2090,17 @@ namespace rld
                             << std::endl;
               }
             }
+            else if (format_version >= rap_version_imports)
+            {
+              /*
+               * Bit 31 set, bits 30:8 the import table index.
+               */
+              import_indexes::const_iterator ii =
+                import_index.find (reloc.symname);
+              if (ii == import_index.end ())
+                throw rld::error ("import not found", reloc.symname);
+              info |= RAP_RELOC_IMPORT | ((*ii).second << 8);
+            }
             else
             {
               /*
@@ -1432,7 +2138,7 @@ namespace rld
                         << " offset=" << offset;
               if (write_addend)
                 std::cout << " addend=" << addend;
-              if ((info & RAP_RELOC_STRING) != 0)
+              if ((info & (RAP_RELOC_STRING | RAP_RELOC_IMPORT)) != 0)
               {
                 std::cout << " symname=" << reloc.symname;
                 if (write_symname)
@@ -1445,6 +2151,12 @@ namespace rld
                         << std::endl;
             }
 
+            if (format_version >= rap_version_compact)
+            {
+              compacts.push_back (compact_reloc (info, offset, addend));
+              continue;
+            }
+
             comp << info << offset;
 
             if (write_addend)
@@ -1453,6 +2165,81 @@ namespace rld
             if (write_symname)
               comp << reloc.symname;
           }
+
+          if (rc)
+          {
+            reloc_cost& rcost = cost.objects[&obj.obj];
+            rcost.records[s] = rc;
+            rcost.bytes[s] = comp.transferred () - obj_mark;
+          }
+        }
+
+        if (format_version >= rap_version_compact)
+        {
+          uint32_t compact_mark = comp.transferred ();
+
+          write_relocations (comp, compacts, sec_rela[s]);
+
+          /*
+           * The compact records of the objects are merged so share the bytes
+           * by the number of records.
+           */
+          uint32_t bytes = comp.transferred () - compact_mark;
+          if (count)
+          {
+            for (reloc_costs::iterator rci = cost.objects.begin ();
+                 rci != cost.objects.end ();
+                 ++rci)
+            {
+              reloc_cost& rcost = (*rci).second;
+              rcost.bytes[s] =
+                (uint32_t) (((uint64_t) bytes * rcost.records[s]) / count);
+            }
+          }
+        }
+
+        cost.relocs[s] = comp.transferred () - mark;
+      }
+    }
+
+    void
+    image::write_relocations (compress::compressor& comp,
+                              compact_relocs&       relocs,
+                              bool                  rela)
+    {
+      std::stable_sort (relocs.begin (), relocs.end ());
+
+      compact_relocs::size_type r = 0;
+
+      while (r < relocs.size ())
+      {
+        uint32_t key = relocs[r].key;
+        uint32_t run = 1;
+
+        while (((r + run) < relocs.size ()) && (relocs[r + run].key == key))
+          ++run;
+
+        /*
+         * Imported symbols only have an addend in RELA sections.
+         */
+        bool write_addend = rela || ((key & RAP_RELOC_KEY_IMPORT) == 0);
+
+        if (rld::verbose () >= RLD_VERBOSE_TRACE)
+          std::cout << "  run: key=0x" << std::hex << key << std::dec
+                    << " length=" << run << std::endl;
+
+        compress::write_uleb128 (comp, run);
+        compress::write_uleb128 (comp, key);
+
+        uint32_t last = 0;
+
+        for (; run > 0; --run, ++r)
+        {
+          const compact_reloc& reloc = relocs[r];
+          compress::write_uleb128 (comp, reloc.offset - last);
+          if (write_addend)
+            compress::write_sleb128 (comp, (int32_t) reloc.addend);
+          last = reloc.offset;
         }
       }
     }
@@ -1462,10 +2249,10 @@ namespace rld
 
       std::string strtable;
       uint32_t pos = 0;
+      size_t details = 0;
 
       section_details s_details;
 
-
       if (rld::verbose () >= RLD_VERBOSE_TRACE)
       {
         std::cout << "rap:file details" << std::endl
@@ -1496,8 +2283,13 @@ namespace rld
           /* obj full name */
           strtable += obj.obj.name ().full ();
           strtable += '\0';
+
+          for (int s = 0; s < rap_secs; ++s)
+            details += obj.secs[s].osindexes.size ();
       }
 
+      s_details.reserve (details);
+
       pos = strtable.length ();
 
       uint32_t sec_num = 0;
@@ -1601,11 +2393,18 @@ namespace rld
         sec_align[s] = 0;
         sec_rela[s] = false;
       }
+      objs.clear ();
+      externs.clear ();
       symtab_size = 0;
+      symhash.clear ();
       strtab.clear ();
       relocs_size = 0;
+      packed = 0;
+      imps.clear ();
+      import_index.clear ();
       init_off = 0;
       fini_off = 0;
+      cost.clear ();
     }
 
     uint32_t
@@ -1633,27 +2432,90 @@ namespace rld
       return std::string::npos;
     }
 
+    const costs&
+    image::get_costs () const
+    {
+      return cost;
+    }
+
+    void
+    image::get_placements (placements& placed) const
+    {
+      for (int s = 0; s < rap_secs; ++s)
+      {
+        for (objects::const_iterator oi = objs.begin ();
+             oi != objs.end ();
+             ++oi)
+        {
+          const object&  obj = *oi;
+          const section& sec = obj.secs[s];
+          for (osecindexes::const_iterator osi = sec.osindexes.begin ();
+               osi != sec.osindexes.end ();
+               ++osi)
+          {
+            const osection& osec = sec.get_osection (*osi);
+            placed.push_back (placement (&obj.obj, osec.name, *osi,
+                                         (sections) s,
+                                         sec.offset + osec.offset,
+                                         osec.size, osec.align));
+          }
+        }
+      }
+    }
+
+    /**
+     * The compressed RAP body is held in memory so the header with the length
+     * can be written before the body. The output is written in order and never
+     * seeked so it can be a pipe.
+     */
     void
     write (files::image&             app,
            const std::string&        init,
            const std::string&        fini,
            const files::object_list& app_objects,
-           const symbols::table&     /* symbols */) /* Add back for incremental
-                                                     * linking */
+           const symbols::table&     /* symbols */, /* Add back for incremental
+                                                      * linking */
+           placements*               placed,
+           costs*                    cost)
     {
-      std::string header;
+      if ((format_version < rap_version_names) ||
+          (format_version > rap_version_latest))
+        throw rld::error ("Invalid RAP format version: " +
+                          rld::to_string (format_version),
+                          "rap::write");
 
-      header = "RAP,00000000,0002,LZ77,00000000\n";
-      app.write (header.c_str (), header.size ());
+      if (add_symbol_hash && (format_version < rap_version_imports))
+        throw rld::error ("The symbol hash table needs RAP format version 3 or later",
+                          "rap::write");
+
+      std::ostringstream version;
+      std::string        header;
+
+      version << std::setfill ('0') << std::setw (4) << format_version;
 
-      compress::compressor compressor (app, 2 * 1024);
+      header = "RAP,00000000," + version.str () + ",LZ77,00000000\n";
+
+      files::memory_image  body;
+      compress::compressor compressor (body, 2 * 1024);
       image                rap;
 
-      rap.layout (app_objects, init, fini);
+      {
+        stats::phase phase ("rap-layout");
+        rap.layout (app_objects, init, fini);
+      }
+
+      if (placed)
+        rap.get_placements (*placed);
+
+      stats::phase phase ("section-emit");
+
       rap.write (compressor);
 
       compressor.flush ();
 
+      if (cost)
+        *cost = rap.get_costs ();
+
       std::ostringstream length;
 
       length << std::setfill ('0') << std::setw (8)
@@ -1661,8 +2523,8 @@ namespace rld
 
       header.replace (4, 8, length.str ());
 
-      app.seek (0);
       app.write (header.c_str (), header.size ());
+      app.write (body.data (), body.size ());
 
       if (rld::verbose () >= RLD_VERBOSE_INFO)
       {
@@ -41,12 +41,67 @@ namespace rld
       */
      extern std::string rpath;
 
+    /**
+     * The RAP format versions the linker can write.
+     */
+    enum versions
+    {
+      rap_version_names = 2,   //< Relocations carry the symbol's name.
+      rap_version_imports = 3, //< Relocations reference the import table.
+      rap_version_compact = 4, //< Relocation records are compacted.
+      rap_version_default = rap_version_names,
+      rap_version_latest = rap_version_compact
+    };
+
+    /**
+     * The RAP format version to write.
+     */
+    extern uint32_t format_version;
+
+    /**
+     * Return the RAP format version given as an option's argument. Throws an
+     * error if the argument is not a version the linker can write.
+     *
+     * @param arg The option's argument.
+     */
+    uint32_t parse_format_version (const char* arg);
+
+    /**
+     * Add the exported symbol hash table or not. Needs version 3 or later.
+     */
+    extern bool add_symbol_hash;
+
+    /**
+     * Pack the object file sections in each RAP section by decreasing
+     * alignment to reduce the padding.
+     */
+    extern bool pack_sections;
+
+    /**
+     * The symbol hash table's bloom filter uses two bits per symbol. The
+     * second bit is selected by the hash shifted by this amount.
+     */
+    #define RAP_SYMHASH_BLOOM_SHIFT 6
+
+    /**
+     * A symbol hash table bucket with no symbols.
+     */
+    #define RAP_SYMHASH_EMPTY 0xffffffffUL
+
     /**
      * The RAP relocation bit masks.
      */
     #define RAP_RELOC_RELA         (1UL << 31)
     #define RAP_RELOC_STRING       (1UL << 31)
     #define RAP_RELOC_STRING_EMBED (1UL << 30)
+    #define RAP_RELOC_IMPORT       (1UL << 31)
+
+    /**
+     * The compact relocation record key packs the relocation type, the import
+     * flag and the import or RAP section index.
+     */
+    #define RAP_RELOC_KEY_IMPORT   (1UL << 8)
+    #define RAP_RELOC_KEY_INDEX    9
 
     /**
      * The sections of interest in a RAP file.
@@ -67,6 +122,81 @@ namespace rld
      */
     const char* section_name (int sec);
 
+    /**
+     * Return the hash of a symbol's name. This is the hash held in the import
+     * table so the target can check its symbol table without comparing the
+     * strings.
+     */
+    uint32_t symbol_hash (const char* name);
+
+    /**
+     * The place of an object file's section in a RAP section.
+     */
+    struct placement
+    {
+      files::object* obj;      //< The object file.
+      std::string    name;     //< The object file's section name.
+      int            index;    //< The object file's section index.
+      sections       sec;      //< The RAP section.
+      uint32_t       offset;   //< The offset in the RAP section.
+      uint32_t       size;     //< The size of the section.
+      uint32_t       align;    //< The alignment of the section.
+
+      placement (files::object*     obj,
+                 const std::string& name,
+                 int                index,
+                 sections           sec,
+                 uint32_t           offset,
+                 uint32_t           size,
+                 uint32_t           align);
+    };
+
+    /**
+     * A container of placements in the order of the RAP sections.
+     */
+    typedef std::vector < placement > placements;
+
+    /**
+     * The relocation records of an object file in each RAP section.
+     */
+    struct reloc_cost
+    {
+      uint32_t records[rap_secs]; //< The number of relocation records.
+      uint32_t bytes[rap_secs];   //< The bytes of relocation records. The
+                                  //  compact records are shared in
+                                  //  proportion to the number of records.
+
+      reloc_cost ();
+    };
+
+    /**
+     * The relocation costs keyed by the object file.
+     */
+    typedef std::map < const files::object*, reloc_cost > reloc_costs;
+
+    /**
+     * The bytes each part of a RAP image takes before it is compressed.
+     */
+    struct costs
+    {
+      uint32_t    header;             //< The header and section table.
+      uint32_t    details;            //< The object file details.
+      uint32_t    strtab;             //< The string table.
+      uint32_t    symtab;             //< The exported symbol table.
+      uint32_t    symhash;            //< The symbol hash table.
+      uint32_t    imports;            //< The import table.
+      uint32_t    sections[rap_secs]; //< The size of each RAP section.
+      uint32_t    relocs[rap_secs];   //< The relocation table of each section.
+      reloc_costs objects;            //< The relocation costs of each object.
+
+      costs ();
+
+      /**
+       * Clear the costs.
+       */
+      void clear ();
+    };
+
     /**
      * Write a RAP format file.
      *
@@ -85,12 +215,18 @@ namespace rld
      * @param fini The application's finish entry point .
      * @param objects The list of object files in the application.
      * @param symbols The symbol table used to create the application.
+     * @param placed If not 0 the place of each object file section in the
+     *               layout is returned.
+     * @param cost If not 0 the bytes each part of the image takes is
+     *             returned.
      */
     void write (files::image&             app,
                 const std::string&        init,
                 const std::string&        fini,
                 const files::object_list& objects,
-                const symbols::table&     symbols);
+                const symbols::table&     symbols,
+                placements*               placed = 0,
+                costs*                    cost = 0);
   }
 }
 
@@ -32,7 +32,8 @@
 #include <sys/stat.h>
 
 #include <rld.h>
-#include <rld.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 namespace rld
 {
@@ -59,6 +60,8 @@ namespace rld
     {
       const std::string name = files::basename (fullname);
 
+      trace::span span ("resolve-symbols", "resolver", fullname);
+
       static int nesting = 0;
 
       ++nesting;
@@ -160,6 +163,7 @@ namespace rld
           urs.set_object (eobj);
           if (!eobj.resolved () && !eobj.resolving ())
           {
+            eobj.set_reference (urs.name (), fullname);
             objects.push_back (&eobj);
             objects.unique ();
           }
@@ -201,7 +205,7 @@ namespace rld
 
       --nesting;
 
-      dependents.merge (objects);
+      dependents.merge (objects, files::link_order);
       dependents.unique ();
     }
 
@@ -212,6 +216,8 @@ namespace rld
              symbols::table&     symbols,
              symbols::symtab&    undefined)
     {
+      stats::phase phase ("resolve");
+
       files::object_list objects;
       cache.get_objects (objects);
 
@@ -237,6 +243,12 @@ namespace rld
                                    object.unresolved_symbols (),
                                    object.name ().full ());
       }
+
+      /*
+       * An object referenced by more than one object can be in the list more
+       * than once if the copies are not next to each other. Keep the first.
+       */
+      files::remove_duplicates (dependents);
     }
   }
 
@@ -0,0 +1,869 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker server and client.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include <rld.h>
+#include <rld-server.h>
+
+#if defined (HAVE_SYS_SOCKET_H) && defined (HAVE_SYS_UN_H) && \
+    defined (HAVE_SYS_WAIT_H) && defined (HAVE_POLL_H)
+#define RLD_SERVER 1
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace rld
+{
+  namespace server
+  {
+    /**
+     * A request starts with the magic and the size of the working directory
+     * and arguments that follow. The client's standard streams are passed
+     * with the header.
+     */
+    static const char     request_magic[4] = { 'R', 'L', 'D', '1' };
+    static const uint32_t request_max = 1024 * 1024;
+
+    handler::~handler ()
+    {
+    }
+
+    const std::string
+    default_socket ()
+    {
+      const char* env = ::getenv ("RTEMS_LD_SERVER");
+      if (env && *env)
+        return env;
+      std::string tmp = "/tmp";
+      env = ::getenv ("TMPDIR");
+      if (env && *env)
+        tmp = env;
+      std::string path;
+      rld::files::path_join (tmp,
+                             "rtems-ld-" + rld::to_string (::getuid ()) + ".sock",
+                             path);
+      return path;
+    }
+
+#if RLD_SERVER
+    /**
+     * The notes socket in a child.
+     */
+    static int notes_fd = -1;
+
+    static bool
+    write_all (int fd, const void* data, size_t size)
+    {
+      const char* d = static_cast < const char* > (data);
+      while (size)
+      {
+        ssize_t w = ::send (fd, d, size, MSG_NOSIGNAL);
+        if (w < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+        d += w;
+        size -= w;
+      }
+      return true;
+    }
+
+    static bool
+    read_all (int fd, void* data, size_t size)
+    {
+      char* d = static_cast < char* > (data);
+      while (size)
+      {
+        ssize_t r = ::read (fd, d, size);
+        if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return false;
+        }
+        if (r == 0)
+          return false;
+        d += r;
+        size -= r;
+      }
+      return true;
+    }
+
+    static void
+    make_address (const std::string& path, struct sockaddr_un& addr)
+    {
+      if (path.size () >= sizeof (addr.sun_path))
+        throw rld::error ("Path too long", "server:socket: " + path);
+      ::memset (&addr, 0, sizeof (addr));
+      addr.sun_family = AF_UNIX;
+      ::strcpy (addr.sun_path, path.c_str ());
+    }
+
+    static int
+    connect_to (const std::string& path)
+    {
+      struct sockaddr_un addr;
+      make_address (path, addr);
+      int sd = ::socket (AF_UNIX, SOCK_STREAM, 0);
+      if (sd < 0)
+        throw rld::error (::strerror (errno), "server:socket: " + path);
+      if (::connect (sd, (struct sockaddr*) &addr, sizeof (addr)) < 0)
+      {
+        ::close (sd);
+        return -1;
+      }
+      return sd;
+    }
+
+    /**
+     * Is the peer of the connection the user ? The client passes its streams
+     * and the server runs commands as the user so neither talks to another
+     * user. If the host cannot tell who the peer is the peer is not trusted.
+     */
+    static bool
+    peer_is_user (int sd)
+    {
+#if defined (SO_PEERCRED)
+      struct ucred cred;
+      socklen_t    len = sizeof (cred);
+      if (::getsockopt (sd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return false;
+      return cred.uid == ::getuid ();
+#elif defined (HAVE_GETPEEREID)
+      uid_t uid;
+      gid_t gid;
+      if (::getpeereid (sd, &uid, &gid) < 0)
+        return false;
+      return uid == ::getuid ();
+#else
+      (void) sd;
+      return false;
+#endif
+    }
+
+    /**
+     * A child running a request.
+     */
+    struct child
+    {
+      int  client;  //< The client's connection.
+      int  notes;   //< The server's end of the notes socket.
+      bool killed;  //< The client has gone and the child has been killed.
+    };
+
+    typedef std::map < pid_t, child > children;
+
+    /**
+     * The SIGCHLD handler writes to a pipe to wake the server.
+     */
+    static int sigchld_pipe[2] = { -1, -1 };
+
+    extern "C" void
+    sigchld_handler (int)
+    {
+      int  e = errno;
+      char c = 0;
+      if (::write (sigchld_pipe[1], &c, 1) < 0)
+      {
+        /* the pipe is full so the server is awake */
+      }
+      errno = e;
+    }
+
+    static int32_t
+    exit_code (int status)
+    {
+      if (WIFEXITED (status))
+        return WEXITSTATUS (status);
+      if (WIFSIGNALED (status))
+        return 128 + WTERMSIG (status);
+      return 12;
+    }
+
+    /**
+     * Read the notes of a child that has exited. The child's end of the notes
+     * socket is closed so this reads to the end.
+     */
+    static std::string
+    read_notes (int fd)
+    {
+      std::string notes;
+      char        buf[1024];
+      while (true)
+      {
+        ssize_t r = ::read (fd, buf, sizeof (buf));
+        if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          break;
+        }
+        if (r == 0)
+          break;
+        notes.append (buf, r);
+      }
+      return notes;
+    }
+
+    static void
+    pass_notes (handler& handler_, const std::string& notes)
+    {
+      try
+      {
+        handler_.noted (notes);
+      }
+      catch (rld::error re)
+      {
+        std::cerr << "error: server: " << re.where << ": " << re.what
+                  << std::endl;
+      }
+    }
+
+    static void
+    reap (children& kids, handler& handler_)
+    {
+      while (true)
+      {
+        int   s = 0;
+        pid_t pid = ::waitpid (-1, &s, WNOHANG);
+        if (pid <= 0)
+          break;
+
+        children::iterator ci = kids.find (pid);
+        if (ci == kids.end ())
+          continue;
+
+        child&      c = (*ci).second;
+        int32_t     code = exit_code (s);
+        std::string notes = read_notes (c.notes);
+
+        write_all (c.client, &code, sizeof (code));
+
+        ::close (c.client);
+        ::close (c.notes);
+        kids.erase (ci);
+
+        if (rld::verbose () >= RLD_VERBOSE_INFO)
+          std::cout << "server: request " << pid << ": exit: " << code
+                    << std::endl;
+
+        pass_notes (handler_, notes);
+      }
+    }
+
+    /**
+     * Receive the request's header and the client's standard streams.
+     */
+    static bool
+    receive_header (int sd, uint32_t& size, int fds[3])
+    {
+      char          header[sizeof (request_magic) + sizeof (uint32_t)];
+      struct iovec  iov;
+      struct msghdr msg;
+      char          control[CMSG_SPACE (sizeof (int) * 3)];
+
+      ::memset (&msg, 0, sizeof (msg));
+      iov.iov_base = header;
+      iov.iov_len = sizeof (header);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof (control);
+
+      ssize_t r;
+      do
+        r = ::recvmsg (sd, &msg, 0);
+      while ((r < 0) && (errno == EINTR));
+
+      if (r <= 0)
+        return false;
+
+      int received = 0;
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+           cmsg != 0;
+           cmsg = CMSG_NXTHDR (&msg, cmsg))
+      {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+        {
+          int* cfds = (int*) CMSG_DATA (cmsg);
+          int  count = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+          for (int f = 0; f < count; ++f)
+          {
+            if (received < 3)
+              fds[received++] = cfds[f];
+            else
+              ::close (cfds[f]);
+          }
+        }
+      }
+
+      if ((received != 3) ||
+          ((size_t) r < sizeof (header) &&
+           !read_all (sd, header + r, sizeof (header) - r)) ||
+          (::memcmp (header, request_magic, sizeof (request_magic)) != 0))
+      {
+        for (int f = 0; f < received; ++f)
+          ::close (fds[f]);
+        return false;
+      }
+
+      ::memcpy (&size, header + sizeof (request_magic), sizeof (size));
+
+      if (size > request_max)
+      {
+        for (int f = 0; f < 3; ++f)
+          ::close (fds[f]);
+        return false;
+      }
+
+      return true;
+    }
+
+    /**
+     * Run the request's command line in a child. This does not return.
+     */
+    static void
+    run_request (handler& handler_, int argc, char* argv[])
+    {
+      int ec;
+      try
+      {
+        ec = handler_.request (argc, argv);
+      }
+      catch (...)
+      {
+        std::cerr << "error: unhandled exception" << std::endl;
+        ec = 12;
+      }
+
+      /*
+       * Do not run the destructors of the parent's state.
+       */
+      std::cout.flush ();
+      std::cerr.flush ();
+      ::fflush (0);
+      ::_exit (ec);
+    }
+
+    /**
+     * Run the request in the child. This does not return.
+     */
+    static void
+    run_child (handler&           handler_,
+               int                fds[3],
+               int                notes,
+               std::string&       request)
+    {
+      ::signal (SIGCHLD, SIG_DFL);
+      ::signal (SIGPIPE, SIG_DFL);
+
+      for (int f = 0; f < 3; ++f)
+      {
+        if (fds[f] != f)
+        {
+          ::dup2 (fds[f], f);
+          ::close (fds[f]);
+        }
+      }
+
+      notes_fd = notes;
+
+      /*
+       * The request is the working directory followed by the arguments, each
+       * terminated by a nul.
+       */
+      std::vector < char* > argv;
+      std::string::size_type start = 0;
+      while (start < request.size ())
+      {
+        std::string::size_type end = request.find ('\0', start);
+        if (end == std::string::npos)
+          break;
+        argv.push_back (&request[start]);
+        start = end + 1;
+      }
+
+      if (argv.size () < 2)
+      {
+        std::cerr << "error: server: invalid request" << std::endl;
+        ::_exit (10);
+      }
+
+      if (::chdir (argv[0]) < 0)
+      {
+        std::cerr << "error: server: chdir: " << argv[0] << ": "
+                  << ::strerror (errno) << std::endl;
+        ::_exit (10);
+      }
+
+      int argc = argv.size () - 1;
+      argv.push_back (0);
+
+      run_request (handler_, argc, &argv[1]);
+    }
+
+    static void
+    accept_request (int sd, children& kids, handler& handler_)
+    {
+      int cd = ::accept (sd, 0, 0);
+      if (cd < 0)
+        return;
+
+      if (!peer_is_user (cd))
+      {
+        if (rld::verbose ())
+          std::cout << "server: request from another user refused" << std::endl;
+        ::close (cd);
+        return;
+      }
+
+      uint32_t    size;
+      int         fds[3];
+      std::string request;
+
+      if (!receive_header (cd, size, fds))
+      {
+        ::close (cd);
+        return;
+      }
+
+      /*
+       * The request's strings are each terminated by a nul.
+       */
+      request.resize (size);
+      if ((size == 0) ||
+          !read_all (cd, &request[0], size) ||
+          (request[size - 1] != '\0'))
+      {
+        for (int f = 0; f < 3; ++f)
+          ::close (fds[f]);
+        ::close (cd);
+        return;
+      }
+
+      int notes[2];
+      if (::socketpair (AF_UNIX, SOCK_STREAM, 0, notes) < 0)
+      {
+        int32_t code = 10;
+        write_all (cd, &code, sizeof (code));
+        for (int f = 0; f < 3; ++f)
+          ::close (fds[f]);
+        ::close (cd);
+        return;
+      }
+
+      std::cout.flush ();
+      std::cerr.flush ();
+      ::fflush (0);
+
+      pid_t pid = ::fork ();
+
+      if (pid == 0)
+      {
+        /*
+         * The child only keeps the streams and its end of the notes.
+         */
+        ::close (sd);
+        ::close (sigchld_pipe[0]);
+        ::close (sigchld_pipe[1]);
+        ::close (cd);
+        ::close (notes[0]);
+        for (children::iterator ci = kids.begin (); ci != kids.end (); ++ci)
+        {
+          ::close ((*ci).second.client);
+          ::close ((*ci).second.notes);
+        }
+        run_child (handler_, fds, notes[1], request);
+      }
+
+      for (int f = 0; f < 3; ++f)
+        ::close (fds[f]);
+      ::close (notes[1]);
+
+      if (pid < 0)
+      {
+        int32_t code = 10;
+        write_all (cd, &code, sizeof (code));
+        ::close (notes[0]);
+        ::close (cd);
+        return;
+      }
+
+      if (rld::verbose () >= RLD_VERBOSE_INFO)
+        std::cout << "server: request " << pid << std::endl;
+
+      child c;
+      c.client = cd;
+      c.notes = notes[0];
+      c.killed = false;
+      kids[pid] = c;
+    }
+
+    void
+    serve (const std::string& path, handler& handler_)
+    {
+      struct sockaddr_un addr;
+      make_address (path, addr);
+
+      /*
+       * Replace a socket left by a server that has gone.
+       */
+      int live = connect_to (path);
+      if (live >= 0)
+      {
+        ::close (live);
+        throw rld::error ("Server already running", "server:socket: " + path);
+      }
+
+      struct stat sb;
+      if ((::lstat (path.c_str (), &sb) == 0) && S_ISSOCK (sb.st_mode))
+        ::unlink (path.c_str ());
+
+      int sd = ::socket (AF_UNIX, SOCK_STREAM, 0);
+      if (sd < 0)
+        throw rld::error (::strerror (errno), "server:socket: " + path);
+
+      /*
+       * Only the user can connect. A request can write any file the user can.
+       */
+      mode_t mask = ::umask (0077);
+      int    r = ::bind (sd, (struct sockaddr*) &addr, sizeof (addr));
+      ::umask (mask);
+
+      if ((r < 0) || (::listen (sd, 64) < 0))
+      {
+        int e = errno;
+        ::close (sd);
+        throw rld::error (::strerror (e), "server:bind: " + path);
+      }
+
+      if (::pipe (sigchld_pipe) < 0)
+      {
+        int e = errno;
+        ::close (sd);
+        throw rld::error (::strerror (e), "server:pipe");
+      }
+
+      ::fcntl (sigchld_pipe[0], F_SETFL, O_NONBLOCK);
+      ::fcntl (sigchld_pipe[1], F_SETFL, O_NONBLOCK);
+
+      ::signal (SIGPIPE, SIG_IGN);
+      ::signal (SIGCHLD, sigchld_handler);
+
+      if (rld::verbose ())
+        std::cout << "server: listening: " << path << std::endl;
+
+      children kids;
+
+      while (true)
+      {
+        std::vector < struct pollfd > fds;
+        std::vector < pid_t >         pids;
+        struct pollfd                 pfd;
+
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfd.fd = sd;
+        fds.push_back (pfd);
+        pfd.fd = sigchld_pipe[0];
+        fds.push_back (pfd);
+
+        /*
+         * A client sends nothing after the request so a readable client has
+         * gone.
+         */
+        for (children::iterator ci = kids.begin (); ci != kids.end (); ++ci)
+        {
+          if (!(*ci).second.killed)
+          {
+            pfd.fd = (*ci).second.client;
+            fds.push_back (pfd);
+            pids.push_back ((*ci).first);
+          }
+        }
+
+        if (::poll (&fds[0], fds.size (), -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          throw rld::error (::strerror (errno), "server:poll");
+        }
+
+        if (fds[1].revents)
+        {
+          char buf[64];
+          while (::read (sigchld_pipe[0], buf, sizeof (buf)) > 0)
+            ;
+        }
+
+        /*
+         * Always reap. A child can exit before the server has recorded it.
+         */
+        reap (kids, handler_);
+
+        for (size_t p = 0; p < pids.size (); ++p)
+        {
+          if (fds[p + 2].revents)
+          {
+            children::iterator ci = kids.find (pids[p]);
+            if (ci != kids.end ())
+            {
+              ::kill (pids[p], SIGTERM);
+              (*ci).second.killed = true;
+            }
+          }
+        }
+
+        if (fds[0].revents)
+          accept_request (sd, kids, handler_);
+      }
+    }
+
+    void
+    note (const std::string& text)
+    {
+      if (notes_fd >= 0)
+        write_all (notes_fd, text.c_str (), text.size ());
+    }
+
+    /**
+     * The children started by start. The value is the parent's end of the
+     * child's notes socket.
+     */
+    typedef std::map < pid_t, int > locals;
+    static locals local_children;
+
+    int
+    start (handler& handler_, int argc, char* argv[])
+    {
+      int notes[2];
+      if (::socketpair (AF_UNIX, SOCK_STREAM, 0, notes) < 0)
+        throw rld::error (::strerror (errno), "server:start:socketpair");
+
+      std::cout.flush ();
+      std::cerr.flush ();
+      ::fflush (0);
+
+      pid_t pid = ::fork ();
+
+      if (pid == 0)
+      {
+        ::close (notes[0]);
+        for (locals::iterator li = local_children.begin ();
+             li != local_children.end ();
+             ++li)
+          ::close ((*li).second);
+        local_children.clear ();
+        notes_fd = notes[1];
+        run_request (handler_, argc, argv);
+      }
+
+      ::close (notes[1]);
+
+      if (pid < 0)
+      {
+        int e = errno;
+        ::close (notes[0]);
+        throw rld::error (::strerror (e), "server:start:fork");
+      }
+
+      local_children[pid] = notes[0];
+
+      return pid;
+    }
+
+    int
+    wait (handler& handler_, int& exit_code_)
+    {
+      if (local_children.empty ())
+        throw rld::error ("No children", "server:wait");
+
+      while (true)
+      {
+        int   s = 0;
+        pid_t pid = ::waitpid (-1, &s, 0);
+        if (pid < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          throw rld::error (::strerror (errno), "server:wait");
+        }
+
+        locals::iterator li = local_children.find (pid);
+        if (li == local_children.end ())
+          continue;
+
+        std::string notes = read_notes ((*li).second);
+        ::close ((*li).second);
+        local_children.erase (li);
+
+        exit_code_ = exit_code (s);
+
+        pass_notes (handler_, notes);
+
+        return pid;
+      }
+    }
+
+    bool
+    client (const std::string& path,
+            int                argc,
+            char*              argv[],
+            int&               exit_code)
+    {
+      int sd = connect_to (path);
+      if (sd < 0)
+        return false;
+
+      if (!peer_is_user (sd))
+      {
+        ::close (sd);
+        throw rld::error ("Server is not run by the user", "client: " + path);
+      }
+
+      std::string request;
+
+      std::vector < char > cwd (1024);
+      while (::getcwd (&cwd[0], cwd.size ()) == 0)
+      {
+        if (errno != ERANGE)
+        {
+          ::close (sd);
+          throw rld::error (::strerror (errno), "client:getcwd");
+        }
+        cwd.resize (cwd.size () * 2);
+      }
+
+      request.append (&cwd[0]);
+      request += '\0';
+      for (int a = 0; a < argc; ++a)
+      {
+        request.append (argv[a]);
+        request += '\0';
+      }
+
+      uint32_t      size = request.size ();
+      char          header[sizeof (request_magic) + sizeof (uint32_t)];
+      struct iovec  iov;
+      struct msghdr msg;
+      char          control[CMSG_SPACE (sizeof (int) * 3)];
+      int           fds[3] = { 0, 1, 2 };
+
+      ::memcpy (header, request_magic, sizeof (request_magic));
+      ::memcpy (header + sizeof (request_magic), &size, sizeof (size));
+
+      ::memset (&msg, 0, sizeof (msg));
+      ::memset (control, 0, sizeof (control));
+      iov.iov_base = header;
+      iov.iov_len = sizeof (header);
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof (control);
+
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+      ::memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+      ssize_t w;
+      do
+        w = ::sendmsg (sd, &msg, MSG_NOSIGNAL);
+      while ((w < 0) && (errno == EINTR));
+
+      int32_t code;
+
+      if ((w < 0) ||
+          ((size_t) w < sizeof (header) &&
+           !write_all (sd, header + w, sizeof (header) - w)) ||
+          !write_all (sd, request.c_str (), request.size ()) ||
+          !read_all (sd, &code, sizeof (code)))
+      {
+        ::close (sd);
+        throw rld::error ("Server closed the connection", "client: " + path);
+      }
+
+      ::close (sd);
+
+      exit_code = code;
+      return true;
+    }
+#else
+    void
+    serve (const std::string& , handler& )
+    {
+      throw rld::error ("Not supported on this host", "server");
+    }
+
+    void
+    note (const std::string& )
+    {
+    }
+
+    int
+    start (handler& , int , char* [])
+    {
+      throw rld::error ("Not supported on this host", "server:start");
+    }
+
+    int
+    wait (handler& , int& )
+    {
+      throw rld::error ("Not supported on this host", "server:wait");
+    }
+
+    bool
+    client (const std::string& , int , char* [], int& )
+    {
+      return false;
+    }
+#endif
+  }
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker server and client.
+ *
+ * The server listens on a local socket for requests. A request is a command
+ * line, the client's working directory and the client's standard streams.
+ * Each request is run in a child process forked from the server so the
+ * request can use the state the server holds without changing it. The client
+ * is given the child's exit code once the child has exited.
+ *
+ */
+
+#if !defined (_RLD_SERVER_H_)
+#define _RLD_SERVER_H_
+
+#include <string>
+
+namespace rld
+{
+  namespace server
+  {
+    /**
+     * The handler runs the requests and keeps the server's state.
+     */
+    class handler
+    {
+    public:
+      /**
+       * Destruct the handler.
+       */
+      virtual ~handler ();
+
+      /**
+       * Run a request. This is called in the child process with the client's
+       * standard streams and working directory. The child exits with the
+       * returned code. Calling exit is also fine.
+       *
+       * @param argc The number of arguments.
+       * @param argv The arguments. The first is the program name.
+       * @return int The exit code.
+       */
+      virtual int request (int argc, char* argv[]) = 0;
+
+      /**
+       * Called in the server once a child has exited with the notes the child
+       * made. The notes are empty if the child made none.
+       */
+      virtual void noted (const std::string& notes) = 0;
+    };
+
+    /**
+     * The path of the socket the server listens on and the clients connect to
+     * if none is provided. This is the RTEMS_LD_SERVER environment variable
+     * if set else a name in the temporary directory unique to the user.
+     */
+    const std::string default_socket ();
+
+    /**
+     * Serve requests on the socket. This does not return unless there is an
+     * error. Requests from other users are refused.
+     *
+     * @param path The path of the socket. An existing socket is replaced.
+     * @param handler_ The handler of the requests.
+     */
+    void serve (const std::string& path, handler& handler_);
+
+    /**
+     * Make a note in a child for the handler in the server. The notes are
+     * passed to the handler's noted call once the child exits. Does nothing
+     * if not called in a child.
+     */
+    void note (const std::string& text);
+
+    /**
+     * Run the command line in a child of this process with this process's
+     * working directory and standard streams. The child runs the handler's
+     * request call and can make notes. The handler's state is shared with the
+     * child and is not changed by it.
+     *
+     * @param handler_ The handler of the request.
+     * @param argc The number of arguments.
+     * @param argv The arguments. The first is the program name.
+     * @return int The child's process id.
+     */
+    int start (handler& handler_, int argc, char* argv[]);
+
+    /**
+     * Wait for a child started by start to exit. The handler's noted call is
+     * made with the child's notes before returning.
+     *
+     * @param handler_ The handler to pass the child's notes to.
+     * @param exit_code The exit code of the child.
+     * @return int The process id of the child that exited.
+     */
+    int wait (handler& handler_, int& exit_code);
+
+    /**
+     * Ask the server to run the command line with this process's working
+     * directory and standard streams. Throws an error if the server is not
+     * run by the user.
+     *
+     * @param path The path of the server's socket.
+     * @param argc The number of arguments.
+     * @param argv The arguments. The first is the program name.
+     * @param exit_code The exit code of the request.
+     * @retval true The server ran the request.
+     * @retval false There is no server listening on the socket.
+     */
+    bool client (const std::string& path,
+                 int                argc,
+                 char*              argv[],
+                 int&               exit_code);
+  }
+}
+
+#endif
@@ -0,0 +1,670 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker size report.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <set>
+
+#include <rld.h>
+#include <rld-sizes.h>
+#include <rld-stats.h>
+
+namespace rld
+{
+  namespace sizes
+  {
+    /**
+     * The kinds of entry in the order they are output and their titles.
+     */
+    struct kind_title
+    {
+      const char* kind;
+      const char* title;
+    };
+
+    static const kind_title kinds[] =
+    {
+      { "total",         "Image" },
+      { "section",       "Sections" },
+      { "table",         "Tables" },
+      { "relocs",        "Relocation tables" },
+      { "padding",       "Alignment padding" },
+      { "archive",       "Archives" },
+      { "object",        "Object files" },
+      { "object-relocs", "Object file relocations" },
+      { "symbol",        "Symbols" },
+      { "chain",         "Archive member references" },
+      { 0,               0 }
+    };
+
+    order
+    parse_order (const std::string& name)
+    {
+      if (name == "size")
+        return by_size;
+      if (name == "name")
+        return by_name;
+      throw rld::error ("invalid size order: " + name, "sizes");
+    }
+
+    entry::entry (const std::string& kind,
+                  const std::string& section,
+                  const std::string& name,
+                  uint32_t           bytes,
+                  const std::string& detail)
+      : kind (kind),
+        section (section),
+        name (name),
+        bytes (bytes),
+        detail (detail)
+    {
+    }
+
+    const std::string
+    entry::key () const
+    {
+      return kind + '\t' + section + '\t' + name;
+    }
+
+    /**
+     * Order entries by the largest first then by name.
+     */
+    class size_compare
+    {
+    public:
+      bool operator () (const entry* lhs, const entry* rhs) const {
+        if (lhs->bytes != rhs->bytes)
+          return lhs->bytes > rhs->bytes;
+        return lhs->key () < rhs->key ();
+      }
+    };
+
+    /**
+     * Order entries by section then name.
+     */
+    class name_compare
+    {
+    public:
+      bool operator () (const entry* lhs, const entry* rhs) const {
+        return lhs->key () < rhs->key ();
+      }
+    };
+
+    typedef std::vector < const entry* > entry_pointers;
+
+    static void
+    sort_entries (entry_pointers& eps, order sort)
+    {
+      if (sort == by_size)
+        std::stable_sort (eps.begin (), eps.end (), size_compare ());
+      else
+        std::stable_sort (eps.begin (), eps.end (), name_compare ());
+    }
+
+    /**
+     * The placements keyed by the object file and section index.
+     */
+    typedef std::pair < const files::object*, int > placement_key;
+    typedef std::map < placement_key, const rap::placement* > placement_index;
+
+    /**
+     * The reference that pulled an object file into the link.
+     */
+    struct reference
+    {
+      const files::object* from;    //< The referencing object, 0 if a root.
+      std::string          symbol;  //< The symbol referenced.
+    };
+
+    typedef std::map < const files::object*, reference > references;
+
+    /**
+     * Find the shortest chain of references from an input object file or an
+     * undefined symbol to each object file. The edges are the unresolved
+     * symbols the resolver pointed at the object file that resolves them.
+     */
+    static void
+    find_references (files::cache&     cache,
+                     symbols::symtab&  undefined,
+                     references&       refs)
+    {
+      std::deque < const files::object* > queue;
+      files::object_list                  inputs;
+
+      cache.get_objects (inputs);
+
+      for (files::object_list::const_iterator oi = inputs.begin ();
+           oi != inputs.end ();
+           ++oi)
+      {
+        reference& ref = refs[*oi];
+        ref.from = 0;
+        queue.push_back (*oi);
+      }
+
+      for (symbols::symtab::const_iterator ui = undefined.begin ();
+           ui != undefined.end ();
+           ++ui)
+      {
+        const symbols::symbol& urs = *((*ui).second);
+        const files::object*   obj = urs.object ();
+        if (obj && (refs.find (obj) == refs.end ()))
+        {
+          reference& ref = refs[obj];
+          ref.from = 0;
+          ref.symbol = urs.name ();
+          queue.push_back (obj);
+        }
+      }
+
+      while (!queue.empty ())
+      {
+        files::object* obj = const_cast < files::object* > (queue.front ());
+        queue.pop_front ();
+
+        symbols::symtab& unresolved = obj->unresolved_symbols ();
+        for (symbols::symtab::const_iterator ui = unresolved.begin ();
+             ui != unresolved.end ();
+             ++ui)
+        {
+          const symbols::symbol& urs = *((*ui).second);
+          const files::object*   target = urs.object ();
+          if (target && (refs.find (target) == refs.end ()))
+          {
+            reference& ref = refs[target];
+            ref.from = obj;
+            ref.symbol = urs.name ();
+            queue.push_back (target);
+          }
+        }
+      }
+    }
+
+    static const std::string
+    chain_of (const files::object* obj, const references& refs)
+    {
+      std::string chain = obj->name ().full ();
+      while (true)
+      {
+        references::const_iterator ri = refs.find (obj);
+        if (ri == refs.end ())
+          return "(not referenced) -> " + chain;
+        const reference& ref = (*ri).second;
+        if (!ref.from)
+        {
+          if (!ref.symbol.empty ())
+            chain = "(undefined) -[" + ref.symbol + "]-> " + chain;
+          return chain;
+        }
+        chain = ref.from->name ().full () + " -[" + ref.symbol + "]-> " + chain;
+        obj = ref.from;
+      }
+    }
+
+    report::report ()
+    {
+    }
+
+    void
+    report::build (files::cache&             cache,
+                   const files::object_list& dependents,
+                   symbols::table&           symbols,
+                   symbols::symtab&          undefined,
+                   const rap::placements&    placed,
+                   const rap::costs&         cost)
+    {
+      stats::phase phase ("size-report");
+
+      ents.clear ();
+
+      /*
+       * The image and its sections and tables.
+       */
+      uint32_t total = (cost.header + cost.details + cost.strtab +
+                        cost.symtab + cost.symhash + cost.imports);
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+      {
+        if (s != rap::rap_bss)
+          total += cost.sections[s];
+        total += cost.relocs[s];
+      }
+
+      ents.push_back (entry ("total", "", "image", total,
+                             "before compression, .bss not included"));
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+        ents.push_back (entry ("section", rap::section_name (s), "",
+                               cost.sections[s]));
+
+      ents.push_back (entry ("table", "", "header", cost.header));
+      ents.push_back (entry ("table", "", "details", cost.details));
+      ents.push_back (entry ("table", "", "strtab", cost.strtab));
+      ents.push_back (entry ("table", "", "symtab", cost.symtab));
+      ents.push_back (entry ("table", "", "symhash", cost.symhash));
+      ents.push_back (entry ("table", "", "imports", cost.imports));
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+        ents.push_back (entry ("relocs", rap::section_name (s), "",
+                               cost.relocs[s]));
+
+      /*
+       * The padding is the gaps between the object file sections and after
+       * the last one.
+       */
+      uint32_t padding[rap::rap_secs];
+      uint32_t end[rap::rap_secs];
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+      {
+        padding[s] = 0;
+        end[s] = 0;
+      }
+
+      typedef std::map < std::string, uint32_t > name_bytes;
+
+      name_bytes      archives[rap::rap_secs];
+      name_bytes      objects[rap::rap_secs];
+      placement_index places;
+
+      std::map < const files::object*, uint32_t > object_totals;
+
+      for (rap::placements::const_iterator pi = placed.begin ();
+           pi != placed.end ();
+           ++pi)
+      {
+        const rap::placement& place = *pi;
+        int                   s = place.sec;
+
+        if (place.offset > end[s])
+          padding[s] += place.offset - end[s];
+        if ((place.offset + place.size) > end[s])
+          end[s] = place.offset + place.size;
+
+        objects[s][place.obj->name ().full ()] += place.size;
+        if (place.obj->get_archive ())
+          archives[s][place.obj->get_archive ()->name ().full ()] += place.size;
+
+        object_totals[place.obj] += place.size;
+
+        places[placement_key (place.obj, place.index)] = &place;
+      }
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+      {
+        if (cost.sections[s] > end[s])
+          padding[s] += cost.sections[s] - end[s];
+        ents.push_back (entry ("padding", rap::section_name (s), "",
+                               padding[s]));
+      }
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+        for (name_bytes::const_iterator ai = archives[s].begin ();
+             ai != archives[s].end ();
+             ++ai)
+          ents.push_back (entry ("archive", rap::section_name (s),
+                                 (*ai).first, (*ai).second));
+
+      for (int s = 0; s < rap::rap_secs; ++s)
+        for (name_bytes::const_iterator oi = objects[s].begin ();
+             oi != objects[s].end ();
+             ++oi)
+          ents.push_back (entry ("object", rap::section_name (s),
+                                 (*oi).first, (*oi).second));
+
+      for (rap::reloc_costs::const_iterator rci = cost.objects.begin ();
+           rci != cost.objects.end ();
+           ++rci)
+      {
+        const rap::reloc_cost& rcost = (*rci).second;
+        for (int s = 0; s < rap::rap_secs; ++s)
+          if (rcost.records[s])
+            ents.push_back (entry ("object-relocs", rap::section_name (s),
+                                   (*rci).first->name ().full (),
+                                   rcost.bytes[s],
+                                   rld::to_string (rcost.records[s]) +
+                                   " records"));
+      }
+
+      /*
+       * The exported symbols in the image.
+       */
+      const symbols::symtab* tables[2] = { &symbols.externals (),
+                                           &symbols.weaks () };
+      for (int t = 0; t < 2; ++t)
+      {
+        for (symbols::symtab::const_iterator si = tables[t]->begin ();
+             si != tables[t]->end ();
+             ++si)
+        {
+          const symbols::symbol& sym = *((*si).second);
+          placement_index::const_iterator pi =
+            places.find (placement_key (sym.object (), sym.section_index ()));
+          if (pi != places.end ())
+            ents.push_back (entry ("symbol",
+                                   rap::section_name ((*pi).second->sec),
+                                   sym.name (), sym.esym ().st_size,
+                                   sym.object ()->name ().full ()));
+        }
+      }
+
+      /*
+       * The archive members pulled into the link and why.
+       */
+      references refs;
+      find_references (cache, undefined, refs);
+
+      for (files::object_list::const_iterator di = dependents.begin ();
+           di != dependents.end ();
+           ++di)
+      {
+        files::object* obj = *di;
+        if (obj->get_archive ())
+          ents.push_back (entry ("chain", "", obj->name ().full (),
+                                 object_totals[obj], chain_of (obj, refs)));
+      }
+    }
+
+    static void
+    csv_split (const std::string& line, rld::strings& fields)
+    {
+      std::string field;
+      bool        quoted = false;
+
+      fields.clear ();
+
+      for (std::string::size_type c = 0; c < line.size (); ++c)
+      {
+        char ch = line[c];
+        if (quoted)
+        {
+          if (ch == '"')
+          {
+            if (((c + 1) < line.size ()) && (line[c + 1] == '"'))
+            {
+              field += '"';
+              ++c;
+            }
+            else
+              quoted = false;
+          }
+          else
+            field += ch;
+        }
+        else if (ch == '"')
+          quoted = true;
+        else if (ch == ',')
+        {
+          fields.push_back (field);
+          field.clear ();
+        }
+        else
+          field += ch;
+      }
+
+      fields.push_back (field);
+    }
+
+    void
+    report::load (const std::string& path)
+    {
+      std::ifstream in (path.c_str ());
+
+      if (!in.is_open ())
+        throw rld::error (::strerror (errno), "sizes:load:" + path);
+
+      ents.clear ();
+
+      std::string line;
+      int         number = 0;
+
+      while (std::getline (in, line))
+      {
+        ++number;
+
+        if (line.empty () || (line.compare (0, 5, "kind,") == 0))
+          continue;
+
+        rld::strings fields;
+        csv_split (line, fields);
+
+        if (fields.size () != 5)
+          throw rld::error ("invalid report line " + rld::to_string (number),
+                            "sizes:load:" + path);
+
+        ents.push_back (entry (fields[0], fields[1], fields[2],
+                               ::strtoul (fields[3].c_str (), 0, 10),
+                               fields[4]));
+      }
+    }
+
+    void
+    report::save (const std::string& path) const
+    {
+      std::ofstream out (path.c_str (),
+                         std::ios_base::out | std::ios_base::trunc);
+
+      if (!out.is_open ())
+        throw rld::error (::strerror (errno), "sizes:save:" + path);
+
+      out << "kind,section,name,bytes,detail" << '\n';
+
+      for (entries::const_iterator ei = ents.begin (); ei != ents.end (); ++ei)
+      {
+        const entry& e = *ei;
+        out << e.kind << ',' << csv_string (e.section) << ','
+            << csv_string (e.name) << ',' << e.bytes << ','
+            << csv_string (e.detail) << '\n';
+      }
+
+      out.close ();
+
+      if (out.fail ())
+        throw rld::error (::strerror (errno), "sizes:save:" + path);
+    }
+
+    uint32_t
+    report::total () const
+    {
+      for (entries::const_iterator ei = ents.begin (); ei != ents.end (); ++ei)
+        if ((*ei).kind == "total")
+          return (*ei).bytes;
+      return 0;
+    }
+
+    void
+    report::output (std::ostream& out, order sort) const
+    {
+      std::ios_base::fmtflags flags = out.flags ();
+      std::streamsize         precision = out.precision ();
+
+      double image = total ();
+
+      out << "Size report:" << '\n'
+          << std::fixed << std::setprecision (1);
+
+      for (int k = 0; kinds[k].kind; ++k)
+      {
+        entry_pointers eps;
+
+        for (entries::const_iterator ei = ents.begin ();
+             ei != ents.end ();
+             ++ei)
+          if ((*ei).kind == kinds[k].kind)
+            eps.push_back (&(*ei));
+
+        if (eps.empty ())
+          continue;
+
+        sort_entries (eps, sort);
+
+        out << ' ' << kinds[k].title << ':' << '\n';
+
+        for (entry_pointers::const_iterator ei = eps.begin ();
+             ei != eps.end ();
+             ++ei)
+        {
+          const entry& e = *(*ei);
+          out << "  " << std::setw (10) << e.bytes << ' '
+              << std::setw (5)
+              << (image > 0 ? (e.bytes * 100.0) / image : 0.0) << '%'
+              << ' ' << std::setw (7) << std::left << e.section << std::right;
+          if (!e.name.empty ())
+            out << ' ' << e.name;
+          if (!e.detail.empty ())
+            out << (e.kind == "chain" ? "\n             " : " ") << e.detail;
+          out << '\n';
+        }
+      }
+
+      out.flags (flags);
+      out.precision (precision);
+    }
+
+    /**
+     * A change between two reports.
+     */
+    struct change
+    {
+      const entry* e;        //< The entry's key.
+      uint32_t     before;   //< The bytes before.
+      uint32_t     after;    //< The bytes after.
+
+      long delta () const {
+        return (long) after - (long) before;
+      }
+    };
+
+    class change_compare
+    {
+    public:
+      change_compare (order sort)
+        : sort (sort) {
+      }
+
+      bool operator () (const change& lhs, const change& rhs) const {
+        if (sort == by_size)
+        {
+          long ld = ::labs (lhs.delta ());
+          long rd = ::labs (rhs.delta ());
+          if (ld != rd)
+            return ld > rd;
+        }
+        return lhs.e->key () < rhs.e->key ();
+      }
+
+    private:
+      order sort;
+    };
+
+    void
+    report::diff (std::ostream& out, const report& earlier, order sort) const
+    {
+      typedef std::map < std::string, const entry* > keyed;
+
+      keyed before;
+      keyed after;
+
+      for (entries::const_iterator ei = earlier.ents.begin ();
+           ei != earlier.ents.end ();
+           ++ei)
+        before[(*ei).key ()] = &(*ei);
+
+      for (entries::const_iterator ei = ents.begin (); ei != ents.end (); ++ei)
+        after[(*ei).key ()] = &(*ei);
+
+      std::vector < change > changes;
+
+      for (keyed::const_iterator ai = after.begin (); ai != after.end (); ++ai)
+      {
+        keyed::const_iterator bi = before.find ((*ai).first);
+        change c;
+        c.e = (*ai).second;
+        c.before = bi == before.end () ? 0 : (*bi).second->bytes;
+        c.after = c.e->bytes;
+        if ((bi == before.end ()) || (c.before != c.after))
+          changes.push_back (c);
+      }
+
+      for (keyed::const_iterator bi = before.begin (); bi != before.end (); ++bi)
+      {
+        if (after.find ((*bi).first) == after.end ())
+        {
+          change c;
+          c.e = (*bi).second;
+          c.before = c.e->bytes;
+          c.after = 0;
+          changes.push_back (c);
+        }
+      }
+
+      std::stable_sort (changes.begin (), changes.end (), change_compare (sort));
+
+      out << "Size differences: " << earlier.total () << " -> " << total ()
+          << " (" << std::showpos << (long) total () - (long) earlier.total ()
+          << std::noshowpos << ')' << '\n';
+
+      for (int k = 0; kinds[k].kind; ++k)
+      {
+        bool first = true;
+
+        for (std::vector < change >::const_iterator ci = changes.begin ();
+             ci != changes.end ();
+             ++ci)
+        {
+          const change& c = *ci;
+
+          if (c.e->kind != kinds[k].kind)
+            continue;
+
+          if (first)
+          {
+            out << ' ' << kinds[k].title << ':' << '\n';
+            first = false;
+          }
+
+          out << "  " << std::setw (10) << c.before
+              << ' ' << std::setw (10) << c.after
+              << ' ' << std::showpos << std::setw (10) << c.delta ()
+              << std::noshowpos
+              << ' ' << std::setw (7) << std::left << c.e->section << std::right;
+          if (!c.e->name.empty ())
+            out << ' ' << c.e->name;
+          out << '\n';
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker size report.
+ *
+ * The bytes of a RAP image are attributed to the RAP sections, the archives,
+ * object files and exported symbols in them, the padding lost to alignment
+ * and the string, symbol and relocation tables. The sizes are before the
+ * image is compressed and the .bss section is memory the target allocates.
+ * Each archive member in the image has the shortest chain of symbol
+ * references from an input object file that pulled it into the link.
+ *
+ * A report can be saved as CSV and compared with the report of a later link.
+ *
+ */
+
+#if !defined (_RLD_SIZES_H_)
+#define _RLD_SIZES_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <rld-files.h>
+#include <rld-rap.h>
+#include <rld-symbols.h>
+
+namespace rld
+{
+  namespace sizes
+  {
+    /**
+     * The order of the entries in a kind of entry.
+     */
+    enum order
+    {
+      by_size,  //< Largest first.
+      by_name   //< By section then name.
+    };
+
+    /**
+     * Return the order given its name. Throws an error if the name is not an
+     * order.
+     *
+     * @param name The name of the order.
+     */
+    order parse_order (const std::string& name);
+
+    /**
+     * An entry in the report. The kind, section and name are the entry's key
+     * when reports are compared.
+     */
+    struct entry
+    {
+      std::string kind;     //< The kind of entry.
+      std::string section;  //< The RAP section, can be empty.
+      std::string name;     //< The name, can be empty.
+      uint32_t    bytes;    //< The number of bytes.
+      std::string detail;   //< More detail, can be empty.
+
+      entry (const std::string& kind,
+             const std::string& section,
+             const std::string& name,
+             uint32_t           bytes,
+             const std::string& detail = "");
+
+      /**
+       * The entry's key.
+       */
+      const std::string key () const;
+    };
+
+    /**
+     * A container of entries.
+     */
+    typedef std::vector < entry > entries;
+
+    /**
+     * The size report.
+     */
+    class report
+    {
+    public:
+      report ();
+
+      /**
+       * Build the report of a link.
+       *
+       * @param cache The file cache of the link.
+       * @param dependents The object files the resolver pulled in.
+       * @param symbols The symbol table of the link.
+       * @param undefined The symbols the user asked to be resolved.
+       * @param placed The place of each object file section in the image.
+       * @param cost The bytes each part of the image takes.
+       */
+      void build (files::cache&             cache,
+                  const files::object_list& dependents,
+                  symbols::table&           symbols,
+                  symbols::symtab&          undefined,
+                  const rap::placements&    placed,
+                  const rap::costs&         cost);
+
+      /**
+       * Load a report saved as CSV.
+       *
+       * @param path The path of the report.
+       */
+      void load (const std::string& path);
+
+      /**
+       * Save the report as CSV.
+       *
+       * @param path The path of the report.
+       */
+      void save (const std::string& path) const;
+
+      /**
+       * Output the report as text.
+       *
+       * @param out The stream to output to.
+       * @param sort The order of the entries.
+       */
+      void output (std::ostream& out, order sort) const;
+
+      /**
+       * Output the entries that differ to an earlier report as text.
+       *
+       * @param out The stream to output to.
+       * @param earlier The report to compare with.
+       * @param sort The order of the entries.
+       */
+      void diff (std::ostream& out, const report& earlier, order sort) const;
+
+      /**
+       * The bytes in the image.
+       */
+      uint32_t total () const;
+
+    private:
+      entries ents;  //< The entries.
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker statistics.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#if defined (HAVE_GETRUSAGE) && defined (HAVE_SYS_RESOURCE_H)
+#define RLD_RUSAGE 1
+#include <sys/resource.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <rld.h>
+#include <rld-memory.h>
+#include <rld-stats.h>
+
+namespace rld
+{
+  namespace stats
+  {
+    /**
+     * The totals of a phase.
+     */
+    struct totals
+    {
+      unsigned long calls;  //< The number of times the phase ran.
+      double        wall;   //< The wall time in seconds.
+      double        cpu;    //< The CPU time in seconds.
+      memory::usage mem[memory::category_count]; //< The memory at the end.
+
+      totals ();
+    };
+
+    totals::totals ()
+      : calls (0),
+        wall (0),
+        cpu (0)
+    {
+    }
+
+    typedef std::map < std::string, totals > phase_totals;
+
+    /**
+     * The counter names in the order of the counters.
+     */
+    static const char* counter_names[counter_count] =
+    {
+      "bytes-read",
+      "bytes-written",
+      "bytes-copied",
+      "bytes-mapped",
+      "syscalls",
+      "files-opened",
+      "archives-opened",
+      "objects-opened",
+      "symbols",
+      "relocations",
+      "compress-raw",
+      "compress-out"
+    };
+
+    static bool                       on;
+    static bool                       as_json;
+    static double                     started;
+    static double                     started_cpu;
+    static uint64_t                   counters[counter_count];
+    static phase_totals               phases;
+    static std::vector < std::string > phase_order;
+
+    /**
+     * The jobs can record from more than one thread.
+     */
+#ifdef HAVE_PTHREAD_H
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+    struct locker
+    {
+      locker ()
+      {
+#ifdef HAVE_PTHREAD_H
+        ::pthread_mutex_lock (&lock);
+#endif
+      }
+
+      ~locker ()
+      {
+#ifdef HAVE_PTHREAD_H
+        ::pthread_mutex_unlock (&lock);
+#endif
+      }
+    };
+
+    static double
+    wall_now ()
+    {
+#ifdef CLOCK_MONOTONIC
+      struct timespec ts;
+      if (::clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec + (ts.tv_nsec / 1e9);
+#endif
+#ifdef HAVE_SYS_TIME_H
+      struct timeval tv;
+      ::gettimeofday (&tv, 0);
+      return tv.tv_sec + (tv.tv_usec / 1e6);
+#else
+      return ::time (0);
+#endif
+    }
+
+    /**
+     * The CPU time of the process.
+     */
+    static double
+    process_cpu_now ()
+    {
+#if RLD_RUSAGE
+      struct rusage ru;
+      if (::getrusage (RUSAGE_SELF, &ru) == 0)
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+                ((ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6));
+#endif
+      return (double) ::clock () / CLOCKS_PER_SEC;
+    }
+
+    /**
+     * The CPU time of the calling thread if the host can provide it else the
+     * process's.
+     */
+    static double
+    cpu_now ()
+    {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+      struct timespec ts;
+      if (::clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec + (ts.tv_nsec / 1e9);
+#endif
+      return process_cpu_now ();
+    }
+
+    /**
+     * The peak resident set size in KiB, -1 if not known.
+     */
+    static long
+    peak_rss ()
+    {
+#if RLD_RUSAGE
+      struct rusage ru;
+      if (::getrusage (RUSAGE_SELF, &ru) == 0)
+      {
+#if __APPLE__
+        return ru.ru_maxrss / 1024;
+#else
+        return ru.ru_maxrss;
+#endif
+      }
+#endif
+      return -1;
+    }
+
+    double
+    now ()
+    {
+      return wall_now ();
+    }
+
+    void
+    enable (bool json)
+    {
+      if (!on)
+      {
+        started = wall_now ();
+        started_cpu = process_cpu_now ();
+        on = true;
+      }
+      as_json = json;
+    }
+
+    void
+    parse (const char* options)
+    {
+      bool json = false;
+
+      if (options)
+      {
+        rld::strings opts;
+        rld::split (options, opts, ',');
+        for (rld::strings::const_iterator oi = opts.begin ();
+             oi != opts.end ();
+             ++oi)
+        {
+          if (*oi == "json")
+            json = true;
+          else if (*oi == "memory")
+            memory::enable ();
+          else
+            throw rld::error ("invalid stats option: " + *oi, "options");
+        }
+      }
+
+      enable (json);
+    }
+
+    bool
+    enabled ()
+    {
+      return on;
+    }
+
+    void
+    count (counter c, uint64_t amount)
+    {
+      if (on)
+      {
+        locker l;
+        counters[c] += amount;
+      }
+    }
+
+    phase::phase (const char* name_)
+      : name (0),
+        wall (0),
+        cpu (0)
+    {
+      if (on)
+      {
+        name = name_;
+        wall = wall_now ();
+        cpu = cpu_now ();
+      }
+    }
+
+    phase::~phase ()
+    {
+      if (name)
+      {
+        double        wall_end = wall_now ();
+        double        cpu_end = cpu_now ();
+        memory::usage mem[memory::category_count];
+
+        if (memory::enabled ())
+          memory::get (mem);
+
+        locker l;
+
+        phase_totals::iterator pi = phases.find (name);
+        if (pi == phases.end ())
+        {
+          pi = phases.insert (phase_totals::value_type (name, totals ())).first;
+          phase_order.push_back (name);
+        }
+
+        totals& t = (*pi).second;
+
+        ++t.calls;
+        t.wall += wall_end - wall;
+        t.cpu += cpu_end - cpu;
+
+        for (int c = 0; c < memory::category_count; ++c)
+          t.mem[c] = mem[c];
+      }
+    }
+
+    void
+    reset ()
+    {
+      locker l;
+      for (int c = 0; c < counter_count; ++c)
+        counters[c] = 0;
+      phases.clear ();
+      phase_order.clear ();
+      started = wall_now ();
+      started_cpu = process_cpu_now ();
+    }
+
+    uint64_t
+    value (counter c)
+    {
+      locker l;
+      return counters[c];
+    }
+
+    bool
+    get_phase (const std::string& name,
+               unsigned long&     calls,
+               double&            wall,
+               double&            cpu)
+    {
+      locker l;
+      phase_totals::const_iterator pi = phases.find (name);
+      if (pi == phases.end ())
+      {
+        calls = 0;
+        wall = 0;
+        cpu = 0;
+        return false;
+      }
+      const totals& t = (*pi).second;
+      calls = t.calls;
+      wall = t.wall;
+      cpu = t.cpu;
+      return true;
+    }
+
+    void
+    report (std::ostream& out, const std::string& tool)
+    {
+      if (!on)
+        return;
+
+      locker l;
+
+      double        wall = wall_now () - started;
+      double        cpu = process_cpu_now () - started_cpu;
+      long          rss = peak_rss ();
+      memory::usage mem[memory::category_count];
+      memory::usage arenas;
+
+      if (memory::enabled ())
+      {
+        memory::get (mem);
+        memory::get_arenas (arenas);
+      }
+
+      std::ios_base::fmtflags flags = out.flags ();
+      std::streamsize         precision = out.precision ();
+
+      out << std::fixed << std::setprecision (6);
+
+      if (as_json)
+      {
+        out << '{' << std::endl
+            << "  \"tool\": " << json_string (tool) << ',' << std::endl
+            << "  \"wall\": " << wall << ',' << std::endl
+            << "  \"cpu\": " << cpu << ',' << std::endl
+            << "  \"peak-rss-kib\": " << rss << ',' << std::endl
+            << "  \"phases\": [";
+
+        for (size_t p = 0; p < phase_order.size (); ++p)
+        {
+          const totals& t = phases[phase_order[p]];
+          out << (p ? "," : "") << std::endl
+              << "    { \"name\": " << json_string (phase_order[p])
+              << ", \"calls\": " << t.calls
+              << ", \"wall\": " << t.wall
+              << ", \"cpu\": " << t.cpu;
+          if (memory::enabled ())
+          {
+            out << ", \"memory\": {";
+            for (int c = 0; c < memory::category_count; ++c)
+              out << (c ? "," : "") << ' '
+                  << json_string (memory::name ((memory::category) c))
+                  << ": { \"bytes\": " << t.mem[c].bytes
+                  << ", \"allocs\": " << t.mem[c].allocs << " }";
+            out << " }";
+          }
+          out << " }";
+        }
+
+        out << std::endl
+            << "  ]," << std::endl
+            << "  \"counters\": {";
+
+        for (int c = 0; c < counter_count; ++c)
+          out << (c ? "," : "") << std::endl
+              << "    " << json_string (counter_names[c]) << ": "
+              << counters[c];
+
+        out << std::endl
+            << "  }";
+
+        if (memory::enabled ())
+        {
+          out << ',' << std::endl
+              << "  \"memory\": {";
+          for (int c = 0; c < memory::category_count; ++c)
+            out << (c ? "," : "") << std::endl
+                << "    " << json_string (memory::name ((memory::category) c))
+                << ": { \"bytes\": " << mem[c].bytes
+                << ", \"peak\": " << mem[c].peak
+                << ", \"allocs\": " << mem[c].allocs << " }";
+          out << ',' << std::endl
+              << "    \"arena\": { \"bytes\": " << arenas.bytes
+              << ", \"peak\": " << arenas.peak
+              << ", \"allocs\": " << arenas.allocs << " }" << std::endl
+              << "  }";
+        }
+
+        out << std::endl
+            << '}' << std::endl;
+      }
+      else
+      {
+        out << tool << " statistics:" << std::endl
+            << " Phase                    Calls    Wall (s)     CPU (s)" << std::endl;
+
+        for (size_t p = 0; p < phase_order.size (); ++p)
+        {
+          const totals& t = phases[phase_order[p]];
+          out << "  " << std::setw (20) << std::left << phase_order[p]
+              << std::right
+              << std::setw (9) << t.calls
+              << std::setw (12) << t.wall
+              << std::setw (12) << t.cpu
+              << std::endl;
+        }
+
+        out << "  " << std::setw (29) << std::left << "total" << std::right
+            << std::setw (12) << wall
+            << std::setw (12) << cpu
+            << std::endl
+            << " Counters:" << std::endl;
+
+        for (int c = 0; c < counter_count; ++c)
+          out << "  " << std::setw (20) << std::left << counter_names[c]
+              << std::right << ": " << counters[c] << std::endl;
+
+        if (counters[compress_raw])
+          out << "  " << std::setw (20) << std::left << "compression"
+              << std::right << ": " << std::setprecision (1)
+              << (counters[compress_out] * 100.0) / counters[compress_raw]
+              << '%' << std::setprecision (6) << std::endl;
+
+        out << "  " << std::setw (20) << std::left << "peak-rss"
+            << std::right << ": ";
+        if (rss < 0)
+          out << "not known";
+        else
+          out << rss << " KiB";
+        out << std::endl;
+
+        if (memory::enabled ())
+        {
+          out << " Memory at the end of each phase:" << std::endl
+              << "  Phase                Category                 Bytes"
+              << "     Allocs" << std::endl;
+
+          for (size_t p = 0; p < phase_order.size (); ++p)
+          {
+            const totals& t = phases[phase_order[p]];
+            bool          first = true;
+            for (int c = 0; c < memory::category_count; ++c)
+            {
+              if (t.mem[c].bytes || t.mem[c].allocs)
+              {
+                out << "  " << std::setw (20) << std::left
+                    << (first ? phase_order[p] : "") << ' '
+                    << std::setw (16) << memory::name ((memory::category) c)
+                    << std::right
+                    << std::setw (14) << t.mem[c].bytes
+                    << std::setw (11) << t.mem[c].allocs << std::endl;
+                first = false;
+              }
+            }
+          }
+
+          out << " Memory:" << std::endl
+              << "  Category                 Bytes          Peak     Allocs"
+              << std::endl;
+
+          for (int c = 0; c < memory::category_count; ++c)
+            out << "  " << std::setw (16) << std::left
+                << memory::name ((memory::category) c) << std::right
+                << std::setw (14) << mem[c].bytes
+                << std::setw (14) << mem[c].peak
+                << std::setw (11) << mem[c].allocs << std::endl;
+
+          /*
+           * The records freed back to an arena are not in the categories, the
+           * arena holds them until it is destroyed.
+           */
+          out << "  " << std::setw (16) << std::left << "arena" << std::right
+              << std::setw (14) << arenas.bytes
+              << std::setw (14) << arenas.peak
+              << std::setw (11) << arenas.allocs << std::endl;
+        }
+      }
+
+      out.flags (flags);
+      out.precision (precision);
+    }
+  }
+}
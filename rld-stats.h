@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker statistics.
+ *
+ * The time spent in each phase of a run and counts of the work done. Nothing
+ * is recorded unless the statistics are enabled.
+ *
+ */
+
+#if !defined (_RLD_STATS_H_)
+#define _RLD_STATS_H_
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+namespace rld
+{
+  namespace stats
+  {
+    /**
+     * The counters.
+     */
+    enum counter
+    {
+      bytes_read,       //< Bytes read from files.
+      bytes_written,    //< Bytes written to files.
+      bytes_copied,     //< Bytes copied between files by the host.
+      bytes_mapped,     //< Bytes of ELF files and archives libelf maps.
+      syscalls,         //< Calls to open, close, read, write, seek and copy
+                        //  files.
+      files_opened,     //< Files opened.
+      archives_opened,  //< Archives libelf has opened.
+      objects_opened,   //< ELF object files libelf has opened.
+      symbols,          //< ELF symbols loaded.
+      relocations,      //< ELF relocation records loaded.
+      compress_raw,     //< Bytes given to the compressor.
+      compress_out,     //< Bytes the compressor wrote.
+      counter_count     //< The number of counters.
+    };
+
+    /**
+     * Enable the statistics. The run's time starts when enabled.
+     *
+     * @param json Report as JSON rather than text.
+     */
+    void enable (bool json = false);
+
+    /**
+     * Enable the statistics given the stats option's argument. The argument
+     * is a comma separated list of 'json' to report as JSON and 'memory' to
+     * account for the memory each category of data uses. Throws an error if
+     * an option is not known.
+     *
+     * @param options The option's argument, can be 0.
+     */
+    void parse (const char* options);
+
+    /**
+     * Are the statistics enabled ?
+     */
+    bool enabled ();
+
+    /**
+     * Add to a counter.
+     *
+     * @param c The counter.
+     * @param amount The amount to add.
+     */
+    void count (counter c, uint64_t amount = 1);
+
+    /**
+     * The wall time in seconds. The time has no fixed start and is only
+     * useful to time an interval.
+     */
+    double now ();
+
+    /**
+     * Time a phase. The wall and CPU time from construction to destruction
+     * are added to the phase's totals. A phase can contain other phases and
+     * its time includes theirs. A phase run by jobs adds the time of each
+     * job. If memory is being accounted for the memory in use when the phase
+     * last ended is kept.
+     */
+    class phase
+    {
+    public:
+      /**
+       * Start timing the phase.
+       *
+       * @param name The phase's name. It must be a string constant.
+       */
+      phase (const char* name);
+
+      /**
+       * Stop timing the phase and add the time to its totals.
+       */
+      ~phase ();
+
+    private:
+      const char* name;   //< The name, 0 if not enabled.
+      double      wall;   //< The wall time at the start.
+      double      cpu;    //< The CPU time at the start.
+    };
+
+    /**
+     * Clear the counters and phase totals and restart the run's time.
+     */
+    void reset ();
+
+    /**
+     * Get the value of a counter.
+     *
+     * @param c The counter.
+     * @return uint64_t The counter's value.
+     */
+    uint64_t value (counter c);
+
+    /**
+     * Get the totals of a phase.
+     *
+     * @param name The phase's name.
+     * @param calls The number of times the phase ran.
+     * @param wall The wall time in seconds.
+     * @param cpu The CPU time in seconds.
+     * @retval true The phase has run.
+     * @retval false The phase has not run.
+     */
+    bool get_phase (const std::string& name,
+                    unsigned long&     calls,
+                    double&            wall,
+                    double&            cpu);
+
+    /**
+     * Output the statistics if enabled.
+     *
+     * @param out The stream to output to.
+     * @param tool The name of the tool.
+     */
+    void report (std::ostream& out, const std::string& tool);
+  }
+}
+
+#endif
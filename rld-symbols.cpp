@@ -364,23 +364,23 @@ namespace rld
     void
     output (std::ostream& out, const table& symbols)
     {
-      out << "Externals:" << std::endl;
+      out << "Externals:" << '\n';
       output (out, symbols.externals ());
-      out << "Weaks:" << std::endl;
+      out << "Weaks:" << '\n';
       output (out, symbols.weaks ());
     }
 
     void
     output (std::ostream& out, const symtab& symbols)
     {
-      std::cout << " No.  Scope      Type        Address    Size    Name" << std::endl;
+      out << " No.  Scope      Type        Address    Size    Name" << '\n';
       int index = 0;
       for (symtab::const_iterator si = symbols.begin ();
            si != symbols.end ();
            ++si)
       {
         const symbol& sym = *((*si).second);
-        out << std::setw (5) << index << ' ' << sym << std::endl;
+        out << std::setw (5) << index << ' ' << sym << '\n';
         ++index;
       }
     }
@@ -31,6 +31,7 @@
 #include <string>
 
 #include <rld-elf-types.h>
+#include <rld-memory.h>
 
 namespace rld
 {
@@ -176,7 +177,9 @@ namespace rld
     /**
      * Container of symbols. A bucket of symbols.
      */
-    typedef std::list < symbol > bucket;
+    typedef std::list < symbol,
+                        memory::allocator < symbol,
+                                            memory::elf_symbols > > bucket;
 
     /**
      * References to symbols. Should always point to symbols held in a bucket.
@@ -187,7 +190,10 @@ namespace rld
      * A symbols table is a map container of symbols. Should always point to
      * symbols held in a bucket.
      */
-    typedef std::map < std::string, symbol* > symtab;
+    typedef std::map < std::string, symbol*, std::less < std::string >,
+                       memory::allocator < std::pair < const std::string,
+                                                       symbol* >,
+                                           memory::symbol_tables > > symtab;
 
     /**
      * A symbols contains a symbol table of externals and weak symbols.
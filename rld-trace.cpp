@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker trace.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <rld.h>
+#include <rld-trace.h>
+
+namespace rld
+{
+  namespace trace
+  {
+    /**
+     * The number of spans a thread keeps.
+     */
+    static const size_t ring_size = 16 * 1024;
+
+    /**
+     * A recorded span.
+     */
+    struct event
+    {
+      const char* name;                       //< The name.
+      const char* category;                   //< The category.
+      uint64_t    start;                      //< The start in nanoseconds.
+      uint64_t    duration;                   //< The duration in nanoseconds.
+      char        detail[span::detail_size];  //< The detail.
+    };
+
+    /**
+     * The spans a thread has recorded. Only the thread records into its ring
+     * and the rings are only read once tracing is closed.
+     */
+    struct ring
+    {
+      int                  tid;       //< The thread's trace id.
+      std::vector < event > events;   //< The ring of events.
+      uint64_t             recorded;  //< The number of events recorded.
+
+      ring (int tid);
+
+      void record (const event& e);
+    };
+
+    ring::ring (int tid)
+      : tid (tid),
+        events (ring_size),
+        recorded (0)
+    {
+    }
+
+    void
+    ring::record (const event& e)
+    {
+      events[recorded % ring_size] = e;
+      ++recorded;
+    }
+
+    typedef std::vector < ring* > rings;
+
+    static bool          on;
+    static uint64_t      started;
+    static std::ofstream out;
+    static std::string   out_path;
+    static rings         threads;
+
+#ifdef HAVE_PTHREAD_H
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_key_t   key;
+    static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
+
+    static void
+    make_key ()
+    {
+      ::pthread_key_create (&key, 0);
+    }
+#endif
+
+    static uint64_t
+    now ()
+    {
+#ifdef CLOCK_MONOTONIC
+      struct timespec ts;
+      if (::clock_gettime (CLOCK_MONOTONIC, &ts) == 0)
+        return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+#endif
+#ifdef HAVE_SYS_TIME_H
+      struct timeval tv;
+      ::gettimeofday (&tv, 0);
+      return (tv.tv_sec * 1000000000ULL) + (tv.tv_usec * 1000ULL);
+#else
+      return ::time (0) * 1000000000ULL;
+#endif
+    }
+
+    /**
+     * The ring of the calling thread. A thread's first span creates its ring
+     * and that is the only time a lock is taken.
+     */
+    static ring&
+    this_ring ()
+    {
+#ifdef HAVE_PTHREAD_H
+      ring* r = static_cast < ring* > (::pthread_getspecific (key));
+      if (!r)
+      {
+        ::pthread_mutex_lock (&lock);
+        r = new ring (threads.size () + 1);
+        threads.push_back (r);
+        ::pthread_mutex_unlock (&lock);
+        ::pthread_setspecific (key, r);
+      }
+      return *r;
+#else
+      if (threads.empty ())
+        threads.push_back (new ring (1));
+      return *threads[0];
+#endif
+    }
+
+    void
+    open (const std::string& path)
+    {
+      if (on)
+        throw rld::error ("Trace already open", "trace:" + path);
+
+      out.open (path.c_str (), std::ios_base::out | std::ios_base::trunc);
+      if (!out.is_open ())
+        throw rld::error (::strerror (errno), "trace:open:" + path);
+
+      out_path = path;
+
+#ifdef HAVE_PTHREAD_H
+      ::pthread_once (&key_once, make_key);
+#endif
+
+      /*
+       * The thread opening the trace is the first thread.
+       */
+      this_ring ();
+
+      started = now ();
+      on = true;
+    }
+
+    bool
+    enabled ()
+    {
+      return on;
+    }
+
+    static void
+    write_event (const event& e, int tid, int pid)
+    {
+      out << "{\"name\":" << json_string (e.name)
+          << ",\"cat\":" << json_string (e.category)
+          << ",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << tid
+          << ",\"ts\":" << ((e.start - started) / 1000.0)
+          << ",\"dur\":" << (e.duration / 1000.0);
+      if (e.detail[0])
+        out << ",\"args\":{\"detail\":" << json_string (e.detail) << '}';
+      out << '}';
+    }
+
+    void
+    close ()
+    {
+      if (!on)
+        return;
+
+      on = false;
+
+      int      pid = ::getpid ();
+      uint64_t dropped = 0;
+      bool     first = true;
+
+      out << std::fixed << std::setprecision (3)
+          << "{\"traceEvents\":[" << std::endl;
+
+      for (rings::iterator ri = threads.begin (); ri != threads.end (); ++ri)
+      {
+        ring&  r = *(*ri);
+        size_t count = r.recorded;
+        size_t oldest = 0;
+
+        if (r.recorded > ring_size)
+        {
+          count = ring_size;
+          oldest = r.recorded % ring_size;
+          dropped += r.recorded - ring_size;
+        }
+
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"tid\":" << r.tid
+            << ",\"args\":{\"name\":\""
+            << (r.tid == 1 ? "main" : "worker") << "\"}}";
+        first = false;
+
+        for (size_t e = 0; e < count; ++e)
+        {
+          out << ",\n";
+          write_event (r.events[(oldest + e) % ring_size], r.tid, pid);
+        }
+
+        delete *ri;
+      }
+
+      threads.clear ();
+
+      out << std::endl
+          << "],\"displayTimeUnit\":\"ms\""
+          << ",\"otherData\":{\"dropped\":" << dropped << "}}" << std::endl;
+
+      out.close ();
+
+      if (out.fail ())
+        std::cerr << "error: trace:write:" << out_path << ": "
+                  << ::strerror (errno) << std::endl;
+
+#ifdef HAVE_PTHREAD_H
+      ::pthread_setspecific (key, 0);
+#endif
+    }
+
+    span::span (const char* name_, const char* category_)
+      : name (0),
+        category (category_),
+        start (0)
+    {
+      if (on)
+      {
+        name = name_;
+        detail[0] = '\0';
+        start = now ();
+      }
+    }
+
+    span::span (const char*        name_,
+                const char*        category_,
+                const std::string& detail_)
+      : name (0),
+        category (category_),
+        start (0)
+    {
+      if (on)
+      {
+        size_t length = detail_.size ();
+        size_t offset = 0;
+        if (length >= detail_size)
+          offset = length - (detail_size - 1);
+        length = detail_.copy (detail, detail_size - 1, offset);
+        detail[length] = '\0';
+        name = name_;
+        start = now ();
+      }
+    }
+
+    span::~span ()
+    {
+      if (name && on)
+      {
+        event e;
+        e.name = name;
+        e.category = category;
+        e.start = start;
+        e.duration = now () - start;
+        ::strcpy (e.detail, detail);
+        this_ring ().record (e);
+      }
+    }
+  }
+}
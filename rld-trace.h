@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems-ld
+ *
+ * @brief RTEMS Linker trace.
+ *
+ * Spans of time spent on each object file, library and section are recorded
+ * and written as a Chrome trace event file that can be viewed with
+ * chrome://tracing or Perfetto. Each thread records into a ring buffer of its
+ * own so recording does not lock. The oldest spans of a thread are dropped
+ * if its ring buffer fills.
+ *
+ */
+
+#if !defined (_RLD_TRACE_H_)
+#define _RLD_TRACE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace rld
+{
+  namespace trace
+  {
+    /**
+     * Open the trace file and start tracing. Nothing is written to the file
+     * until it is closed.
+     *
+     * @param path The path of the trace file.
+     */
+    void open (const std::string& path);
+
+    /**
+     * Write the spans to the trace file and close it. Does nothing if tracing
+     * has not been started.
+     */
+    void close ();
+
+    /**
+     * Is tracing on ?
+     */
+    bool enabled ();
+
+    /**
+     * A span of time. The span is recorded when it is destructed.
+     */
+    class span
+    {
+    public:
+      /**
+       * The size of the detail kept with a span. Longer details keep the end.
+       */
+      static const size_t detail_size = 56;
+
+      /**
+       * Start a span.
+       *
+       * @param name The span's name. It must be a string constant.
+       * @param category The span's category. It must be a string constant.
+       */
+      span (const char* name, const char* category);
+
+      /**
+       * Start a span with a detail, for example the file it is for.
+       *
+       * @param name The span's name. It must be a string constant.
+       * @param category The span's category. It must be a string constant.
+       * @param detail The detail. It is copied.
+       */
+      span (const char* name, const char* category, const std::string& detail);
+
+      /**
+       * End the span and record it.
+       */
+      ~span ();
+
+    private:
+      const char* name;                 //< The name, 0 if not tracing.
+      const char* category;             //< The category.
+      uint64_t    start;                //< The start time in nanoseconds.
+      char        detail[detail_size];  //< The detail, can be empty.
+    };
+  }
+}
+
+#endif
@@ -110,22 +110,44 @@ namespace rld
     }
   }
 
-  void
-  map (rld::files::cache& cache, rld::symbols::table& symbols)
+  const std::string
+  json_string (const std::string& str)
+  {
+    static const char hex[] = "0123456789abcdef";
+    std::string       js = "\"";
+    for (std::string::const_iterator si = str.begin (); si != str.end (); ++si)
+    {
+      unsigned char c = *si;
+      if ((c == '"') || (c == '\\'))
+      {
+        js += '\\';
+        js += c;
+      }
+      else if (c < ' ')
+      {
+        js += "\\u00";
+        js += hex[c >> 4];
+        js += hex[c & 0xf];
+      }
+      else
+        js += c;
+    }
+    return js + '"';
+  }
+
+  const std::string
+  csv_string (const std::string& str)
   {
-    std::cout << "Archive files    : " << cache.archive_count () << std::endl;
-    std::cout << "Object files     : " << cache.object_count () << std::endl;
-    std::cout << "Exported symbols : " << symbols.size () << std::endl;
-
-    std::cout << "Archives:" << std::endl;
-    cache.output_archive_files (std::cout);
-    std::cout << "Objects:" << std::endl;
-    cache.output_object_files (std::cout);
-
-    std::cout << "Exported symbols:" << std::endl;
-    rld::symbols::output (std::cout, symbols);
-    std::cout << "Unresolved symbols:" << std::endl;
-    cache.output_unresolved_symbols (std::cout);
+    if (str.find_first_of (",\"\r\n") == std::string::npos)
+      return str;
+    std::string cs = "\"";
+    for (std::string::const_iterator si = str.begin (); si != str.end (); ++si)
+    {
+      if (*si == '"')
+        cs += '"';
+      cs += *si;
+    }
+    return cs + '"';
   }
 
   void
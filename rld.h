@@ -142,9 +142,16 @@ namespace rld
   void split (const std::string& str, strings& strs, char separator);
 
   /**
-   * Map of the symbol table.
+   * Quote a string as a JSON string. Quotes and backslashes are escaped and
+   * control characters are written as \u00XX escapes.
    */
-  void map (rld::files::cache& cache, rld::symbols::table& symbols);
+  const std::string json_string (const std::string& str);
+
+  /**
+   * Quote a CSV field. The field is quoted if it holds a comma, a quote or a
+   * line end and the quotes in it are doubled.
+   */
+  const std::string csv_string (const std::string& str);
 
   /**
    * Warn is externals in referenced object files are not used.
@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems_rld
+ *
+ * @brief RTEMS Compressor Benchmark times the RAP compressor compressing and
+ *        decompressing inputs with a range of block sizes and FastLZ levels.
+ *
+ * A RAP file given as an input is decompressed and its payload, the sections
+ * and tables the linker compresses, is the input. Any other file is used as
+ * it is.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cxxabi.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <rld.h>
+#include <rld-compression.h>
+#include <rld-stats.h>
+
+/**
+ * RTEMS Compressor Benchmark options.
+ */
+static struct option rld_opts[] = {
+  { "help",        no_argument,            NULL,           'h' },
+  { "version",     no_argument,            NULL,           'V' },
+  { "verbose",     no_argument,            NULL,           'v' },
+  { "blocks",      required_argument,      NULL,           'b' },
+  { "levels",      required_argument,      NULL,           'L' },
+  { "iterations",  required_argument,      NULL,           'i' },
+  { "json",        no_argument,            NULL,           'j' },
+  { "output",      required_argument,      NULL,           'o' },
+  { NULL,          0,                      NULL,            0 }
+};
+
+void
+usage (int exit_code)
+{
+  std::cout << "rtems-compress-bench [options] [files]" << std::endl
+            << "Options and arguments:" << std::endl
+            << " -h        : help (also --help)" << std::endl
+            << " -V        : print the version number and exit (also --version)" << std::endl
+            << " -v        : verbose, can supply multiple times to increase" << std::endl
+            << "             verbosity (also --verbose)" << std::endl
+            << " -b sizes  : comma separated block sizes, at most 63549 so a block" << std::endl
+            << "             that does not compress fits the 16 bit block header," << std::endl
+            << "             default 1024,2048,4096,8192,16384,32768,61440" << std::endl
+            << "             (also --blocks)" << std::endl
+            << " -L levels : comma separated FastLZ levels, 0 for automatic, default" << std::endl
+            << "             0,1,2 (also --levels)" << std::endl
+            << " -i count  : number of times to time each case, the fastest is" << std::endl
+            << "             reported, default 5 (also --iterations)" << std::endl
+            << " -j        : output JSON (also --json)" << std::endl
+            << " -o file   : write the results to file, default stdout" << std::endl
+            << "             (also --output)" << std::endl
+            << "The files are RAP files, their payload is used, or any other" << std::endl
+            << "file. The default is this program." << std::endl;
+  ::exit (exit_code);
+}
+
+/**
+ * An input to the benchmark.
+ */
+struct input
+{
+  std::string             name;   //< The input's name.
+  std::vector < uint8_t > data;   //< The uncompressed data.
+};
+
+typedef std::vector < input > inputs;
+
+/**
+ * The result of a case.
+ */
+struct result
+{
+  size_t block;       //< The block size.
+  int    level;       //< The FastLZ level.
+  bool   valid;       //< The case ran.
+  size_t compressed;  //< The size compressed including the block headers.
+  double comp;        //< The compress time in seconds.
+  double decomp;      //< The decompress time in seconds.
+  std::string error;  //< The error if the case did not run.
+};
+
+typedef std::vector < result > results;
+
+static void
+load_input (const std::string& path, input& in)
+{
+  rld::files::image img (path);
+
+  img.open ();
+
+  try
+  {
+    in.name = path;
+    in.data.resize (img.size ());
+    if (!in.data.empty () &&
+        (img.read (&in.data[0], in.data.size ()) != (ssize_t) in.data.size ()))
+      throw rld::error ("Read past end", "input:" + path);
+
+    std::string header;
+    for (size_t h = 0; (h < in.data.size ()) && (h < 64); ++h)
+    {
+      if (in.data[h] == '\n')
+      {
+        header.assign ((const char*) &in.data[0], h);
+        break;
+      }
+    }
+
+    rld::strings fields;
+    rld::split (header, fields, ',');
+
+    if ((fields.size () == 5) && (fields[0] == "RAP"))
+    {
+      if (rld::verbose ())
+        std::cerr << "input: RAP payload: " << path << std::endl;
+
+      std::vector < uint8_t > payload;
+
+      if (fields[3] == "LZ77")
+      {
+        img.seek (header.size () + 1);
+
+        rld::compress::compressor comp (img, 0xffff, false);
+        uint8_t                   block[4096];
+        size_t                    reading;
+
+        while ((reading = comp.read (block, sizeof (block))) > 0)
+          payload.insert (payload.end (), block, block + reading);
+      }
+      else
+      {
+        payload.assign (in.data.begin () + header.size () + 1, in.data.end ());
+      }
+
+      in.name += " (payload)";
+      in.data.swap (payload);
+    }
+  }
+  catch (...)
+  {
+    img.close ();
+    throw;
+  }
+
+  img.close ();
+}
+
+static void
+run_case (const input& in, size_t iterations, result& r)
+{
+  r.valid = false;
+  r.compressed = 0;
+  r.comp = 0;
+  r.decomp = 0;
+
+  rld::files::memory_image out;
+  std::vector < uint8_t >  check (in.data.size ());
+
+  try
+  {
+    for (size_t i = 0; i < iterations; ++i)
+    {
+      out.open (true);
+
+      double start = rld::stats::now ();
+      {
+        rld::compress::compressor comp (out, r.block, true, true, r.level);
+        comp.write (&in.data[0], in.data.size ());
+        comp.flush ();
+        r.compressed = comp.compressed ();
+      }
+      double compressing = rld::stats::now () - start;
+
+      out.close ();
+
+      out.open ();
+
+      start = rld::stats::now ();
+      {
+        rld::compress::compressor comp (out, r.block, false);
+        if (comp.read (&check[0], check.size ()) != check.size ())
+          throw rld::error ("Read past end", "decompress");
+      }
+      double decompressing = rld::stats::now () - start;
+
+      out.close ();
+
+      if (::memcmp (&check[0], &in.data[0], check.size ()) != 0)
+        throw rld::error ("Decompressed data does not match", "decompress");
+
+      if ((i == 0) || (compressing < r.comp))
+        r.comp = compressing;
+      if ((i == 0) || (decompressing < r.decomp))
+        r.decomp = decompressing;
+    }
+
+    r.valid = true;
+  }
+  catch (rld::error re)
+  {
+    r.error = re.what;
+  }
+}
+
+static double
+mb_per_s (size_t bytes, double seconds)
+{
+  if (seconds <= 0)
+    return 0;
+  return (bytes / (1024.0 * 1024.0)) / seconds;
+}
+
+static double
+ratio (size_t bytes, size_t compressed)
+{
+  return (compressed * 100.0) / bytes;
+}
+
+static void
+output_text (std::ostream& out, const input& in, const results& rs)
+{
+  out << in.name << ": " << in.data.size () << " bytes" << std::endl
+      << "   Block  Level    Size %  Comp MB/s  Decomp MB/s" << std::endl;
+
+  for (results::const_iterator ri = rs.begin (); ri != rs.end (); ++ri)
+  {
+    const result& r = *ri;
+    out << std::setw (8) << r.block
+        << std::setw (7);
+    if (r.level)
+      out << r.level;
+    else
+      out << "auto";
+    if (r.valid)
+      out << std::setw (10) << std::setprecision (2)
+          << ratio (in.data.size (), r.compressed)
+          << std::setw (11) << std::setprecision (1)
+          << mb_per_s (in.data.size (), r.comp)
+          << std::setw (13)
+          << mb_per_s (in.data.size (), r.decomp);
+    else
+      out << "  " << r.error;
+    out << std::endl;
+  }
+}
+
+static void
+output_json (std::ostream& out, const input& in, const results& rs)
+{
+  out << "    {" << std::endl
+      << "      \"input\": " << rld::json_string (in.name) << ',' << std::endl
+      << "      \"bytes\": " << in.data.size () << ',' << std::endl
+      << "      \"cases\": [";
+
+  for (results::const_iterator ri = rs.begin (); ri != rs.end (); ++ri)
+  {
+    const result& r = *ri;
+    out << (ri == rs.begin () ? "" : ",") << std::endl
+        << "        { \"block\": " << r.block
+        << ", \"level\": " << r.level;
+    if (r.valid)
+      out << std::setprecision (3)
+          << ", \"compressed\": " << r.compressed
+          << ", \"size-percent\": " << ratio (in.data.size (), r.compressed)
+          << ", \"comp-mb-s\": " << mb_per_s (in.data.size (), r.comp)
+          << ", \"decomp-mb-s\": " << mb_per_s (in.data.size (), r.decomp);
+    else
+      out << ", \"error\": " << rld::json_string (r.error);
+    out << " }";
+  }
+
+  out << std::endl
+      << "      ]" << std::endl
+      << "    }";
+}
+
+static void
+counts (const char* arg, std::vector < int >& values, int min, int max,
+        const char* what)
+{
+  rld::strings fields;
+  rld::split (arg, fields, ',');
+  values.clear ();
+  for (rld::strings::iterator fi = fields.begin (); fi != fields.end (); ++fi)
+  {
+    char* end;
+    long  value = ::strtol ((*fi).c_str (), &end, 10);
+    if ((*fi).empty () || (*end != '\0') || (value < min) || (value > max))
+      throw rld::error ("invalid value: " + *fi, what);
+    values.push_back (value);
+  }
+}
+
+int
+main (int argc, char* argv[])
+{
+  int         ec = 0;
+  const char* program = argv[0];
+
+  try
+  {
+    std::vector < int > blocks;
+    std::vector < int > levels;
+    int                 iterations = 5;
+    bool                json = false;
+    std::string         output;
+    inputs              ins;
+
+    counts ("1024,2048,4096,8192,16384,32768,61440", blocks, 1,
+            rld::compress::max_block_size, "options:blocks");
+    counts ("0,1,2", levels, 0, 2, "options:levels");
+
+    while (true)
+    {
+      int opt = ::getopt_long (argc, argv, "hvVb:L:i:jo:", rld_opts, NULL);
+      if (opt < 0)
+        break;
+
+      switch (opt)
+      {
+        case 'V':
+          std::cout << "rtems-compress-bench (RTEMS Compressor Benchmark) "
+                    << rld::version () << std::endl;
+          ::exit (0);
+          break;
+
+        case 'v':
+          rld::verbose_inc ();
+          break;
+
+        case 'b':
+          counts (optarg, blocks, 1, rld::compress::max_block_size,
+                  "options:blocks");
+          break;
+
+        case 'L':
+          counts (optarg, levels, 0, 2, "options:levels");
+          break;
+
+        case 'i':
+          iterations = ::strtol (optarg, 0, 10);
+          if (iterations <= 0)
+            throw rld::error ("invalid count: " + std::string (optarg),
+                              "options:iterations");
+          break;
+
+        case 'j':
+          json = true;
+          break;
+
+        case 'o':
+          output = optarg;
+          break;
+
+        case '?':
+          usage (3);
+          break;
+
+        case 'h':
+          usage (0);
+          break;
+      }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc == 0)
+    {
+      ins.push_back (input ());
+      load_input (program, ins.back ());
+    }
+
+    while (argc--)
+    {
+      ins.push_back (input ());
+      load_input (*argv++, ins.back ());
+    }
+
+    std::ofstream file;
+    if (!output.empty ())
+    {
+      file.open (output.c_str ());
+      if (!file.is_open ())
+        throw rld::error (::strerror (errno), "open:" + output);
+    }
+
+    std::ostream& out = output.empty () ? std::cout : file;
+
+    out << std::fixed;
+
+    if (json)
+      out << '{' << std::endl
+          << "  \"tool\": \"rtems-compress-bench\"," << std::endl
+          << "  \"version\": \"" << rld::version () << "\"," << std::endl
+          << "  \"iterations\": " << iterations << ',' << std::endl
+          << "  \"inputs\": [";
+
+    for (inputs::iterator ii = ins.begin (); ii != ins.end (); ++ii)
+    {
+      input&  in = *ii;
+      results rs;
+
+      if (in.data.empty ())
+        throw rld::error ("Input is empty", "input:" + in.name);
+
+      for (size_t b = 0; b < blocks.size (); ++b)
+      {
+        for (size_t l = 0; l < levels.size (); ++l)
+        {
+          result r;
+          r.block = blocks[b];
+          r.level = levels[l];
+          if (rld::verbose ())
+            std::cerr << "bench: " << in.name << ": block=" << r.block
+                      << " level=" << r.level << std::endl;
+          run_case (in, iterations, r);
+          rs.push_back (r);
+        }
+      }
+
+      if (json)
+      {
+        out << (ii == ins.begin () ? "" : ",") << std::endl;
+        output_json (out, in, rs);
+      }
+      else
+      {
+        if (ii != ins.begin ())
+          out << std::endl;
+        output_text (out, in, rs);
+      }
+    }
+
+    if (json)
+      out << std::endl
+          << "  ]" << std::endl
+          << '}' << std::endl;
+  }
+  catch (rld::error re)
+  {
+    std::cerr << "error: "
+              << re.where << ": " << re.what
+              << std::endl;
+    ec = 10;
+  }
+  catch (std::exception e)
+  {
+    int   status;
+    char* realname;
+    realname = abi::__cxa_demangle (e.what(), 0, 0, &status);
+    std::cerr << "error: exception: " << realname << " [";
+    ::free (realname);
+    const std::type_info &ti = typeid (e);
+    realname = abi::__cxa_demangle (ti.name(), 0, 0, &status);
+    std::cerr << realname << "] " << e.what () << std::endl;
+    ::free (realname);
+    ec = 11;
+  }
+  catch (...)
+  {
+    /*
+     * Helps to know if this happens.
+     */
+    std::cerr << "error: unhandled exception" << std::endl;
+    ec = 12;
+  }
+
+  return ec;
+}
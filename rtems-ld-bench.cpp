@@ -0,0 +1,911 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems_rld
+ *
+ * @brief RTEMS Linker Benchmark generates a synthetic set of ELF object files
+ *        and archives and times the linker's phases linking them.
+ *
+ * Object 0 references the functions of object 1, object 1 those of object 2
+ * and so on with the last object referencing object 0's so every object is
+ * part of the link. The first objects are the application and the remaining
+ * objects are split over the archives.
+ *
+ * The links allocate their records from a link-scoped arena as the linker
+ * does, from the heap, or alternate between the two to compare them.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cxxabi.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <rld.h>
+#include <rld-outputter.h>
+#include <rld-resolver.h>
+#include <rld-stats.h>
+
+#if __WIN32__
+#define CREATE_MODE (S_IRUSR | S_IWUSR)
+#define OPEN_FLAGS  (O_BINARY)
+#else
+#define CREATE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH)
+#define OPEN_FLAGS  (0)
+#endif
+
+/**
+ * RTEMS Linker Benchmark options.
+ */
+static struct option rld_opts[] = {
+  { "help",        no_argument,            NULL,           'h' },
+  { "version",     no_argument,            NULL,           'V' },
+  { "verbose",     no_argument,            NULL,           'v' },
+  { "objects",     required_argument,      NULL,           'n' },
+  { "app-objects", required_argument,      NULL,           'a' },
+  { "archives",    required_argument,      NULL,           'A' },
+  { "symbols",     required_argument,      NULL,           's' },
+  { "relocs",      required_argument,      NULL,           'r' },
+  { "sections",    required_argument,      NULL,           'S' },
+  { "name-length", required_argument,      NULL,           'N' },
+  { "iterations",  required_argument,      NULL,           'i' },
+  { "dir",         required_argument,      NULL,           'd' },
+  { "keep",        no_argument,            NULL,           'k' },
+  { "output",      required_argument,      NULL,           'o' },
+  { "alloc",       required_argument,      NULL,           'm' },
+  { "check",       required_argument,      NULL,           'c' },
+  { NULL,          0,                      NULL,            0 }
+};
+
+void
+usage (int exit_code)
+{
+  std::cout << "rtems-ld-bench [options]" << std::endl
+            << "Options and arguments:" << std::endl
+            << " -h        : help (also --help)" << std::endl
+            << " -V        : print the version number and exit (also --version)" << std::endl
+            << " -v        : verbose, can supply multiple times to increase" << std::endl
+            << "             verbosity (also --verbose)" << std::endl
+            << " -n count  : number of object files, default 200 (also --objects)" << std::endl
+            << " -a count  : number of the objects in the application, the" << std::endl
+            << "             others are in archives, default 1 (also --app-objects)" << std::endl
+            << " -A count  : number of archives, default 4 (also --archives)" << std::endl
+            << " -s count  : functions defined by each object, default 20" << std::endl
+            << "             (also --symbols)" << std::endl
+            << " -r count  : relocations in each section, default 8 (also --relocs)" << std::endl
+            << " -S count  : text sections in each object as if compiled with" << std::endl
+            << "             -ffunction-sections, default 4 (also --sections)" << std::endl
+            << " -N length : length of the C++ function names, default 40" << std::endl
+            << "             (also --name-length)" << std::endl
+            << " -i count  : number of times to link, default 5 (also --iterations)" << std::endl
+            << " -d dir    : directory for the generated files, default" << std::endl
+            << "             'rld-bench' (also --dir)" << std::endl
+            << " -k        : keep the generated files (also --keep)" << std::endl
+            << " -o file   : write the JSON results to file, default stdout" << std::endl
+            << "             (also --output)" << std::endl
+            << " -m mode   : allocate the link's records from the 'arena', the" << std::endl
+            << "             'heap' or link with 'both' to compare them, default" << std::endl
+            << "             'arena' (also --alloc)" << std::endl
+            << " -c file   : check the RAP image is the same as the reference" << std::endl
+            << "             image, the image is saved as the reference if the" << std::endl
+            << "             file does not exist (also --check)" << std::endl;
+  ::exit (exit_code);
+}
+
+/**
+ * The parameters of the generated files.
+ */
+struct parameters
+{
+  int objects;      //< The number of object files.
+  int app_objects;  //< The number of objects in the application.
+  int archives;     //< The number of archives.
+  int symbols;      //< The functions each object defines.
+  int relocs;       //< The relocations in each section.
+  int sections;     //< The text sections in each object.
+  int name_length;  //< The length of a function name.
+  int iterations;   //< The number of links.
+  bool arena;       //< Link with an arena.
+  bool heap;        //< Link without an arena.
+
+  parameters ();
+};
+
+parameters::parameters ()
+  : objects (200),
+    app_objects (1),
+    archives (4),
+    symbols (20),
+    relocs (8),
+    sections (4),
+    name_length (40),
+    iterations (5),
+    arena (true),
+    heap (false)
+{
+}
+
+/**
+ * The name of a function. It is a mangled C++ function with no arguments
+ * padded to the length.
+ */
+static const std::string
+function_name (const parameters& params, int object, int function)
+{
+  std::string id = "bench_o" + rld::to_string (object) +
+    "_f" + rld::to_string (function);
+  if ((int) id.size () < params.name_length)
+    id.append (params.name_length - id.size (), 'x');
+  return "_Z" + rld::to_string (id.size ()) + id + 'v';
+}
+
+/**
+ * Add a string to a string table returning its offset.
+ */
+static uint32_t
+add_string (std::string& table, const std::string& s)
+{
+  uint32_t offset = table.size ();
+  table += s;
+  table += '\0';
+  return offset;
+}
+
+static void
+libelf_error (const std::string& where)
+{
+  throw rld::error (::elf_errmsg (-1), "libelf:" + where);
+}
+
+/**
+ * Create a section with a single data descriptor.
+ */
+static void
+add_section (Elf*               elf,
+             uint32_t           name,
+             uint32_t           type,
+             uint32_t           flags,
+             uint32_t           link,
+             uint32_t           info,
+             uint32_t           align,
+             uint32_t           entsize,
+             void*              buffer,
+             size_t             size,
+             Elf_Type           data_type,
+             const std::string& path)
+{
+  Elf_Scn* scn = ::elf_newscn (elf);
+  if (!scn)
+    libelf_error ("elf_newscn:" + path);
+
+  Elf32_Shdr* shdr = ::elf32_getshdr (scn);
+  if (!shdr)
+    libelf_error ("elf32_getshdr:" + path);
+
+  shdr->sh_name = name;
+  shdr->sh_type = type;
+  shdr->sh_flags = flags;
+  shdr->sh_link = link;
+  shdr->sh_info = info;
+  shdr->sh_addralign = align;
+  shdr->sh_entsize = entsize;
+
+  Elf_Data* data = ::elf_newdata (scn);
+  if (!data)
+    libelf_error ("elf_newdata:" + path);
+
+  data->d_buf = buffer;
+  data->d_size = size;
+  data->d_type = data_type;
+  data->d_align = align;
+  data->d_off = 0;
+  data->d_version = EV_CURRENT;
+}
+
+/**
+ * Generate an object file. The section header table is:
+ *
+ *  1 .. S        .text.<n> sections
+ *  S + 1         .data
+ *  S + 2 .. 2S+1 .rel.text.<n> sections
+ *  2S + 2        .symtab
+ *  2S + 3        .strtab
+ *  2S + 4        .shstrtab
+ */
+static void
+generate_object (const parameters& params,
+                 int               object,
+                 const std::string& path)
+{
+  const int    secs = params.sections;
+  const size_t text_size = std::max (16, params.relocs * 4);
+  const int    symtab_index = (2 * secs) + 2;
+  const int    next = (object + 1) % params.objects;
+
+  std::string              shstrtab (1, '\0');
+  std::string              strtab (1, '\0');
+  std::vector < Elf32_Sym > syms (1);
+
+  /*
+   * The defined functions are spread over the text sections and the
+   * functions of the next object are undefined.
+   */
+  for (int f = 0; f < params.symbols; ++f)
+  {
+    Elf32_Sym sym;
+    ::memset (&sym, 0, sizeof (sym));
+    sym.st_name = add_string (strtab, function_name (params, object, f));
+    sym.st_value = ((f / secs) * 4) % text_size;
+    sym.st_size = 4;
+    sym.st_info = ELF32_ST_INFO (STB_GLOBAL, STT_FUNC);
+    sym.st_shndx = 1 + (f % secs);
+    syms.push_back (sym);
+  }
+
+  if (next != object)
+  {
+    for (int f = 0; f < params.symbols; ++f)
+    {
+      Elf32_Sym sym;
+      ::memset (&sym, 0, sizeof (sym));
+      sym.st_name = add_string (strtab, function_name (params, next, f));
+      sym.st_info = ELF32_ST_INFO (STB_GLOBAL, STT_NOTYPE);
+      sym.st_shndx = SHN_UNDEF;
+      syms.push_back (sym);
+    }
+  }
+
+  std::vector < uint8_t >                text (text_size, 0);
+  uint8_t                                data[16] = { 0 };
+  std::vector < std::vector < Elf32_Rel > > rels (secs);
+  std::vector < uint32_t >               text_names (secs);
+  std::vector < uint32_t >               rel_names (secs);
+
+  for (int s = 0; s < secs; ++s)
+  {
+    std::string name = ".text." + rld::to_string (s);
+    text_names[s] = add_string (shstrtab, name);
+    rel_names[s] = add_string (shstrtab, ".rel" + name);
+
+    /*
+     * The relocations alternate between the object's functions and the next
+     * object's.
+     */
+    for (int r = 0; r < params.relocs; ++r)
+    {
+      Elf32_Rel rel;
+      int       reloc = (s * params.relocs) + r;
+      int       sym = 1 + ((reloc / 2) % params.symbols);
+      if ((next != object) && (reloc & 1))
+        sym += params.symbols;
+      rel.r_offset = r * 4;
+      rel.r_info = ELF32_R_INFO (sym, (r & 1) ? R_386_PC32 : R_386_32);
+      rels[s].push_back (rel);
+    }
+  }
+
+  uint32_t data_name = add_string (shstrtab, ".data");
+  uint32_t symtab_name = add_string (shstrtab, ".symtab");
+  uint32_t strtab_name = add_string (shstrtab, ".strtab");
+  uint32_t shstrtab_name = add_string (shstrtab, ".shstrtab");
+
+  int fd = ::open (path.c_str (),
+                   OPEN_FLAGS | O_WRONLY | O_CREAT | O_TRUNC, CREATE_MODE);
+  if (fd < 0)
+    throw rld::error (::strerror (errno), "open:" + path);
+
+  Elf* elf = ::elf_begin (fd, ELF_C_WRITE, 0);
+
+  try
+  {
+    if (!elf)
+      libelf_error ("elf_begin:" + path);
+
+    Elf32_Ehdr* ehdr = ::elf32_newehdr (elf);
+    if (!ehdr)
+      libelf_error ("elf32_newehdr:" + path);
+
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_type = ET_REL;
+    ehdr->e_machine = EM_386;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_shstrndx = symtab_index + 2;
+
+    for (int s = 0; s < secs; ++s)
+      add_section (elf, text_names[s], SHT_PROGBITS,
+                   SHF_ALLOC | SHF_EXECINSTR, 0, 0, 4, 0,
+                   &text[0], text.size (), ELF_T_BYTE, path);
+
+    add_section (elf, data_name, SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+                 0, 0, 4, 0, data, sizeof (data), ELF_T_BYTE, path);
+
+    for (int s = 0; s < secs; ++s)
+      add_section (elf, rel_names[s], SHT_REL, 0, symtab_index, 1 + s,
+                   4, sizeof (Elf32_Rel), rels[s].empty () ? 0 : &rels[s][0],
+                   rels[s].size () * sizeof (Elf32_Rel), ELF_T_REL, path);
+
+    add_section (elf, symtab_name, SHT_SYMTAB, 0, symtab_index + 1, 1,
+                 4, sizeof (Elf32_Sym), &syms[0],
+                 syms.size () * sizeof (Elf32_Sym), ELF_T_SYM, path);
+
+    add_section (elf, strtab_name, SHT_STRTAB, 0, 0, 0, 1, 0,
+                 const_cast < char* > (strtab.data ()), strtab.size (),
+                 ELF_T_BYTE, path);
+
+    add_section (elf, shstrtab_name, SHT_STRTAB, 0, 0, 0, 1, 0,
+                 const_cast < char* > (shstrtab.data ()), shstrtab.size (),
+                 ELF_T_BYTE, path);
+
+    if (::elf_update (elf, ELF_C_WRITE) < 0)
+      libelf_error ("elf_update:" + path);
+  }
+  catch (...)
+  {
+    if (elf)
+      ::elf_end (elf);
+    ::close (fd);
+    throw;
+  }
+
+  ::elf_end (elf);
+  ::close (fd);
+}
+
+/**
+ * The generated files.
+ */
+struct corpus
+{
+  rld::files::paths objects;    //< The application's object files.
+  rld::files::paths libraries;  //< The archives.
+  rld::files::paths generated;  //< All generated files.
+  std::string       entry;      //< The entry point.
+  std::string       app;        //< The application's output.
+  size_t            size;       //< The size of the objects and archives.
+};
+
+static void
+generate (const parameters& params, const std::string& dir, corpus& files)
+{
+  if (::elf_version (EV_CURRENT) == EV_NONE)
+    libelf_error ("elf_version");
+
+  if ((::mkdir (dir.c_str (), S_IRWXU | S_IRWXG | S_IRWXO) < 0) &&
+      (errno != EEXIST))
+    throw rld::error (::strerror (errno), "mkdir:" + dir);
+
+  files.size = 0;
+  files.entry = function_name (params, 0, 0);
+  rld::files::path_join (dir, "bench.rap", files.app);
+  files.generated.push_back (files.app);
+
+  rld::files::paths objects;
+
+  for (int o = 0; o < params.objects; ++o)
+  {
+    std::string path;
+    rld::files::path_join (dir, "o" + rld::to_string (o) + ".o", path);
+    files.generated.push_back (path);
+    generate_object (params, o, path);
+    objects.push_back (path);
+  }
+
+  int app_objects = std::min (params.app_objects, params.objects);
+  int lib_objects = params.objects - app_objects;
+  int archives = std::min (params.archives, lib_objects);
+
+  rld::files::paths::iterator pi = objects.begin ();
+
+  for (int o = 0; o < app_objects; ++o, ++pi)
+  {
+    files.objects.push_back (*pi);
+    files.size += rld::files::file (*pi).size ();
+  }
+
+  for (int a = 0; a < archives; ++a)
+  {
+    int                 members = (lib_objects / archives) +
+                                  (a < (lib_objects % archives) ? 1 : 0);
+    std::string         path;
+    rld::files::object_list arch_objects;
+
+    rld::files::path_join (dir, "libbench" + rld::to_string (a) + ".a", path);
+    files.generated.push_back (path);
+
+    for (int m = 0; m < members; ++m, ++pi)
+    {
+      arch_objects.push_back (new rld::files::object (*pi));
+    }
+
+    try
+    {
+      rld::files::archive arch (path);
+      arch.create (arch_objects);
+    }
+    catch (...)
+    {
+      for (rld::files::object_list::iterator oi = arch_objects.begin ();
+           oi != arch_objects.end ();
+           ++oi)
+        delete *oi;
+      throw;
+    }
+
+    for (rld::files::object_list::iterator oi = arch_objects.begin ();
+         oi != arch_objects.end ();
+         ++oi)
+      delete *oi;
+
+    files.libraries.push_back (path);
+    files.size += rld::files::file (path).size ();
+  }
+}
+
+/**
+ * Link the corpus once.
+ */
+static void
+link (const corpus& files)
+{
+  rld::files::cache       cache;
+  rld::symbols::table     base_symbols;
+  rld::symbols::table     symbols;
+  rld::symbols::symtab    undefined;
+  rld::files::paths       objects (files.objects);
+  rld::files::paths       libraries (files.libraries);
+  rld::files::object_list dependents;
+
+  rld::stats::phase phase ("link");
+
+  cache.add (objects);
+  cache.open ();
+  cache.add_libraries (libraries);
+
+  try
+  {
+    cache.archives_begin ();
+    cache.load_symbols (symbols);
+    rld::resolver::resolve (dependents, cache, base_symbols, symbols,
+                            undefined);
+    rld::outputter::application (files.app, files.entry, "",
+                                 dependents, cache, symbols, true);
+  }
+  catch (...)
+  {
+    cache.archives_end ();
+    throw;
+  }
+
+  cache.archives_end ();
+}
+
+/**
+ * Link the corpus once allocating the records from an arena or the heap. The
+ * time includes freeing the link's records.
+ */
+static void
+link (const corpus& files, bool use_arena, size_t& reserved)
+{
+  rld::stats::phase        phase ("link-and-free");
+  rld::memory::arena       arena;
+  rld::memory::arena_scope scope (use_arena ? &arena : 0);
+
+  link (files);
+
+  reserved = arena.reserved ();
+}
+
+/**
+ * The phases timed. The linker's phase names and the names reported.
+ */
+static const char* bench_phases[][2] =
+{
+  { "symbol-load",  "load-symbols" },
+  { "resolve",      "resolve"      },
+  { "rap-layout",   "layout"       },
+  { "section-emit", "write"        },
+  { 0,              "link"         },
+  { "link-and-free", "link-and-free" }
+};
+
+static const int bench_phase_count =
+  sizeof (bench_phases) / sizeof (bench_phases[0]);
+
+/**
+ * The times of a phase over the iterations.
+ */
+struct samples
+{
+  std::vector < double > wall;  //< The wall time of each iteration.
+  std::vector < double > cpu;   //< The CPU time of each iteration.
+};
+
+static void
+output_samples (std::ostream& out, const char* name, samples& s)
+{
+  std::sort (s.wall.begin (), s.wall.end ());
+
+  double wall_total = 0;
+  double cpu_total = 0;
+  for (size_t i = 0; i < s.wall.size (); ++i)
+  {
+    wall_total += s.wall[i];
+    cpu_total += s.cpu[i];
+  }
+
+  out << "    { \"name\": \"" << name << '"'
+      << ", \"min\": " << s.wall.front ()
+      << ", \"median\": " << s.wall[s.wall.size () / 2]
+      << ", \"mean\": " << wall_total / s.wall.size ()
+      << ", \"max\": " << s.wall.back ()
+      << ", \"cpu-mean\": " << cpu_total / s.cpu.size () << " }";
+}
+
+static void
+bench (const parameters& params, const corpus& files, std::ostream& out)
+{
+  std::vector < samples > times (bench_phase_count);
+  std::vector < samples > heap_times (bench_phase_count);
+  uint64_t                symbols = 0;
+  uint64_t                relocations = 0;
+  size_t                  reserved = 0;
+
+  rld::stats::enable ();
+
+  for (int i = 0; i < params.iterations; ++i)
+  {
+    /*
+     * When comparing the heap and arena links alternate so both see the same
+     * state of the host.
+     */
+    for (int m = 0; m < 2; ++m)
+    {
+      bool use_arena = m == 1;
+
+      if ((use_arena && !params.arena) || (!use_arena && !params.heap))
+        continue;
+
+      if (rld::verbose ())
+        std::cerr << "bench: iteration " << i + 1
+                  << (use_arena ? " (arena)" : " (heap)") << std::endl;
+
+      std::vector < samples >& mode_times =
+        (use_arena || !params.arena) ? times : heap_times;
+      size_t mode_reserved = 0;
+
+      rld::stats::reset ();
+
+      link (files, use_arena, mode_reserved);
+
+      if (use_arena)
+        reserved = mode_reserved;
+
+      for (int p = 0; p < bench_phase_count; ++p)
+      {
+        unsigned long calls;
+        double        wall;
+        double        cpu;
+
+        if (bench_phases[p][0])
+          rld::stats::get_phase (bench_phases[p][0], calls, wall, cpu);
+        else
+          rld::stats::get_phase ("link", calls, wall, cpu);
+
+        mode_times[p].wall.push_back (wall);
+        mode_times[p].cpu.push_back (cpu);
+      }
+
+      symbols = rld::stats::value (rld::stats::symbols);
+      relocations = rld::stats::value (rld::stats::relocations);
+    }
+  }
+
+  const char* alloc = params.heap ? (params.arena ? "both" : "heap") : "arena";
+
+  std::ios_base::fmtflags flags = out.flags ();
+
+  out << std::fixed << std::setprecision (6)
+      << '{' << std::endl
+      << "  \"tool\": \"rtems-ld-bench\"," << std::endl
+      << "  \"version\": \"" << rld::version () << "\"," << std::endl
+      << "  \"parameters\": {" << std::endl
+      << "    \"objects\": " << params.objects << ',' << std::endl
+      << "    \"app-objects\": " << params.app_objects << ',' << std::endl
+      << "    \"archives\": " << params.archives << ',' << std::endl
+      << "    \"symbols\": " << params.symbols << ',' << std::endl
+      << "    \"relocs\": " << params.relocs << ',' << std::endl
+      << "    \"sections\": " << params.sections << ',' << std::endl
+      << "    \"name-length\": " << params.name_length << ',' << std::endl
+      << "    \"iterations\": " << params.iterations << ',' << std::endl
+      << "    \"alloc\": \"" << alloc << '"' << std::endl
+      << "  }," << std::endl
+      << "  \"corpus-bytes\": " << files.size << ',' << std::endl
+      << "  \"symbols\": " << symbols << ',' << std::endl
+      << "  \"relocations\": " << relocations << ',' << std::endl;
+
+  if (params.arena)
+    out << "  \"arena-reserved\": " << reserved << ',' << std::endl;
+
+  out << "  \"phases\": [";
+
+  for (int p = 0; p < bench_phase_count; ++p)
+  {
+    out << (p ? "," : "") << std::endl;
+    output_samples (out, bench_phases[p][1], times[p]);
+  }
+
+  out << std::endl
+      << "  ]";
+
+  /*
+   * When comparing the phases above are the arena's and the heap's follow.
+   */
+  if (params.arena && params.heap)
+  {
+    out << ',' << std::endl
+        << "  \"heap-phases\": [";
+
+    for (int p = 0; p < bench_phase_count; ++p)
+    {
+      out << (p ? "," : "") << std::endl;
+      output_samples (out, bench_phases[p][1], heap_times[p]);
+    }
+
+    out << std::endl
+        << "  ]";
+  }
+
+  out << std::endl
+      << '}' << std::endl;
+
+  out.flags (flags);
+}
+
+/**
+ * Check the linked image is byte for byte the same as a reference image, for
+ * example one linked by an earlier version of the linker. If there is no
+ * reference the image is saved as the reference.
+ */
+static void
+check_image (const std::string& app, const std::string& reference)
+{
+  std::ifstream in (app.c_str (), std::ios::binary);
+  if (!in.is_open ())
+    throw rld::error (::strerror (errno), "check:open: " + app);
+  std::string image ((std::istreambuf_iterator < char > (in)),
+                     std::istreambuf_iterator < char > ());
+
+  std::ifstream ref_in (reference.c_str (), std::ios::binary);
+  if (!ref_in.is_open ())
+  {
+    std::ofstream out (reference.c_str (), std::ios::binary);
+    if (!out.is_open ())
+      throw rld::error (::strerror (errno), "check:open: " + reference);
+    out.write (image.data (), image.size ());
+    if (!out)
+      throw rld::error ("write failed", "check: " + reference);
+    std::cerr << "check: reference saved: " << reference << std::endl;
+    return;
+  }
+
+  std::string ref ((std::istreambuf_iterator < char > (ref_in)),
+                   std::istreambuf_iterator < char > ());
+
+  if (image != ref)
+    throw rld::error ("image differs from the reference (" +
+                      rld::to_string (image.size ()) + " bytes, reference " +
+                      rld::to_string (ref.size ()) + " bytes)",
+                      "check: " + reference);
+
+  if (rld::verbose ())
+    std::cerr << "check: image matches the reference" << std::endl;
+}
+
+static int
+positive (const char* arg, const char* what)
+{
+  char* end;
+  long  value = ::strtol (arg, &end, 10);
+  if ((*end != '\0') || (value <= 0))
+    throw rld::error ("invalid count: " + std::string (arg), what);
+  return value;
+}
+
+int
+main (int argc, char* argv[])
+{
+  int         ec = 0;
+  parameters  params;
+  corpus      files;
+  std::string dir = "rld-bench";
+  std::string output;
+  std::string reference;
+  bool        keep = false;
+
+  try
+  {
+    while (true)
+    {
+      int opt = ::getopt_long (argc, argv, "hvVn:a:A:s:r:S:N:i:d:ko:m:c:", rld_opts, NULL);
+      if (opt < 0)
+        break;
+
+      switch (opt)
+      {
+        case 'V':
+          std::cout << "rtems-ld-bench (RTEMS Linker Benchmark) " << rld::version ()
+                    << std::endl;
+          ::exit (0);
+          break;
+
+        case 'v':
+          rld::verbose_inc ();
+          break;
+
+        case 'n':
+          params.objects = positive (optarg, "options:objects");
+          break;
+
+        case 'a':
+          params.app_objects = positive (optarg, "options:app-objects");
+          break;
+
+        case 'A':
+          params.archives = positive (optarg, "options:archives");
+          break;
+
+        case 's':
+          params.symbols = positive (optarg, "options:symbols");
+          break;
+
+        case 'r':
+          params.relocs = positive (optarg, "options:relocs");
+          break;
+
+        case 'S':
+          params.sections = positive (optarg, "options:sections");
+          break;
+
+        case 'N':
+          params.name_length = positive (optarg, "options:name-length");
+          break;
+
+        case 'i':
+          params.iterations = positive (optarg, "options:iterations");
+          break;
+
+        case 'd':
+          dir = optarg;
+          break;
+
+        case 'k':
+          keep = true;
+          break;
+
+        case 'o':
+          output = optarg;
+          break;
+
+        case 'c':
+          reference = optarg;
+          break;
+
+        case 'm':
+          if (::strcmp (optarg, "arena") == 0)
+          {
+            params.arena = true;
+            params.heap = false;
+          }
+          else if (::strcmp (optarg, "heap") == 0)
+          {
+            params.arena = false;
+            params.heap = true;
+          }
+          else if (::strcmp (optarg, "both") == 0)
+          {
+            params.arena = true;
+            params.heap = true;
+          }
+          else
+            throw rld::error ("invalid mode: " + std::string (optarg),
+                              "options:alloc");
+          break;
+
+        case '?':
+          usage (3);
+          break;
+
+        case 'h':
+          usage (0);
+          break;
+      }
+    }
+
+    if (optind != argc)
+      throw rld::error ("no arguments allowed", "options");
+
+    generate (params, dir, files);
+
+    if (output.empty ())
+      bench (params, files, std::cout);
+    else
+    {
+      std::ofstream out (output.c_str ());
+      if (!out.is_open ())
+        throw rld::error (::strerror (errno), "open:" + output);
+      bench (params, files, out);
+    }
+
+    if (!reference.empty ())
+      check_image (files.app, reference);
+  }
+  catch (rld::error re)
+  {
+    std::cerr << "error: "
+              << re.where << ": " << re.what
+              << std::endl;
+    ec = 10;
+  }
+  catch (std::exception e)
+  {
+    int   status;
+    char* realname;
+    realname = abi::__cxa_demangle (e.what(), 0, 0, &status);
+    std::cerr << "error: exception: " << realname << " [";
+    ::free (realname);
+    const std::type_info &ti = typeid (e);
+    realname = abi::__cxa_demangle (ti.name(), 0, 0, &status);
+    std::cerr << realname << "] " << e.what () << std::endl;
+    ::free (realname);
+    ec = 11;
+  }
+  catch (...)
+  {
+    /*
+     * Helps to know if this happens.
+     */
+    std::cerr << "error: unhandled exception" << std::endl;
+    ec = 12;
+  }
+
+  if (!keep)
+  {
+    for (rld::files::paths::iterator pi = files.generated.begin ();
+         pi != files.generated.end ();
+         ++pi)
+      ::unlink ((*pi).c_str ());
+    ::rmdir (dir.c_str ());
+  }
+
+  return ec;
+}
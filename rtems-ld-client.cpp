@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012, Chris Johns <chrisj@rtems.org>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+/**
+ * @file
+ *
+ * @ingroup rtems_rld
+ *
+ * @brief RTEMS Linker Client passes its command line to an RTEMS Linker
+ *        server. It runs the linker if there is no server so it can be used
+ *        in place of the linker.
+ *
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <vector>
+
+#include <rld.h>
+#include <rld-server.h>
+
+int
+main (int argc, char* argv[])
+{
+  std::string           linker = "rtems-ld";
+  std::vector < char* > args (argv, argv + argc);
+
+  args[0] = const_cast < char* > (linker.c_str ());
+
+  try
+  {
+    int ec = 0;
+    if (rld::server::client (rld::server::default_socket (),
+                             argc, &args[0], ec))
+      return ec;
+  }
+  catch (rld::error re)
+  {
+    std::cerr << "warning: "
+              << re.where << ": " << re.what
+              << std::endl;
+  }
+
+  /*
+   * No server. Run the linker installed with the client if there is one.
+   */
+  std::string path = argv[0];
+  if (path.find_first_of (RLD_PATH_SEPARATOR) != std::string::npos)
+  {
+    rld::files::path_join (rld::files::dirname (path), linker, path);
+    if (rld::files::check_file (path))
+      linker = path;
+  }
+
+  args.push_back (0);
+  args[0] = const_cast < char* > (linker.c_str ());
+
+  ::execvp (args[0], &args[0]);
+
+  std::cerr << "error: exec: " << linker << ": " << ::strerror (errno)
+            << std::endl;
+
+  return 10;
+}
@@ -26,22 +26,32 @@
 #include "config.h"
 #endif
 
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include <cxxabi.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #include <getopt.h>
 
 #include <rld.h>
 #include <rld-cc.h>
+#include <rld-jobs.h>
+#include <rld-map.h>
 #include <rld-rap.h>
 #include <rld-outputter.h>
 #include <rld-process.h>
 #include <rld-resolver.h>
+#include <rld-server.h>
+#include <rld-sizes.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 #ifndef HAVE_KILL
 #define kill(p,s) raise(s)
@@ -57,6 +67,7 @@ static struct option rld_opts[] = {
   { "verbose",     no_argument,            NULL,           'v' },
   { "warn",        no_argument,            NULL,           'w' },
   { "map",         no_argument,            NULL,           'M' },
+  { "map-format",  required_argument,      NULL,           'f' },
   { "output",      required_argument,      NULL,           'o' },
   { "out-format",  required_argument,      NULL,           'O' },
   { "lib-path",    required_argument,      NULL,           'L' },
@@ -72,8 +83,16 @@ static struct option rld_opts[] = {
   { "mcpu",        required_argument,      NULL,           'c' },
   { "rap-strip",   no_argument,            NULL,           'S' },
   { "rpath",       required_argument,      NULL,           'R' },
+  { "rap-format",  required_argument,      NULL,           'F' },
+  { "rap-hash",    no_argument,            NULL,           'H' },
+  { "rap-pack",    no_argument,            NULL,           'k' },
   { "runtime-lib", required_argument,      NULL,           'P' },
   { "one-file",    no_argument,            NULL,           's' },
+  { "stats",       optional_argument,      NULL,           'T' },
+  { "trace",       required_argument,      NULL,           'Y' },
+  { "size-report", optional_argument,      NULL,           'z' },
+  { "size-sort",   required_argument,      NULL,           'Z' },
+  { "size-diff",   required_argument,      NULL,           'D' },
   { NULL,          0,                      NULL,            0 }
 };
 
@@ -96,7 +115,10 @@ usage (int exit_code)
             << "             to increase verbosity (also --verbose)" << std::endl
             << " -w        : generate warnings (also --warn)" << std::endl
             << " -M        : generate map output (also --map)" << std::endl
-            << " -o file   : linker output is written to file (also --output)" << std::endl
+            << " -f format : map format, 'text' (default), 'json' or 'csv', implies" << std::endl
+            << "             -M (also --map-format)" << std::endl
+            << " -o file   : linker output is written to file, '-' for stdout" << std::endl
+            << "             (also --output)" << std::endl
             << " -O format : linker output format, default is 'rap' (also --out-format)" << std::endl
             << " -L path   : path to a library, add multiple for more than" << std::endl
             << "             one path (also --lib-path)" << std::endl
@@ -116,9 +138,46 @@ usage (int exit_code)
             << " -c cpu    : machine architecture's CPU (also --mcpu)" << std::endl
             << " -S        : do not include file details (also --rap-strip)" << std::endl
             << " -R        : include file paths (also --rpath)" << std::endl
+            << " -F ver    : RAP format version, 2 (default), 3 to add an import" << std::endl
+            << "             table or 4 to also compact the relocation records" << std::endl
+            << "             (also --rap-format)" << std::endl
+            << " -H        : add the exported symbol hash table, needs a RAP" << std::endl
+            << "             format of 3 or later (also --rap-hash)" << std::endl
+            << " -k        : pack sections by alignment to reduce the padding" << std::endl
+            << "             (also --rap-pack)" << std::endl
             << " -P        : place objects from archives (also --runtime-lib)" << std::endl
             << " -s        : Include archive elf object files (also --one-file)" << std::endl
+            << " -T[opts]  : output the time of each phase and counts of the work" << std::endl
+            << "             done, opts is a comma separated list of 'json' to" << std::endl
+            << "             output JSON and 'memory' to add the memory used by" << std::endl
+            << "             each category of data (also --stats[=opts])" << std::endl
+            << " -Y file   : write a Chrome trace event file of the time spent on" << std::endl
+            << "             each file, library and section (also --trace)" << std::endl
+            << " -z[file]  : report the bytes of the RAP image by section, archive," << std::endl
+            << "             object file and symbol, or save the report as CSV to" << std::endl
+            << "             file (also --size-report[=file])" << std::endl
+            << " -Z order  : order the size report by 'size' (default) or 'name'" << std::endl
+            << "             (also --size-sort)" << std::endl
+            << " -D file   : report the size differences to the CSV size report of" << std::endl
+            << "             an earlier link (also --size-diff)" << std::endl
             << " -Wl,opts  : link compatible flags, ignored" << std::endl
+            << "Server:" << std::endl
+            << " rtems-ld --server[=socket]" << std::endl
+            << "             serve links from rtems-ld-client on the socket keeping" << std::endl
+            << "             the libraries loaded, the default socket is" << std::endl
+            << "             " << rld::server::default_socket () << std::endl
+            << "Batch:" << std::endl
+            << " rtems-ld --batch=manifest [-j jobs] [options]" << std::endl
+            << "             link the applications in the manifest, one per line" << std::endl
+            << "             as 'output entry objects', '-' for the default entry" << std::endl
+            << "             and '#' starts a comment. The options apply to each" << std::endl
+            << "             application and the libraries are loaded once. Link" << std::endl
+            << "             using jobs processes, 0 for one per processor," << std::endl
+            << "             default 1 (also --jobs)" << std::endl
+            << "Compiler cache:" << std::endl
+            << " The compiler's search paths and libraries are cached in" << std::endl
+            << " ~/.rtems-ld-cc.cache. Set RTEMS_LD_CC_CACHE to use another" << std::endl
+            << " file or to an empty string to not cache." << std::endl
             << "Output Formats:" << std::endl
             << " rap     - RTEMS application (LZ77, single image)" << std::endl
             << " elf     - ELF application (script, ELF files)" << std::endl
@@ -161,12 +220,617 @@ setup_signals (void)
 #endif
 }
 
+/**
+ * A library set is the base image and libraries a link uses. The server loads
+ * the sets links ask for and keeps them so the links that follow use the
+ * archives and symbols without loading them. The key holds the working
+ * directory if any path is relative, the base image and the libraries, each
+ * on a line.
+ */
+struct library_set
+{
+  /**
+   * The time and size of a file when the set was loaded.
+   */
+  typedef std::pair < time_t, off_t > stamp;
+  typedef std::map < std::string, stamp > stamps;
+
+  std::string          cwd;         //< The directory of relative paths.
+  std::string          base_name;   //< The base image, can be empty.
+  rld::files::paths    libraries;   //< The libraries.
+  rld::files::cache    cache;       //< The loaded libraries.
+  rld::files::cache    base;        //< The loaded base image.
+  stamps               files;       //< The files when loaded.
+  unsigned int         machinetype; //< The machine type of the files.
+  unsigned long        used;        //< When last used.
+
+  library_set (const std::string& key);
+
+  /**
+   * The files have not changed since the set was loaded.
+   */
+  bool current () const;
+
+  /**
+   * Load the set.
+   */
+  void load ();
+
+  /**
+   * Make the key for a link's base image and libraries.
+   */
+  static const std::string key (const std::string&       base_name,
+                                const rld::files::paths& libraries);
+
+private:
+  static bool file_stamp (const std::string& path, stamp& stamp_);
+};
+
+library_set::library_set (const std::string& key)
+  : machinetype (0),
+    used (0)
+{
+  std::string::size_type start = 0;
+  int                    line = 0;
+  while (start <= key.size ())
+  {
+    std::string::size_type end = key.find ('\n', start);
+    if (end == std::string::npos)
+      end = key.size ();
+    std::string field = key.substr (start, end - start);
+    if (line == 0)
+      cwd = field;
+    else if (line == 1)
+      base_name = field;
+    else if (!field.empty ())
+      libraries.push_back (field);
+    ++line;
+    start = end + 1;
+  }
+}
+
+bool
+library_set::file_stamp (const std::string& path, stamp& stamp_)
+{
+  struct stat sb;
+  if (::stat (path.c_str (), &sb) < 0)
+    return false;
+  stamp_ = stamp (sb.st_mtime, sb.st_size);
+  return true;
+}
+
+bool
+library_set::current () const
+{
+  for (stamps::const_iterator si = files.begin (); si != files.end (); ++si)
+  {
+    stamp now;
+    if (!file_stamp ((*si).first, now) || (now != (*si).second))
+      return false;
+  }
+  return true;
+}
+
+void
+library_set::load ()
+{
+  int here = -1;
+
+  if (!cwd.empty ())
+  {
+    here = ::open (".", O_RDONLY);
+    if ((here < 0) || (::chdir (cwd.c_str ()) < 0))
+    {
+      if (here >= 0)
+        ::close (here);
+      throw rld::error (::strerror (errno), "library-set:chdir: " + cwd);
+    }
+  }
+
+  try
+  {
+    /*
+     * Stamp the files first so a change while loading is seen.
+     */
+    rld::files::paths paths = libraries;
+    if (!base_name.empty ())
+      paths.push_back (base_name);
+    for (rld::files::paths::iterator pi = paths.begin (); pi != paths.end (); ++pi)
+    {
+      stamp stamp_;
+      if (!file_stamp (*pi, stamp_))
+        throw rld::error ("Not found", "library-set: " + *pi);
+      files[*pi] = stamp_;
+    }
+
+    rld::symbols::table symbols;
+
+    cache.open ();
+    cache.add_libraries (libraries);
+    cache.load_symbols (symbols);
+    cache.archives_end ();
+
+    if (!base_name.empty ())
+    {
+      rld::symbols::table base_symbols;
+      base.open ();
+      base.add (base_name);
+      base.load_symbols (base_symbols, true);
+      base.archives_end ();
+    }
+
+    machinetype = rld::elf::object_machine_type ();
+  }
+  catch (...)
+  {
+    rld::elf::check_file_reset ();
+    if (here >= 0)
+    {
+      if (::fchdir (here) < 0)
+        std::cerr << "error: library-set: fchdir: " << ::strerror (errno)
+                  << std::endl;
+      ::close (here);
+    }
+    throw;
+  }
+
+  /*
+   * Links for other machines can follow.
+   */
+  rld::elf::check_file_reset ();
+
+  if (here >= 0)
+  {
+    if (::fchdir (here) < 0)
+      throw rld::error (::strerror (errno), "library-set:fchdir");
+    ::close (here);
+  }
+}
+
+const std::string
+library_set::key (const std::string&       base_name,
+                  const rld::files::paths& libraries)
+{
+  bool        relative = !base_name.empty () && (base_name[0] != '/');
+  std::string libs;
+
+  for (rld::files::paths::const_iterator li = libraries.begin ();
+       li != libraries.end ();
+       ++li)
+  {
+    if ((*li).empty () || ((*li)[0] != '/'))
+      relative = true;
+    libs += '\n' + *li;
+  }
+
+  std::string cwd;
+
+  if (relative)
+  {
+    char* dir = ::getcwd (0, 0);
+    if (!dir)
+      throw rld::error (::strerror (errno), "library-set:getcwd");
+    cwd = dir;
+    ::free (dir);
+  }
+
+  return cwd + '\n' + base_name + libs;
+}
+
+/**
+ * The link server keeps the library sets. A link runs in a child of the
+ * server and asks for the set it needs. If the set is not loaded the link
+ * loads what it needs itself and notes the set so the server loads it once
+ * the link has finished.
+ */
+class link_server
+  : public rld::server::handler
+{
+public:
+  link_server ();
+  ~link_server ();
+
+  int request (int argc, char* argv[]);
+  void noted (const std::string& notes);
+
+  /**
+   * Find a current library set for a link and note its use. Returns 0 if
+   * there is no set and notes the set is needed.
+   */
+  library_set* find (const std::string&       base_name,
+                     const rld::files::paths& libraries);
+
+private:
+  typedef std::map < std::string, library_set* > library_sets;
+
+  /**
+   * The number of sets kept. The least recently used set is dropped.
+   */
+  static const size_t max_sets = 8;
+
+  library_sets  sets;
+  unsigned long ticks;
+};
+
+/**
+ * The link server if serving or linking a batch.
+ */
+static link_server* server;
+
+static int run_linker (int argc, char* argv[]);
+
+link_server::link_server ()
+  : ticks (0)
+{
+}
+
+link_server::~link_server ()
+{
+  for (library_sets::iterator si = sets.begin (); si != sets.end (); ++si)
+    delete (*si).second;
+}
+
 int
-main (int argc, char* argv[])
+link_server::request (int argc, char* argv[])
+{
+  setup_signals ();
+  return run_linker (argc, argv);
+}
+
+void
+link_server::noted (const std::string& notes)
+{
+  std::string::size_type nl = notes.find ('\n');
+  if (nl == std::string::npos)
+    return;
+
+  std::string what = notes.substr (0, nl);
+  std::string key = notes.substr (nl + 1);
+
+  library_sets::iterator si = sets.find (key);
+
+  if (what == "used")
+  {
+    if (si != sets.end ())
+      (*si).second->used = ++ticks;
+    return;
+  }
+
+  if (what != "load")
+    return;
+
+  if (si != sets.end ())
+  {
+    /*
+     * Another link could have loaded it.
+     */
+    if ((*si).second->current ())
+      return;
+    delete (*si).second;
+    sets.erase (si);
+  }
+
+  if (sets.size () >= max_sets)
+  {
+    library_sets::iterator lru = sets.begin ();
+    for (si = sets.begin (); si != sets.end (); ++si)
+      if ((*si).second->used < (*lru).second->used)
+        lru = si;
+    delete (*lru).second;
+    sets.erase (lru);
+  }
+
+  library_set* set = new library_set (key);
+
+  try
+  {
+    set->load ();
+  }
+  catch (...)
+  {
+    delete set;
+    throw;
+  }
+
+  set->used = ++ticks;
+  sets[key] = set;
+}
+
+library_set*
+link_server::find (const std::string&       base_name,
+                   const rld::files::paths& libraries)
+{
+  std::string            key = library_set::key (base_name, libraries);
+  library_sets::iterator si = sets.find (key);
+
+  if ((si != sets.end ()) &&
+      (*si).second->current () &&
+      ((*si).second->machinetype == rld::elf::object_machine_type ()))
+  {
+    rld::server::note ("used\n" + key);
+    return (*si).second;
+  }
+
+  rld::server::note ("load\n" + key);
+  return 0;
+}
+
+static int
+serve (int argc, char* argv[])
 {
   int ec = 0;
 
-  setup_signals ();
+  try
+  {
+    std::string path;
+
+    if (argv[1][8] == '=')
+      path = argv[1] + 9;
+    else
+      path = rld::server::default_socket ();
+
+    if (argc > 2)
+      throw rld::error ("the server has no other options", "options");
+
+    server = new link_server ();
+
+    rld::server::serve (path, *server);
+  }
+  catch (rld::error re)
+  {
+    std::cerr << "error: "
+              << re.where << ": " << re.what
+              << std::endl;
+    ec = 10;
+  }
+
+  return ec;
+}
+
+/**
+ * An application in a batch manifest.
+ */
+struct batch_app
+{
+  std::string  output;   //< The output file.
+  std::string  entry;    //< The entry point, empty for the default.
+  rld::strings objects;  //< The application's objects.
+};
+
+typedef std::vector < batch_app > batch_apps;
+
+static void
+load_manifest (const std::string& path, batch_apps& apps)
+{
+  std::ifstream in (path.c_str ());
+  if (!in.is_open ())
+    throw rld::error ("Cannot open", "batch:manifest: " + path);
+
+  std::string line;
+  int         lineno = 0;
+
+  while (std::getline (in, line))
+  {
+    ++lineno;
+
+    std::string::size_type comment = line.find ('#');
+    if (comment != std::string::npos)
+      line.erase (comment);
+
+    std::istringstream tokens (line);
+    batch_app          app;
+
+    if (!(tokens >> app.output))
+      continue;
+
+    std::string object;
+    if (tokens >> app.entry)
+      while (tokens >> object)
+        app.objects.push_back (object);
+
+    if (app.objects.empty ())
+      throw rld::error ("No entry or objects",
+                        "batch:manifest: " + path + ':' + rld::to_string (lineno));
+
+    if (app.entry == "-")
+      app.entry.clear ();
+
+    apps.push_back (app);
+  }
+
+  if (apps.empty ())
+    throw rld::error ("No applications", "batch:manifest: " + path);
+}
+
+/**
+ * Start a child to link the application. The child links with the batch's
+ * options against the library set the server holds.
+ */
+static int
+start_link (const batch_app& app, const rld::strings& options)
+{
+  rld::strings args;
+
+  args.push_back ("rtems-ld");
+  args.insert (args.end (), options.begin (), options.end ());
+  args.push_back ("-o");
+  args.push_back (app.output);
+  if (!app.entry.empty ())
+  {
+    args.push_back ("-e");
+    args.push_back (app.entry);
+  }
+  args.insert (args.end (), app.objects.begin (), app.objects.end ());
+
+  std::vector < char* > argv;
+  for (rld::strings::iterator ai = args.begin (); ai != args.end (); ++ai)
+    argv.push_back (const_cast < char* > ((*ai).c_str ()));
+  argv.push_back (0);
+
+  int pid = rld::server::start (*server, argv.size () - 1, &argv[0]);
+
+  if (rld::verbose () >= RLD_VERBOSE_INFO)
+    std::cout << "batch: " << app.output << ": link " << pid << std::endl;
+
+  return pid;
+}
+
+/**
+ * Link the applications in a manifest. Each link is a child process so the
+ * state a link changes, such as what is resolved, does not leak into the
+ * next link. The first link runs on its own and the libraries it notes are
+ * loaded once for the links that follow.
+ */
+static int
+batch (int argc, char* argv[])
+{
+  int ec = 0;
+
+  try
+  {
+    std::string  manifest = argv[1] + 8;
+    rld::strings options;
+    batch_apps   apps;
+    int          jobs = 1;
+
+    if (manifest.empty ())
+      throw rld::error ("no manifest", "options");
+
+    for (int arg = 2; arg < argc; ++arg)
+    {
+      std::string opt = argv[arg];
+      std::string count;
+      if ((opt == "-j") || (opt == "--jobs"))
+      {
+        if (++arg >= argc)
+          throw rld::error ("no number of jobs", "options");
+        count = argv[arg];
+      }
+      else if (opt.compare (0, 7, "--jobs=") == 0)
+        count = opt.substr (7);
+      else if ((opt.size () > 2) && (opt.compare (0, 2, "-j") == 0))
+        count = opt.substr (2);
+      else if ((opt == "-v") || (opt == "--verbose"))
+      {
+        /*
+         * The links inherit the verbose level.
+         */
+        rld::verbose_inc ();
+        continue;
+      }
+      else
+      {
+        options.push_back (opt);
+        continue;
+      }
+      jobs = ::strtol (count.c_str (), 0, 10);
+      if (jobs < 0)
+        throw rld::error ("Invalid number of jobs: " + count, "options");
+      if (jobs == 0)
+        jobs = rld::jobs::processors ();
+    }
+
+    load_manifest (manifest, apps);
+
+    if (rld::verbose () >= RLD_VERBOSE_INFO)
+      std::cout << "batch: " << manifest << ": applications: " << apps.size ()
+                << " jobs: " << jobs << std::endl;
+
+    server = new link_server ();
+
+    std::map < int, size_t > running;
+    size_t                   next = 0;
+    size_t                   failed = 0;
+
+    while ((next < apps.size ()) || !running.empty ())
+    {
+      /*
+       * The first link runs on its own so the libraries it notes are loaded
+       * before the other links start.
+       */
+      while ((next < apps.size ()) &&
+             (running.size () < (size_t) jobs) &&
+             ((next != 1) || running.empty ()))
+      {
+        running[start_link (apps[next], options)] = next;
+        ++next;
+      }
+
+      int code = 0;
+      int pid = rld::server::wait (*server, code);
+
+      std::map < int, size_t >::iterator ri = running.find (pid);
+      if (ri == running.end ())
+        continue;
+
+      const batch_app& app = apps[(*ri).second];
+      running.erase (ri);
+
+      if (code != 0)
+      {
+        std::cerr << "error: batch: " << app.output << ": exit: " << code
+                  << std::endl;
+        ++failed;
+      }
+      else if (rld::verbose ())
+        std::cout << "batch: " << app.output << ": linked" << std::endl;
+    }
+
+    if (failed)
+    {
+      std::cerr << "error: batch: " << manifest << ": failed: " << failed
+                << " of " << apps.size () << std::endl;
+      ec = 10;
+    }
+  }
+  catch (rld::error re)
+  {
+    std::cerr << "error: "
+              << re.where << ": " << re.what
+              << std::endl;
+    ec = 10;
+  }
+
+  return ec;
+}
+
+/**
+ * Write the maps of the base image and the application. The dependents and
+ * placements are 0 if the link failed.
+ */
+static void
+write_map (rld::map::format               map_format,
+           const std::string&             base_name,
+           rld::files::cache&             base,
+           rld::symbols::table&           base_symbols,
+           rld::files::cache&             cache,
+           rld::symbols::table&           symbols,
+           const rld::files::object_list* dependents,
+           const rld::rap::placements*    placed)
+{
+  rld::map::writer writer (map_format);
+  if (base_name.length ())
+    writer.write ("base", base, base_symbols);
+  if (dependents && cache.path_count ())
+    writer.write ("application", cache, symbols, *dependents, *placed);
+  else
+    writer.write ("application", cache, symbols);
+  writer.close ();
+}
+
+static int
+run_linker (int argc, char* argv[])
+{
+  int ec = 0;
+
+  /*
+   * The link's records are allocated from the arena and freed in one go when
+   * the link ends. Records still held when the arena is destroyed, for
+   * example by a server's library set, keep the arena's chunks until they are
+   * freed.
+   */
+  rld::memory::arena       arena;
+  rld::memory::arena_scope arena_scope (&arena);
 
   try
   {
@@ -192,6 +856,11 @@ main (int argc, char* argv[])
     bool                 standard_libs = true;
     bool                 exec_prefix_set = false;
     bool                 map = false;
+    rld::map::format     map_format = rld::map::text;
+    bool                 size_report = false;
+    std::string          size_report_path;
+    std::string          size_diff_path;
+    rld::sizes::order    size_order = rld::sizes::by_size;
     bool                 warnings = false;
     bool                 one_file = false;
 
@@ -199,7 +868,7 @@ main (int argc, char* argv[])
 
     while (true)
     {
-      int opt = ::getopt_long (argc, argv, "hvwVMnb:E:o:O:L:l:a:c:e:d:u:C:W:R:P", rld_opts, NULL);
+      int opt = ::getopt_long (argc, argv, "hvwVMf:nb:E:o:O:L:l:a:c:e:d:u:C:W:R:PF:HkT::Y:z::Z:D:", rld_opts, NULL);
       if (opt < 0)
         break;
 
@@ -219,6 +888,11 @@ main (int argc, char* argv[])
           map = true;
           break;
 
+        case 'f':
+          map_format = rld::map::parse_format (optarg);
+          map = true;
+          break;
+
         case 'w':
           warnings = true;
           break;
@@ -307,6 +981,18 @@ main (int argc, char* argv[])
           rld::rap::rpath += '\0';
           break;
 
+        case 'F':
+          rld::rap::format_version = rld::rap::parse_format_version (optarg);
+          break;
+
+        case 'H':
+          rld::rap::add_symbol_hash = true;
+          break;
+
+        case 'k':
+          rld::rap::pack_sections = true;
+          break;
+
         case 'W':
           /* ignore linker compatiable flags */
           break;
@@ -315,6 +1001,28 @@ main (int argc, char* argv[])
           usage (3);
           break;
 
+        case 'T':
+          rld::stats::parse (optarg);
+          break;
+
+        case 'Y':
+          rld::trace::open (optarg);
+          break;
+
+        case 'z':
+          size_report = true;
+          if (optarg)
+            size_report_path = optarg;
+          break;
+
+        case 'Z':
+          size_order = rld::sizes::parse_order (optarg);
+          break;
+
+        case 'D':
+          size_diff_path = optarg;
+          break;
+
         case 'h':
           usage (0);
           break;
@@ -324,7 +1032,7 @@ main (int argc, char* argv[])
     argc -= optind;
     argv += optind;
 
-    if (rld::verbose () || map)
+    if (rld::verbose () || (map && (map_format == rld::map::text)))
       std::cout << "RTEMS Linker " << rld::version () << std::endl;
 
     /*
@@ -342,6 +1050,28 @@ main (int argc, char* argv[])
         (output_type != "archive"))
       throw rld::error ("invalid output format", "options");
 
+    /*
+     * The size report is the RAP image's.
+     */
+    bool sizes = size_report || !size_diff_path.empty ();
+
+    if (sizes && (output_type != "rap"))
+      throw rld::error ("size report needs the rap output format", "options");
+
+    /*
+     * Only the formats written as a single stream can go to stdout and
+     * nothing else can be written there.
+     */
+    if (output == "-")
+    {
+      if ((output_type != "rap") && (output_type != "elf"))
+        throw rld::error ("output format cannot be written to stdout", "options");
+      if (rld::verbose () || map || rld::stats::enabled () ||
+          !size_diff_path.empty () || (size_report && size_report_path.empty ()))
+        throw rld::error ("no verbose, map, stats or size output when writing to stdout",
+                          "options");
+    }
+
     /*
      * Load the remaining command line arguments into the cache as object
      * files.
@@ -385,18 +1115,6 @@ main (int argc, char* argv[])
     if (rld::cc::cc.empty () && !exec_prefix_set)
       rld::cc::exec_prefix = rld::elf::machine_type ();
 
-    /*
-     * If we have a base image add it.
-     */
-    if (base_name.length ())
-    {
-      if (rld::verbose ())
-        std::cout << "base-image: " << base_name << std::endl;
-      base.open ();
-      base.add (base_name);
-      base.load_symbols (base_symbols, true);
-    }
-
     /*
      * Get the standard library paths
      */
@@ -414,10 +1132,45 @@ main (int argc, char* argv[])
     if (standard_libs)
       rld::cc::get_standard_libs (libraries, libpaths);
 
+    /*
+     * A server could have the libraries and base image loaded. The objects
+     * are added to the server's cache. The set's archive members are created
+     * before the objects however the objects are merged in link order so the
+     * image is the same as a link without the server.
+     */
+    library_set* set = 0;
+
+    if (server)
+      set = server->find (base_name, libraries);
+
+    if (set && rld::verbose ())
+      std::cout << "server: libraries loaded" << std::endl;
+
+    rld::files::cache& link_cache = set ? set->cache : cache;
+    rld::files::cache& link_base = set ? set->base : base;
+
+    /*
+     * If we have a base image add it.
+     */
+    if (base_name.length ())
+    {
+      if (rld::verbose ())
+        std::cout << "base-image: " << base_name << std::endl;
+      if (!set)
+      {
+        base.open ();
+        base.add (base_name);
+      }
+      link_base.load_symbols (base_symbols, true);
+    }
+
     /*
      * Load the library to the cache.
      */
-    cache.add_libraries (libraries);
+    if (set)
+      link_cache.add (objects);
+    else
+      cache.add_libraries (libraries);
 
     /*
      * Begin the archive session. This opens the archives and leaves them open
@@ -431,87 +1184,129 @@ main (int argc, char* argv[])
      */
     try
     {
-      cache.archives_begin ();
+      link_cache.archives_begin ();
 
       /*
        * Load the symbol table.
        */
-      cache.load_symbols (symbols);
+      link_cache.load_symbols (symbols);
 
       /*
-       * Map ?
+       * This structure allows us to add different operations with the same
+       * structure.
        */
-      if (map)
-      {
-        if (base_name.length ())
-          rld::map (base, base_symbols);
-        rld::map (cache, symbols);
-      }
+      rld::files::object_list dependents;
+      rld::rap::placements    placed;
+      rld::rap::costs         costs;
 
-      if (cache.path_count ())
+      try
       {
-        /*
-         * This structure allows us to add different operations with the same
-         * structure.
-         */
-        rld::files::object_list dependents;
-        rld::resolver::resolve (dependents, cache,
-                                base_symbols, symbols, undefined);
-
-        /**
-         * Output the file.
-         */
-        if (output_type == "script")
-          rld::outputter::script (output, entry, exit, dependents, cache);
-        else if (output_type == "archive")
-          rld::outputter::archive (output, entry, exit, dependents, cache);
-        else if (output_type == "elf")
-          rld::outputter::elf_application (output, entry, exit,
-                                           dependents, cache);
-        else if (output_type == "rap")
+        if (link_cache.path_count ())
         {
-          rld::outputter::application (output, entry, exit,
-                                       dependents, cache, symbols,
-                                       one_file);
-          if (!outra.empty ())
-          {
-            rld::files::paths ra_libs;
-            bool ra_exist = false;
+          rld::resolver::resolve (dependents, link_cache,
+                                  base_symbols, symbols, undefined);
 
-            /**
-             * If exist, search it, else create a new one.
-             */
-            if ((ra_exist = ::access (outra.c_str (), 0)) == 0)
+          /**
+           * Output the file.
+           */
+          if (output_type == "script")
+            rld::outputter::script (output, entry, exit,
+                                    dependents, link_cache);
+          else if (output_type == "archive")
+            rld::outputter::archive (output, entry, exit,
+                                     dependents, link_cache);
+          else if (output_type == "elf")
+            rld::outputter::elf_application (output, entry, exit,
+                                             dependents, link_cache);
+          else if (output_type == "rap")
+          {
+            rld::outputter::application (output, entry, exit,
+                                         dependents, link_cache, symbols,
+                                         one_file,
+                                         map || sizes ? &placed : 0,
+                                         sizes ? &costs : 0);
+            if (!outra.empty ())
             {
-              ra_libs.push_back (outra);
-              cachera.open ();
-              cachera.add_libraries (ra_libs);
-              cachera.archives_begin ();
+              rld::files::paths ra_libs;
+              bool ra_exist = false;
+
+              /**
+               * If exist, search it, else create a new one.
+               */
+              if ((ra_exist = ::access (outra.c_str (), 0)) == 0)
+              {
+                ra_libs.push_back (outra);
+                cachera.open ();
+                cachera.add_libraries (ra_libs);
+                cachera.archives_begin ();
+              }
+
+              rld::outputter::archivera (outra, dependents, cachera,
+                                         !ra_exist, false);
             }
+          }
+          else
+            throw rld::error ("invalid output type", "output");
 
-            rld::outputter::archivera (outra, dependents, cachera,
-                                       !ra_exist, false);
+          /**
+           * Check for warnings.
+           */
+          if (warnings)
+          {
+            rld::warn_unused_externals (dependents);
           }
-        }
-        else
-          throw rld::error ("invalid output type", "output");
 
-        /**
-         * Check for warnings.
-         */
-        if (warnings)
-        {
-          rld::warn_unused_externals (dependents);
+          /*
+           * Size report ?
+           */
+          if (sizes)
+          {
+            rld::sizes::report report;
+            report.build (link_cache, dependents, symbols, undefined,
+                          placed, costs);
+            if (size_report)
+            {
+              if (size_report_path.empty ())
+                report.output (std::cout, size_order);
+              else
+                report.save (size_report_path);
+            }
+            if (!size_diff_path.empty ())
+            {
+              rld::sizes::report earlier;
+              earlier.load (size_diff_path);
+              report.diff (std::cout, earlier, size_order);
+            }
+          }
         }
       }
+      catch (...)
+      {
+        /*
+         * The map is needed most when the link fails. It is written without
+         * the objects the resolver pulled in and the layout.
+         */
+        if (map)
+          write_map (map_format, base_name, link_base, base_symbols,
+                     link_cache, symbols, 0, 0);
+        throw;
+      }
+
+      /*
+       * Map ? It is written once the link is done so the layout and the
+       * reason each object file is in the link can be reported.
+       */
+      if (map)
+        write_map (map_format, base_name, link_base, base_symbols,
+                   link_cache, symbols, &dependents, &placed);
     }
     catch (...)
     {
-      cache.archives_end ();
+      link_cache.archives_end ();
       throw;
     }
 
-    cache.archives_end ();
+    link_cache.archives_end ();
   }
   catch (rld::error re)
   {
@@ -542,5 +1337,32 @@ main (int argc, char* argv[])
     ec = 12;
   }
 
+  if (rld::verbose () >= RLD_VERBOSE_INFO)
+    std::cout << "arena: reserved: " << arena.reserved ()
+              << " used: " << arena.used () << std::endl;
+
+  rld::stats::report (std::cout, "rtems-ld");
+  rld::trace::close ();
+
   return ec;
 }
+
+int
+main (int argc, char* argv[])
+{
+  setup_signals ();
+
+  /*
+   * The server and batch have to be the first option. The links they run
+   * parse their own command lines.
+   */
+  if ((argc > 1) &&
+      (::strncmp (argv[1], "--server", 8) == 0) &&
+      ((argv[1][8] == '\0') || (argv[1][8] == '=')))
+    return serve (argc, argv);
+
+  if ((argc > 1) && (::strncmp (argv[1], "--batch=", 8) == 0))
+    return batch (argc, argv);
+
+  return run_linker (argc, argv);
+}
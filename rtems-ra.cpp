@@ -26,7 +26,9 @@
 #include "config.h"
 #endif
 
+#include <iomanip>
 #include <iostream>
+#include <map>
 
 #include <cxxabi.h>
 #include <signal.h>
@@ -38,10 +40,13 @@
 
 #include <rld.h>
 #include <rld-cc.h>
+#include <rld-jobs.h>
 #include <rld-rap.h>
 #include <rld-outputter.h>
 #include <rld-process.h>
 #include <rld-resolver.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 #ifndef HAVE_KILL
 #define kill(p,s) raise(s)
@@ -66,9 +71,16 @@ static struct option rld_opts[] = {
   { "mcpu",        required_argument,      NULL,           'c' },
   { "rap-strip",   no_argument,            NULL,           'S' },
   { "rpath",       required_argument,      NULL,           'R' },
+  { "rap-format",  required_argument,      NULL,           'F' },
+  { "rap-hash",    no_argument,            NULL,           'H' },
+  { "rap-pack",    no_argument,            NULL,           'k' },
   { "add-rap",     required_argument,      NULL,           'A' },
   { "replace-rap", required_argument,      NULL,           'r' },
   { "delete-rap",  required_argument,      NULL,           'd' },
+  { "jobs",        required_argument,      NULL,           'j' },
+  { "incremental", no_argument,            NULL,           'I' },
+  { "stats",       optional_argument,      NULL,           'T' },
+  { "trace",       required_argument,      NULL,           'Y' },
   { NULL,          0,                      NULL,            0 }
 };
 
@@ -103,15 +115,352 @@ usage (int exit_code)
             << " -c cpu    : machine architecture's CPU (also --mcpu)" << std::endl
             << " -S        : do not include file details (also --rap-strip)" << std::endl
             << " -R        : include file paths (also --rpath)" << std::endl
+            << " -F ver    : RAP format version, 2 (default), 3 to add an import" << std::endl
+            << "             table or 4 to also compact the relocation records" << std::endl
+            << "             (also --rap-format)" << std::endl
+            << " -H        : add the exported symbol hash table, needs a RAP" << std::endl
+            << "             format of 3 or later (also --rap-hash)" << std::endl
+            << " -k        : pack sections by alignment to reduce the padding" << std::endl
+            << "             (also --rap-pack)" << std::endl
             << " -A        : Add rap files (also --Add-rap)" << std::endl
             << " -r        : replace rap files (also --replace-rap)" << std::endl
             << " -d        : delete rap files (also --delete-rap)" << std::endl
+            << " -j jobs   : convert the library's objects using jobs threads," << std::endl
+            << "             0 for one per processor, default 1 (also --jobs)" << std::endl
+            << " -I        : update the ra file converting only the new or changed" << std::endl
+            << "             objects, keeps an index in the ra file (also --incremental)" << std::endl
+            << " -T[opts]  : output the time of each phase and counts of the work" << std::endl
+            << "             done, opts is a comma separated list of 'json' to" << std::endl
+            << "             output JSON and 'memory' to add the memory used by" << std::endl
+            << "             each category of data (also --stats[=opts])" << std::endl
+            << " -Y file   : write a Chrome trace event file of the time spent on" << std::endl
+            << "             each file, library and section (also --trace)" << std::endl
             << " -Wl,opts  : link compatible flags, ignored" << std::endl
+            << "Compiler cache:" << std::endl
+            << " The compiler's search paths and libraries are cached in" << std::endl
+            << " ~/.rtems-ld-cc.cache. Set RTEMS_LD_CC_CACHE to use another" << std::endl
+            << " file or to an empty string to not cache." << std::endl
             << "Output Formats:" << std::endl
             << " ra      - RTEMS archive container of rap files" << std::endl;
   ::exit (exit_code);
 }
 
+/**
+ * A worker's view of the library being converted. Worker 0 uses the library
+ * cache loaded by the main thread. The other workers open their own cache of
+ * the library when they run their first job so no archive file or libelf
+ * handle is shared between threads.
+ */
+struct convert_worker
+{
+  rld::files::cache*   cache;    //< The worker's cache of the library.
+  rld::symbols::table* symbols;  //< The symbols of the objects converted.
+  bool                 owner;    //< The worker created the cache.
+
+  convert_worker ();
+  ~convert_worker ();
+};
+
+typedef std::vector < convert_worker > convert_workers;
+
+convert_worker::convert_worker ()
+  : cache (0),
+    symbols (0),
+    owner (false)
+{
+}
+
+convert_worker::~convert_worker ()
+{
+  if (owner)
+  {
+    if (cache)
+    {
+      cache->archives_end ();
+      delete cache;
+    }
+    delete symbols;
+  }
+}
+
+/**
+ * Convert an object file in a library to a RAP image held in memory.
+ */
+class convert_job
+  : public rld::jobs::job
+{
+public:
+  convert_job (const std::string& library,
+               const std::string& object,
+               rld::files::image& rap,
+               const std::string& entry,
+               const std::string& exit,
+               convert_workers&   workers);
+
+  void run (int worker);
+
+private:
+  const std::string  library;   //< The library holding the object.
+  const std::string  object;    //< The object's path in the cache.
+  rld::files::image& rap;       //< The RAP image to write.
+  const std::string  entry;     //< The entry point.
+  const std::string  exit;      //< The exit point.
+  convert_workers&   workers;   //< The workers' caches.
+};
+
+convert_job::convert_job (const std::string& library,
+                          const std::string& object,
+                          rld::files::image& rap,
+                          const std::string& entry,
+                          const std::string& exit,
+                          convert_workers&   workers)
+  : library (library),
+    object (object),
+    rap (rap),
+    entry (entry),
+    exit (exit),
+    workers (workers)
+{
+}
+
+void
+convert_job::run (int worker)
+{
+  convert_worker& cw = workers[worker];
+
+  if (!cw.cache)
+  {
+    rld::files::paths library_;
+    library_.push_back (library);
+    cw.owner = true;
+    cw.symbols = new rld::symbols::table ();
+    cw.cache = new rld::files::cache ();
+    cw.cache->open ();
+    cw.cache->add_libraries (library_);
+  }
+
+  rld::files::objects&          objs = cw.cache->get_objects ();
+  rld::files::objects::iterator obi = objs.find (object);
+
+  if (obi == objs.end ())
+    throw rld::error ("Object not found in library", "convert:" + object);
+
+  rld::files::object* obj = (*obi).second;
+
+  if (cw.owner)
+  {
+    obj->open ();
+    try
+    {
+      obj->begin ();
+      obj->load_symbols (*cw.symbols);
+      obj->end ();
+    }
+    catch (...)
+    {
+      obj->close ();
+      throw;
+    }
+    obj->close ();
+  }
+
+  rld::files::object_list dependents;
+  dependents.push_back (obj);
+
+  rld::outputter::application (rap, entry, exit,
+                               dependents, *cw.cache, *cw.symbols,
+                               true);
+}
+
+/**
+ * The name of the index member of an incremental RA file. It is the last
+ * member and maps each RAP member to the hash of the object file it was
+ * converted from.
+ */
+static const char* const ra_index_name = "ra-index";
+
+/**
+ * The index of an incremental RA file. The key is the RAP member's name and
+ * the value the hash of the object file.
+ */
+typedef std::map < std::string, std::string > ra_index;
+
+/**
+ * Hash the data with the 64 bit FNV-1a hash.
+ */
+static void
+fnv_hash (uint64_t& hash, const uint8_t* data, size_t size)
+{
+  while (size--)
+  {
+    hash ^= *data++;
+    hash *= 0x100000001b3ULL;
+  }
+}
+
+/**
+ * The first line of the index. It holds the linker version and the options
+ * that change the RAP output. An index with a different header is ignored.
+ */
+static std::string
+ra_index_header (const std::string& entry, const std::string& exit)
+{
+  std::ostringstream oss;
+  uint64_t           hash = 0xcbf29ce484222325ULL;
+  const std::string  rpath = rld::rap::rpath;
+
+  fnv_hash (hash, (const uint8_t*) entry.c_str (), entry.length () + 1);
+  fnv_hash (hash, (const uint8_t*) exit.c_str (), exit.length () + 1);
+  fnv_hash (hash, (const uint8_t*) rpath.data (), rpath.length ());
+
+  oss << "RA-INDEX,0001," << rld::version ()
+      << ",F" << rld::rap::format_version
+      << ",H" << rld::rap::add_symbol_hash
+      << ",k" << rld::rap::pack_sections
+      << ",S" << !rld::rap::add_obj_details
+      << ',' << std::hex << std::setfill ('0') << std::setw (16) << hash;
+
+  return oss.str ();
+}
+
+/**
+ * Hash the object file's data. The RAP file holds the object's name and
+ * offset in the library when the details are included so they are part of
+ * the hash.
+ */
+static std::string
+object_hash (rld::files::object& obj)
+{
+  #define OBJECT_HASH_BUFFER_SIZE (8 * 1024)
+  uint64_t           hash = 0xcbf29ce484222325ULL;
+  uint8_t            buffer[OBJECT_HASH_BUFFER_SIZE];
+  size_t             size = obj.name ().size ();
+  std::ostringstream oss;
+
+  obj.open ();
+
+  try
+  {
+    obj.seek (0);
+    while (size)
+    {
+      size_t  l = size < OBJECT_HASH_BUFFER_SIZE ? size : OBJECT_HASH_BUFFER_SIZE;
+      ssize_t r = obj.read (buffer, l);
+      if (r == 0)
+        throw rld::error ("input too short", "hashing: " + obj.name ().full ());
+      fnv_hash (hash, buffer, r);
+      size -= r;
+    }
+  }
+  catch (...)
+  {
+    obj.close ();
+    throw;
+  }
+
+  obj.close ();
+
+  if (rld::rap::add_obj_details)
+  {
+    const std::string name = obj.name ().full ();
+    fnv_hash (hash, (const uint8_t*) name.c_str (), name.length ());
+  }
+
+  oss << std::hex << std::setfill ('0') << std::setw (16) << hash;
+
+  return oss.str ();
+}
+
+/**
+ * Copy an archive member into the image.
+ */
+static void
+read_member (rld::files::object& member, rld::files::image& img)
+{
+  member.open ();
+  img.open (true);
+
+  try
+  {
+    if (member.name ().size ())
+    {
+      member.seek (0);
+      rld::files::copy_file (member, img, member.name ().size ());
+    }
+  }
+  catch (...)
+  {
+    img.close ();
+    member.close ();
+    throw;
+  }
+
+  img.close ();
+  member.close ();
+}
+
+/**
+ * Load the index held in an existing RA file. The index is empty if the
+ * member does not exist or was written with a different header.
+ */
+static void
+ra_index_load (rld::files::object* member,
+               const std::string&  header,
+               ra_index&           index)
+{
+  index.clear ();
+
+  if (!member)
+    return;
+
+  rld::files::memory_image text;
+  read_member (*member, text);
+
+  std::istringstream iss (std::string ((const char*) text.data (), text.size ()));
+  std::string        line;
+
+  if (!std::getline (iss, line) || (line != header))
+  {
+    if (rld::verbose ())
+      std::cout << "index: header does not match, converting all" << std::endl;
+    return;
+  }
+
+  while (std::getline (iss, line))
+  {
+    std::string::size_type space = line.find (' ');
+    if (space != std::string::npos)
+      index[line.substr (space + 1)] = line.substr (0, space);
+  }
+}
+
+/**
+ * Order the members of an archive by their offset in the archive.
+ */
+static bool
+member_offset_compare (rld::files::object* lhs, rld::files::object* rhs)
+{
+  return lhs->name ().offset () < rhs->name ().offset ();
+}
+
+/**
+ * Delete the conversion jobs and the RAP images they write.
+ */
+static void
+delete_conversions (rld::jobs::job_list& convert_jobs, rld::files::image_list& raps)
+{
+  for (rld::jobs::job_list::iterator ji = convert_jobs.begin ();
+       ji != convert_jobs.end ();
+       ++ji)
+    delete *ji;
+  convert_jobs.clear ();
+  for (rld::files::image_list::iterator ii = raps.begin ();
+       ii != raps.end ();
+       ++ii)
+    delete *ii;
+  raps.clear ();
+}
+
 static void
 fatal_signal (int signum)
 {
@@ -170,6 +519,8 @@ main (int argc, char* argv[])
     bool                    standard_libs = true;
     bool                    exec_prefix_set = false;
     bool                    convert = true;
+    int                     jobs = 1;
+    bool                    incremental = false;
     rld::files::object_list dependents;
 
     libpaths.push_back (".");
@@ -177,7 +528,7 @@ main (int argc, char* argv[])
 
     while (true)
     {
-      int opt = ::getopt_long (argc, argv, "hVvnS:a:p:L:l:o:C:E:c:R:W:A:r:d", rld_opts, NULL);
+      int opt = ::getopt_long (argc, argv, "hVvnS:a:p:L:l:o:C:E:c:R:W:A:r:dF:Hkj:IT::Y:", rld_opts, NULL);
       if (opt < 0)
         break;
 
@@ -269,6 +620,31 @@ main (int argc, char* argv[])
           rld::rap::rpath += '\0';
           break;
 
+        case 'F':
+          rld::rap::format_version = rld::rap::parse_format_version (optarg);
+          break;
+
+        case 'H':
+          rld::rap::add_symbol_hash = true;
+          break;
+
+        case 'k':
+          rld::rap::pack_sections = true;
+          break;
+
+        case 'I':
+          incremental = true;
+          break;
+
+        case 'j':
+          jobs = ::strtol (optarg, 0, 10);
+          if (jobs < 0)
+            throw rld::error ("Invalid number of jobs: " + std::string (optarg),
+                              "options");
+          if (jobs == 0)
+            jobs = rld::jobs::processors ();
+          break;
+
         case 'W':
           /* ignore linker compatiable flags */
           break;
@@ -277,6 +653,14 @@ main (int argc, char* argv[])
           usage (3);
           break;
 
+        case 'T':
+          rld::stats::parse (optarg);
+          break;
+
+        case 'Y':
+          rld::trace::open (optarg);
+          break;
+
         case 'h':
           usage (0);
           break;
@@ -346,13 +730,92 @@ main (int argc, char* argv[])
 
         cache->load_symbols (symbols);
 
+        rld::jobs::job_list   convert_jobs;
+        rld::files::image_list raps;
+        rld::files::cache*    old_ra = 0;
+
         try
         {
 
-          rld::files::objects& objs = cache->get_objects ();
-          rld::files::paths    raobjects;
+          rld::files::objects&  objs = cache->get_objects ();
+          convert_workers       workers (jobs);
+
+          /*
+           * Worker 0 converts using the library loaded here.
+           */
+          workers[0].cache = cache;
+          workers[0].symbols = &symbols;
 
           int pos = -1;
+          std::string raname = *p;
+
+          pos = raname.rfind ('/', raname.length ());
+          if (pos != -1)
+          {
+            raname.erase (0, pos);
+          }
+
+          pos = -1;
+          pos = raname.rfind ('.', raname.length ());
+          if (pos != -1)
+          {
+            raname.erase (pos, raname.length ());
+          }
+          raname += ".ra";
+
+          raname = output_path + raname;
+
+          /*
+           * An incremental update reuses the RAP members of the existing RA
+           * file whose object file has not changed.
+           */
+          std::string                                  index_header;
+          ra_index                                     old_index;
+          std::string                                  new_index;
+          std::map < std::string, rld::files::object* > old_raps;
+          std::map < std::string, int >                onames;
+          int                                          reused = 0;
+
+          if (incremental)
+          {
+            index_header = ra_index_header (entry, exit);
+            new_index = index_header + '\n';
+
+            if (rld::files::check_file (raname))
+            {
+              rld::files::paths old_library;
+              old_library.push_back (raname);
+
+              old_ra = new rld::files::cache ();
+              old_ra->open ();
+              old_ra->add_libraries (old_library);
+
+              rld::files::objects& old_objs = old_ra->get_objects ();
+              for (rld::files::objects::iterator obi = old_objs.begin ();
+                   obi != old_objs.end ();
+                   ++obi)
+              {
+                rld::files::object* obj = (*obi).second;
+                old_raps[obj->name ().oname ()] = obj;
+              }
+
+              rld::files::object* index_member = 0;
+              if (old_raps.find (ra_index_name) != old_raps.end ())
+                index_member = old_raps[ra_index_name];
+
+              ra_index_load (index_member, index_header, old_index);
+            }
+
+            /*
+             * An object file name used more than once in the library
+             * cannot be matched to its RAP member and is always converted.
+             */
+            for (rld::files::objects::iterator obi = objs.begin ();
+                 obi != objs.end ();
+                 ++obi)
+              ++onames[(*obi).second->name ().oname ()];
+          }
+
           std::string rap_name;
           for (rld::files::objects::iterator obi = objs.begin ();
               obi != objs.end ();
@@ -360,8 +823,6 @@ main (int argc, char* argv[])
           {
             rld::files::object* obj = (*obi).second;
 
-            dependents.clear ();
-
             rap_name = obj->name ().oname ();
 
             pos = obj->name ().oname ().rfind ('.', rap_name.length ());
@@ -372,65 +833,82 @@ main (int argc, char* argv[])
 
             rap_name += ".rap";
 
-            dependents.push_back (obj);
+            /*
+             * The RAP is converted into memory and the image's name is the
+             * archive member's name. Nothing is written to the current
+             * directory.
+             */
+            rld::files::image* rap = new rld::files::memory_image (rap_name);
+            raps.push_back (rap);
 
-            raobjects.push_back (rap_name);
-
-            /* Todo: include absolute name for rap_name */
-
-            rld::outputter::application (rap_name, entry, exit,
-                                         dependents, *cache, symbols,
-                                         true);
-          }
+            if (incremental)
+            {
+              const std::string hash = object_hash (*obj);
+
+              new_index += hash + ' ' + rap_name + '\n';
+
+              ra_index::const_iterator ii = old_index.find (rap_name);
+              if ((onames[obj->name ().oname ()] == 1) &&
+                  (ii != old_index.end ()) && ((*ii).second == hash) &&
+                  (old_raps.find (rap_name) != old_raps.end ()))
+              {
+                if (rld::verbose () >= RLD_VERBOSE_DETAILS)
+                  std::cout << "index: reuse: " << rap_name << std::endl;
+                read_member (*old_raps[rap_name], *rap);
+                ++reused;
+                continue;
+              }
+            }
 
-          dependents.clear ();
-          for (rld::files::paths::iterator ni = raobjects.begin (); ni != raobjects.end (); ++ni)
-          {
-            rld::files::object* obj = new rld::files::object (*ni);
-            dependents.push_back (obj);
+            convert_jobs.push_back (new convert_job (*p, (*obi).first,
+                                                     *rap, entry, exit,
+                                                     workers));
           }
 
-          bool ra_rap = true;
-          bool ra_exist = false;
-          rld::files::cache cachera;
-          std::string raname = *p;
+          /*
+           * Convert the objects. The RAP images are held in the archive in
+           * the library's order no matter which worker converted them.
+           */
+          int used = jobs;
+          rld::jobs::run (convert_jobs, used);
+          if (rld::verbose ())
+            std::cout << "Converted: " << convert_jobs.size ()
+                      << " objects using " << used << " jobs" << std::endl;
 
-          pos = -1;
-          pos = raname.rfind ('/', raname.length ());
-          if (pos != -1)
+          if (incremental)
           {
-            raname.erase (0, pos);
-          }
+            if (rld::verbose ())
+              std::cout << "Reused: " << reused << " objects" << std::endl;
 
-          pos = -1;
-          pos = raname.rfind ('.', raname.length ());
-          if (pos != -1)
-          {
-            raname.erase (pos, raname.length ());
-          }
-          raname += ".ra";
+            rld::files::image* index = new rld::files::memory_image (ra_index_name);
+            raps.push_back (index);
 
-          raname = output_path + raname;
+            index->open (true);
+            index->write (new_index.c_str (), new_index.length ());
+            index->close ();
+          }
 
-          rld::outputter::archivera (raname, dependents, cachera,
-                                     ra_exist, ra_rap);
+          rld::outputter::archivera (raname, raps);
           std::cout << "Generated: " << raname << std::endl;
-
-
-          for (rld::files::object_list::iterator oi = dependents.begin ();
-               oi != dependents.end ();
-               ++oi)
-          {
-            rld::files::object& obj = *(*oi);
-            ::unlink (obj.name ().oname ().c_str ());
-          }
         }
         catch (...)
         {
+          delete_conversions (convert_jobs, raps);
+          if (old_ra)
+          {
+            old_ra->archives_end ();
+            delete old_ra;
+          }
           cache->archives_end ();
           throw;
         }
 
+        delete_conversions (convert_jobs, raps);
+        if (old_ra)
+        {
+          old_ra->archives_end ();
+          delete old_ra;
+        }
         cache->archives_end ();
         delete cache;
       }
@@ -477,6 +955,14 @@ main (int argc, char* argv[])
           rap_name = obj->name ().oname ();
           rap_delete = false;
 
+          /*
+           * The index of an incremental RA file does not track members
+           * added, replaced or deleted by hand so drop it. The next
+           * incremental update converts all the objects.
+           */
+          if (rap_name == ra_index_name)
+            continue;
+
           for (rld::files::paths::iterator pa = raps_delete.begin ();
                pa != raps_delete.end ();
                ++pa)
@@ -492,6 +978,12 @@ main (int argc, char* argv[])
             dependents.push_back (obj);
         }
 
+        /*
+         * Keep the members in the order they are held in the RA file so the
+         * members before the first change do not need to be written.
+         */
+        dependents.sort (member_offset_compare);
+
         /*
          * Add rap files into ra file, add supports replace.
          */
@@ -617,5 +1109,8 @@ main (int argc, char* argv[])
     ec = 12;
   }
 
+  rld::stats::report (std::cout, "rtems-ra");
+  rld::trace::close ();
+
   return ec;
 }
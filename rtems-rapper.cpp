@@ -87,6 +87,19 @@ namespace rap
 
   typedef std::vector < relocation > relocations;
 
+  /**
+   * An import table entry.
+   */
+  struct import
+  {
+    uint32_t hash;
+    uint32_t name;
+  };
+
+  typedef std::vector < import > imports;
+
+  struct file;
+
   /**
    * Relocation offset sorter for the relocations container.
    */
@@ -117,7 +130,7 @@ namespace rap
     ~section ();
 
     void load_data (rld::compress::compressor& comp);
-    void load_relocs (rld::compress::compressor& comp);
+    void load_relocs (rld::compress::compressor& comp, const file& rap);
   };
 
   /**
@@ -196,6 +209,15 @@ namespace rap
 
     off_t       relocs_rap_off;
     uint32_t    relocs_size; /* not used */
+    uint32_t    relocs_rap_size;
+
+    off_t       imports_rap_off;
+    uint32_t    imports_size;
+    imports     imps;
+
+    off_t       symhash_rap_off;
+    uint32_t    symhash_size;
+    uint32_t*   symhash;
 
     off_t       detail_rap_off;
     uint32_t    obj_num;
@@ -256,6 +278,17 @@ namespace rap
                  uint32_t& name,
                  uint32_t& value) const;
 
+    /**
+     * Look up a symbol by name using the symbol hash table. Returns the
+     * symbol's index or -1 if not found.
+     */
+    int symbol_lookup (const char* name) const;
+
+    /**
+     * Return the name of an import given its index.
+     */
+    const char* import_name (uint32_t index) const;
+
     /**
      * Return the string from the string table.
      */
@@ -328,7 +361,7 @@ namespace rap
   }
 
   void
-  section::load_relocs (rld::compress::compressor& comp)
+  section::load_relocs (rld::compress::compressor& comp, const file& rap)
   {
     uint32_t header;
     comp >> header;
@@ -336,7 +369,48 @@ namespace rap
     rela = header & RAP_RELOC_RELA ? true : false;
     relocs_size = header & ~RAP_RELOC_RELA;
 
-    if (relocs_size)
+    if (relocs_size && (rap.rhdr_version >= rld::rap::rap_version_compact))
+    {
+      /*
+       * Runs of records with the same type and symbol. Each run is the length
+       * and key then the offset delta and addend of each record.
+       */
+      while (relocs.size () < relocs_size)
+      {
+        uint32_t run = rld::compress::read_uleb128 (comp);
+        uint32_t key = rld::compress::read_uleb128 (comp);
+        uint32_t offset = 0;
+        bool     import = (key & RAP_RELOC_KEY_IMPORT) != 0;
+
+        if ((run == 0) || ((relocs.size () + run) > relocs_size))
+          throw rld::error ("Invalid relocation run length", "rapper");
+
+        while (run--)
+        {
+          relocation reloc;
+
+          reloc.rap_off = comp.offset ();
+
+          reloc.info = (key & 0xff) | ((key >> RAP_RELOC_KEY_INDEX) << 8);
+          if (import)
+          {
+            reloc.info |= RAP_RELOC_IMPORT;
+            reloc.symname = rap.import_name (key >> RAP_RELOC_KEY_INDEX);
+          }
+
+          offset += rld::compress::read_uleb128 (comp);
+          reloc.offset = offset;
+
+          if (!import || rela)
+            reloc.addend = rld::compress::read_sleb128 (comp);
+
+          relocs.push_back (reloc);
+        }
+      }
+
+      std::stable_sort (relocs.begin (), relocs.end (), reloc_offset_compare ());
+    }
+    else if (relocs_size)
     {
       for (uint32_t r = 0; r < relocs_size; ++r)
       {
@@ -347,18 +421,29 @@ namespace rap
         comp >> reloc.info
              >> reloc.offset;
 
-        if (((reloc.info & RAP_RELOC_STRING) == 0) || rela)
-          comp >> reloc.addend;
+        if (rap.rhdr_version >= rld::rap::rap_version_imports)
+        {
+          if (((reloc.info & RAP_RELOC_IMPORT) == 0) || rela)
+            comp >> reloc.addend;
 
-        if ((reloc.info & RAP_RELOC_STRING) != 0)
+          if ((reloc.info & RAP_RELOC_IMPORT) != 0)
+            reloc.symname = rap.import_name ((reloc.info & ~RAP_RELOC_IMPORT) >> 8);
+        }
+        else
         {
-          if ((reloc.info & RAP_RELOC_STRING_EMBED) == 0)
+          if (((reloc.info & RAP_RELOC_STRING) == 0) || rela)
+            comp >> reloc.addend;
+
+          if ((reloc.info & RAP_RELOC_STRING) != 0)
           {
-            size_t symname_size = (reloc.info & ~(3 << 30)) >> 8;
-            reloc.symname.resize (symname_size);
-            size_t symname_read = comp.read ((void*) reloc.symname.c_str (), symname_size);
-            if (symname_read != symname_size)
-              throw rld::error ("Reading reloc symbol name failed", "rapper");
+            if ((reloc.info & RAP_RELOC_STRING_EMBED) == 0)
+            {
+              size_t symname_size = (reloc.info & ~(3 << 30)) >> 8;
+              reloc.symname.resize (symname_size);
+              size_t symname_read = comp.read ((void*) reloc.symname.c_str (), symname_size);
+              if (symname_read != symname_size)
+                throw rld::error ("Reading reloc symbol name failed", "rapper");
+            }
           }
         }
 
@@ -389,6 +474,12 @@ namespace rap
       symtab (0),
       relocs_rap_off (0),
       relocs_size (0),
+      relocs_rap_size (0),
+      imports_rap_off (0),
+      imports_size (0),
+      symhash_rap_off (0),
+      symhash_size (0),
+      symhash (0),
       detail_rap_off (0),
       obj_num (0),
       obj_name (0),
@@ -413,6 +504,8 @@ namespace rap
       delete [] symtab;
     if (strtab)
       delete [] strtab;
+    if (symhash)
+      delete [] symhash;
     if (obj_name)
       delete [] obj_name;
     if (sec_num)
@@ -570,6 +663,14 @@ namespace rap
          >> strtab_size
          >> relocs_size;
 
+    /*
+     * uint32_t: imports_size (version 3)
+     * uint32_t: symhash_size (version 3)
+     */
+    if (rhdr_version >= rld::rap::rap_version_imports)
+      comp >> imports_size
+           >> symhash_size;
+
     /*
      * Load the file details.
      */
@@ -627,12 +728,42 @@ namespace rap
         throw rld::error ("Reading symbol table failed", "rapper");
     }
 
+    /*
+     * Load the symbol hash table.
+     */
+    symhash_rap_off = comp.offset ();
+    if (symhash_size)
+    {
+      uint32_t words = symhash_size / sizeof (uint32_t);
+      symhash = new uint32_t[words];
+      for (uint32_t w = 0; w < words; ++w)
+        comp >> symhash[w];
+      if ((words < 3) || (symhash[0] == 0) || (symhash[1] == 0) ||
+          (words != (3 + symhash[0] + symhash[1] + symbols ())))
+        throw rld::error ("Invalid symbol hash table", "rapper");
+    }
+
+    /*
+     * Load the import table.
+     */
+    imports_rap_off = comp.offset ();
+    for (uint32_t i = 0; i < imports_size / (2 * sizeof (uint32_t)); ++i)
+    {
+      import imp;
+      comp >> imp.hash
+           >> imp.name;
+      if (imp.name >= strtab_size)
+        throw rld::error ("Invalid import name", "rapper");
+      imps.push_back (imp);
+    }
+
     /*
      * Load the relocation tables.
      */
     relocs_rap_off = comp.offset ();
     for (int s = 0; s < rld::rap::rap_secs; ++s)
-      secs[s].load_relocs (comp);
+      secs[s].load_relocs (comp, *this);
+    relocs_rap_size = comp.offset () - relocs_rap_off;
   }
 
   void
@@ -678,8 +809,59 @@ namespace rap
       uint8_t* sym = symtab + (index * 3 * sizeof (uint32_t));
       data  = get_value < uint32_t > (sym);
       name  = get_value < uint32_t > (sym + (1 * sizeof (uint32_t)));
-      value = get_value < uint32_t > (symtab + (2 * sizeof (uint32_t)));
+      value = get_value < uint32_t > (sym + (2 * sizeof (uint32_t)));
+    }
+  }
+
+  int
+  file::symbol_lookup (const char* name) const
+  {
+    const uint32_t  buckets = symhash[0];
+    const uint32_t  bloom_size = symhash[1];
+    const uint32_t  bloom_shift = symhash[2];
+    const uint32_t* bloom = &symhash[3];
+    const uint32_t* bucket = bloom + bloom_size;
+    const uint32_t* chain = bucket + buckets;
+    const uint32_t  hash = rld::rap::symbol_hash (name);
+    const uint32_t  mask = ((1UL << (hash % 32)) |
+                            (1UL << ((hash >> bloom_shift) % 32)));
+
+    if ((bloom[(hash / 32) % bloom_size] & mask) != mask)
+      return -1;
+
+    uint32_t index = bucket[hash % buckets];
+
+    if (index == RAP_SYMHASH_EMPTY)
+      return -1;
+
+    while (index < (uint32_t) symbols ())
+    {
+      uint32_t data;
+      uint32_t sym_name;
+      uint32_t value;
+
+      symbol (index, data, sym_name, value);
+
+      if (((chain[index] | 1) == (hash | 1)) &&
+          (::strcmp (name, (const char*) &strtab[sym_name]) == 0))
+        return index;
+
+      if (chain[index] & 1)
+        break;
+
+      ++index;
     }
+
+    return -1;
+  }
+
+  const char*
+  file::import_name (uint32_t index) const
+  {
+    if (index >= imps.size ())
+      throw rld::error ("Invalid import index: " + rld::to_string (index),
+                        "rapper");
+    return (const char*) &strtab[imps[index].name];
   }
 
   const char*
@@ -712,6 +894,7 @@ rap_show (rld::files::paths& raps,
           bool               show_strings,
           bool               show_symbols,
           bool               show_relocs,
+          bool               show_imports,
           bool               show_details)
 {
   for (rld::files::paths::iterator pi = raps.begin();
@@ -768,10 +951,8 @@ rap_show (rld::files::paths& raps,
                 << " (" << r.layout_rap_off << ')' << std::endl
                 << std::setw (18) << "  "
                 << "  size  align offset    " << std::endl;
-      uint32_t relocs_size = 0;
       for (int s = 0; s < rld::rap::rap_secs; ++s)
       {
-        relocs_size += r.secs[s].relocs.size ();
         std::cout << std::setw (16) << rld::rap::section_name (s)
                   << ": " << std::setw (6) << r.secs[s].size
                   << std::setw (7)  << r.secs[s].alignment;
@@ -797,9 +978,25 @@ rap_show (rld::files::paths& raps,
                 << std::hex << std::setfill ('0')
                 << " 0x" << std::setw (8) << r.symtab_rap_off
                 << std::setfill (' ') << std::dec
-                << " (" << r.symtab_rap_off << ')' << std::endl
-                << std::setw (16) << "relocs" << ": "
-                << std::setw (6) << (relocs_size * 3 * sizeof (uint32_t))
+                << " (" << r.symtab_rap_off << ')' << std::endl;
+      if (r.symhash_size)
+        std::cout << std::setw (16) << "symhash" << ": "
+                  << std::setw (6) << r.symhash_size
+                  << std::setw (7) << '-'
+                  << std::hex << std::setfill ('0')
+                  << " 0x" << std::setw (8) << r.symhash_rap_off
+                  << std::setfill (' ') << std::dec
+                  << " (" << r.symhash_rap_off << ')' << std::endl;
+      if (r.rhdr_version >= rld::rap::rap_version_imports)
+        std::cout << std::setw (16) << "imports" << ": "
+                  << std::setw (6) << r.imports_size
+                  << std::setw (7) << '-'
+                  << std::hex << std::setfill ('0')
+                  << " 0x" << std::setw (8) << r.imports_rap_off
+                  << std::setfill (' ') << std::dec
+                  << " (" << r.imports_rap_off << ')' << std::endl;
+      std::cout << std::setw (16) << "relocs" << ": "
+                << std::setw (6) << r.relocs_rap_size
                 << std::setw (7) << '-'
                 << std::hex << std::setfill ('0')
                 << " 0x" << std::setw (8) << r.relocs_rap_off
@@ -928,6 +1125,70 @@ rap_show (rld::files::paths& raps,
         std::cout << std::setw (16) << " "
                   << "No symbol table found." << std::endl;
       }
+
+      if (r.symhash_size)
+      {
+        int failures = 0;
+        for (int s = 0; s < r.symbols (); ++s)
+        {
+          uint32_t data;
+          uint32_t name;
+          uint32_t value;
+          r.symbol (s, data, name, value);
+          int found = r.symbol_lookup ((const char*) &r.strtab[name]);
+          if (found != s)
+          {
+            std::cout << " error: hash lookup failed: " << &r.strtab[name]
+                      << " index=" << s << " found=" << found << std::endl;
+            ++failures;
+          }
+        }
+        std::cout << "  Symbol Hash: 0x"
+                  << std::hex << std::setfill ('0')
+                  << std::setw (8) << r.symhash_rap_off
+                  << std::setfill (' ') << std::dec
+                  << " (" << r.symhash_rap_off << ')'
+                  << " size: " << r.symhash_size
+                  << " buckets: " << r.symhash[0]
+                  << " bloom: " << r.symhash[1]
+                  << (failures ? " invalid" : " valid")
+                  << std::endl;
+      }
+    }
+
+    if (show_imports)
+    {
+      std::cout << "  Imports: 0x"
+                << std::hex << std::setfill ('0')
+                << std::setw (8) << r.imports_rap_off
+                << std::setfill (' ') << std::dec
+                << " (" << r.imports_rap_off << ')'
+                << " size: " << r.imports_size
+                << std::endl;
+      if (!r.imps.empty ())
+      {
+        std::cout << std::setw (18) << "  "
+                  << "  hash       name" << std::endl;
+        for (size_t i = 0; i < r.imps.size (); ++i)
+        {
+          const char* name = r.import_name (i);
+          uint32_t    hash = rld::rap::symbol_hash (name);
+          std::cout << std::setw (16) << i << ": "
+                    << std::hex << std::setfill ('0')
+                    << "0x" << std::setw (8) << r.imps[i].hash
+                    << std::dec << std::setfill (' ')
+                    << " " << name;
+          if (hash != r.imps[i].hash)
+            std::cout << std::hex << " (hash invalid, expected 0x"
+                      << hash << ')' << std::dec;
+          std::cout << std::endl;
+        }
+      }
+      else
+      {
+        std::cout << std::setw (16) << " "
+                  << "No import table found." << std::endl;
+      }
     }
 
     if (show_relocs)
@@ -1079,6 +1340,7 @@ static struct option rld_opts[] = {
   { "strings",     no_argument,            NULL,           's' },
   { "symbols",     no_argument,            NULL,           'S' },
   { "relocs",      no_argument,            NULL,           'r' },
+  { "imports",     no_argument,            NULL,           'i' },
   { "overlay",     no_argument,            NULL,           'o' },
   { "expand",      no_argument,            NULL,           'x' },
   { NULL,          0,                      NULL,            0 }
@@ -1101,6 +1363,7 @@ usage (int exit_code)
             << " -s        : show strings (also --strings)" << std::endl
             << " -S        : show symbols (also --symbols)" << std::endl
             << " -r        : show relocations (also --relocs)" << std::endl
+            << " -i        : show the import table (also --imports)" << std::endl
             << " -o        : linkage overlay (also --overlay)" << std::endl
             << " -x        : expand (also --expand)" << std::endl
             << " -f        : show file details" << std::endl;
@@ -1159,13 +1422,14 @@ main (int argc, char* argv[])
     bool              show_strings = false;
     bool              show_symbols = false;
     bool              show_relocs = false;
+    bool              show_imports = false;
     bool              show_details = false;
     bool              overlay = false;
     bool              expand = false;
 
     while (true)
     {
-      int opt = ::getopt_long (argc, argv, "hvVnaHlsSroxf", rld_opts, NULL);
+      int opt = ::getopt_long (argc, argv, "hvVnaHlsSrioxf", rld_opts, NULL);
       if (opt < 0)
         break;
 
@@ -1193,6 +1457,7 @@ main (int argc, char* argv[])
           show_strings = true;
           show_symbols = true;
           show_relocs = true;
+          show_imports = true;
           show_details = true;
           break;
 
@@ -1226,6 +1491,11 @@ main (int argc, char* argv[])
           show_relocs = true;
           break;
 
+        case 'i':
+          show = true;
+          show_imports = true;
+          break;
+
         case 'o':
           overlay = true;
           break;
@@ -1271,6 +1541,7 @@ main (int argc, char* argv[])
                 show_strings,
                 show_symbols,
                 show_relocs,
+                show_imports,
                 show_details);
 
     if (overlay)
@@ -38,9 +38,12 @@
 
 #include <rld.h>
 #include <rld-cc.h>
+#include <rld-map.h>
 #include <rld-outputter.h>
 #include <rld-process.h>
 #include <rld-resolver.h>
+#include <rld-stats.h>
+#include <rld-trace.h>
 
 #ifndef HAVE_KILL
 #define kill(p,s) raise(s)
@@ -62,6 +65,8 @@ static struct option rld_opts[] = {
   { "exec-prefix", required_argument,      NULL,           'E' },
   { "march",       required_argument,      NULL,           'a' },
   { "mcpu",        required_argument,      NULL,           'c' },
+  { "stats",       optional_argument,      NULL,           'T' },
+  { "trace",       required_argument,      NULL,           'Y' },
   { NULL,          0,                      NULL,            0 }
 };
 
@@ -83,7 +88,17 @@ usage (int exit_code)
             << " -C file   : execute file as the target C compiler (also --cc)" << std::endl
             << " -E prefix : the RTEMS tool prefix (also --exec-prefix)" << std::endl
             << " -a march  : machine architecture (also --march)" << std::endl
-            << " -c cpu    : machine architecture's CPU (also --mcpu)" << std::endl;
+            << " -c cpu    : machine architecture's CPU (also --mcpu)" << std::endl
+            << " -T[opts]  : output the time of each phase and counts of the work" << std::endl
+            << "             done, opts is a comma separated list of 'json' to" << std::endl
+            << "             output JSON and 'memory' to add the memory used by" << std::endl
+            << "             each category of data (also --stats[=opts])" << std::endl
+            << " -Y file   : write a Chrome trace event file of the time spent on" << std::endl
+            << "             each file, library and section (also --trace)" << std::endl
+            << "Compiler cache:" << std::endl
+            << " The compiler's search paths and libraries are cached in" << std::endl
+            << " ~/.rtems-ld-cc.cache. Set RTEMS_LD_CC_CACHE to use another" << std::endl
+            << " file or to an empty string to not cache." << std::endl;
   ::exit (exit_code);
 }
 
@@ -148,7 +163,7 @@ main (int argc, char* argv[])
 
     while (true)
     {
-      int opt = ::getopt_long (argc, argv, "hvwVSE:L:l:a:c:C:", rld_opts, NULL);
+      int opt = ::getopt_long (argc, argv, "hvwVSE:L:l:a:c:C:T::Y:", rld_opts, NULL);
       if (opt < 0)
         break;
 
@@ -211,6 +226,14 @@ main (int argc, char* argv[])
           usage (3);
           break;
 
+        case 'T':
+          rld::stats::parse (optarg);
+          break;
+
+        case 'Y':
+          rld::trace::open (optarg);
+          break;
+
         case 'h':
           usage (0);
           break;
@@ -293,7 +316,9 @@ main (int argc, char* argv[])
        */
       cache.load_symbols (symbols);
 
-      rld::map (cache, symbols);
+      rld::map::writer map (rld::map::text);
+      map.write ("symbols", cache, symbols);
+      map.close ();
     }
     catch (...)
     {
@@ -332,5 +357,8 @@ main (int argc, char* argv[])
     ec = 12;
   }
 
+  rld::stats::report (std::cout, "rtems-syms");
+  rld::trace::close ();
+
   return ec;
 }